@@ -1,15 +1,32 @@
 #!/usr/bin/env python3
 import argparse
+import struct
 from sentence_transformers import SentenceTransformer
 import numpy as np
 import ijson
 
+# 二进制向量文件格式，与 src/lemvecfile.hpp 保持一致：
+# [64 字节 header: magic(8) version(u32) dim(u32) count(u64) 保留(40)][count*dim 个 float32][count 个 uint64 词条ID]
+VECFILE_MAGIC = b"LEMVEC\0\0"
+VECFILE_VERSION = 1
+
+
+def pack_header(dim, count):
+    return struct.pack("<8sIIQ40x", VECFILE_MAGIC, VECFILE_VERSION, dim, count)
+
+
+def parse_lexeme_id(lexeme_id):
+    return int(lexeme_id[1:]) if lexeme_id.startswith("L") else int(lexeme_id)
+
 def main():
     parser = argparse.ArgumentParser(description="将简化后的 JSON 文件中每个词条的 combined_text 向量化，并输出到文本文件")
     parser.add_argument("--input", type=str, required=True, help="输入的 JSON 文件路径")
     parser.add_argument("--output", type=str, required=True, help="输出向量文件路径")
     parser.add_argument("--model", type=str, default="all-MiniLM-L6-v2", help="Sentence‑BERT 模型名称或路径")
+    parser.add_argument("--format", type=str, choices=["txt", "bin"], default=None,
+                        help="输出格式：txt 为旧的文本格式，bin 为二进制格式；默认按输出文件扩展名判断")
     args = parser.parse_args()
+    out_format = args.format or ("bin" if args.output.endswith(".bin") else "txt")
 
     # 1. 加载 Sentence‑BERT 模型
     print("正在加载模型：", args.model)
@@ -18,6 +35,9 @@ def main():
     # 2. 打开输出文件准备写入
     print("正在读取 JSON 文件：", args.input)
     processed_count = 0  # 用于记录已处理的词条数量
+    if out_format == "bin":
+        write_binary(model, args.input, args.output)
+        return
     with open(args.output, 'w', encoding='utf-8') as fout:
         # 使用 ijson 逐行解析 JSON 文件
         with open(args.input, 'r', encoding='utf-8') as fin:
@@ -46,5 +66,40 @@ def main():
 
     print("向量化完成，结果已保存到：", args.output)
 
+def write_binary(model, input_path, output_path):
+    """向量按行写入 float32 矩阵，ID 列在最后追加，写完后回填 header 中的 dim 和 count"""
+    processed_count = 0
+    dim = 0
+    ids = []
+    with open(output_path, 'wb') as fout:
+        fout.write(pack_header(0, 0))  # 先占位
+        with open(input_path, 'r', encoding='utf-8') as fin:
+            for entry in ijson.items(fin, 'item'):
+                if entry.get("language", "").lower() != "en":
+                    continue
+                lexeme_id = entry.get("id", "")
+                combined_text = entry.get("combined_text", "")
+                if not combined_text:
+                    continue
+                try:
+                    numeric_id = parse_lexeme_id(lexeme_id)
+                except ValueError:
+                    continue
+
+                embedding = np.asarray(model.encode(combined_text), dtype="<f4")
+                dim = dim or embedding.shape[0]
+                fout.write(embedding.tobytes())
+                ids.append(numeric_id)
+
+                processed_count += 1
+                if processed_count % 100 == 0:
+                    print(f"已处理 {processed_count} 个词条")
+        fout.write(np.asarray(ids, dtype="<u8").tobytes())
+        fout.seek(0)
+        fout.write(pack_header(dim, len(ids)))
+
+    print("向量化完成，结果已保存到：", output_path)
+
+
 if __name__ == "__main__":
     main()
\ No newline at end of file
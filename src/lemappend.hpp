@@ -0,0 +1,160 @@
+#pragma once
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <algorithm>
+
+// 内存段（MemSegment）使用的只追加容器：只有一个写线程追加，任意多个查询线程不加锁地同时读取。
+// 写线程先写好元素，再以 release 语义发布新的长度；读线程以 acquire 语义读到长度 n 后，前 n 个元素都已写完、不再改变。
+// 扩容时新开一块两倍大的缓冲区，拷贝已有元素后再发布，旧缓冲区不释放（正在读它的查询仍然有效），随容器一起释放，
+// 总占用不超过最终大小的两倍。查询只读取获取视图时已发布的部分，写入与查询之间没有锁，也就不会互相等待。
+
+namespace ns_index {
+
+// 只追加的数组。读取时先取 size() 再取 data()：data() 至少与读到的长度一样新，旧缓冲区中也有这些元素的副本
+template <typename T>
+class AppendVector {
+public:
+    AppendVector() = default;
+    AppendVector(const AppendVector&) = delete;
+    AppendVector& operator=(const AppendVector&) = delete;
+
+    // ---- 写线程 ----
+    void push_back(const T& value) {
+        size_t n = size_.load(std::memory_order_relaxed);
+        Reserve(n + 1);
+        buffers_.back()[n] = value;
+        size_.store(n + 1, std::memory_order_release);
+    }
+
+    template <typename It>
+    void append(It first, It last) {
+        size_t n = size_.load(std::memory_order_relaxed);
+        size_t count = static_cast<size_t>(std::distance(first, last));
+        if (count == 0) {
+            return;
+        }
+        Reserve(n + count);
+        std::copy(first, last, buffers_.back().get() + n);
+        size_.store(n + count, std::memory_order_release);
+    }
+
+    // ---- 读线程 ----
+    size_t size() const { return size_.load(std::memory_order_acquire); }
+    const T* data() const { return data_.load(std::memory_order_acquire); }
+
+private:
+    void Reserve(size_t count) {
+        if (count <= capacity_) {
+            return;
+        }
+        size_t capacity = std::max<size_t>({count, capacity_ * 2, 4});
+        std::unique_ptr<T[]> buffer(new T[capacity]);
+        if (!buffers_.empty()) {
+            std::copy(buffers_.back().get(), buffers_.back().get() + size_.load(std::memory_order_relaxed), buffer.get());
+        }
+        data_.store(buffer.get(), std::memory_order_release);
+        buffers_.push_back(std::move(buffer));
+        capacity_ = capacity;
+    }
+
+    std::atomic<size_t> size_{0};
+    std::atomic<T*> data_{nullptr};
+    size_t capacity_ = 0;                        // 只由写线程访问
+    std::vector<std::unique_ptr<T[]>> buffers_;  // 最后一块为当前缓冲区，只由写线程访问
+};
+
+// 只追加的 关键词 -> V 映射：开放寻址的散列表，槽位是指向条目的原子指针；条目插入后地址不变，值由调用方只追加地修改。
+// 装载率超过一半时换一张两倍大的表，旧表同样保留到映射释放
+template <typename V>
+class AppendTermMap {
+public:
+    struct Entry {
+        explicit Entry(std::string k) : key(std::move(k)) {}
+        std::string key;
+        V value;
+    };
+
+    AppendTermMap() { Rehash(16); }
+    AppendTermMap(const AppendTermMap&) = delete;
+    AppendTermMap& operator=(const AppendTermMap&) = delete;
+
+    // ---- 写线程：取出 key 对应的值，不存在时插入一个默认值 ----
+    V& Upsert(const std::string& key) {
+        const Table& table = *tables_.back();
+        size_t slot = Probe(table, key);
+        if (Entry* entry = table.slots[slot].load(std::memory_order_relaxed)) {
+            return entry->value;
+        }
+        storage_.emplace_back(key);
+        Entry* entry = &storage_.back();
+        if (storage_.size() * 2 > table.mask + 1) {
+            Rehash((table.mask + 1) * 2);
+            slot = Probe(*tables_.back(), key);
+        }
+        tables_.back()->slots[slot].store(entry, std::memory_order_release);
+        entries_.push_back(entry);
+        return entry->value;
+    }
+
+    // ---- 读线程 ----
+    const V* Find(std::string_view key) const {
+        const Table& table = *table_.load(std::memory_order_acquire);
+        const Entry* entry = table.slots[Probe(table, key)].load(std::memory_order_acquire);
+        return entry != nullptr ? &entry->value : nullptr;
+    }
+
+    // 按插入顺序逐个产出已发布的条目 emit(const Entry&)
+    template <typename Emit>
+    void ForEach(Emit emit) const {
+        size_t count = entries_.size();
+        const Entry* const* entries = entries_.data();
+        for (size_t i = 0; i < count; ++i) {
+            emit(*entries[i]);
+        }
+    }
+
+private:
+    struct Table {
+        size_t mask;
+        std::unique_ptr<std::atomic<Entry*>[]> slots;
+    };
+
+    // key 所在的槽位，或探测到的第一个空槽位
+    static size_t Probe(const Table& table, std::string_view key) {
+        size_t slot = std::hash<std::string_view>()(key) & table.mask;
+        while (const Entry* entry = table.slots[slot].load(std::memory_order_acquire)) {
+            if (entry->key == key) {
+                break;
+            }
+            slot = (slot + 1) & table.mask;
+        }
+        return slot;
+    }
+
+    void Rehash(size_t size) {
+        std::unique_ptr<Table> table(new Table{size - 1, std::unique_ptr<std::atomic<Entry*>[]>(new std::atomic<Entry*>[size])});
+        for (size_t i = 0; i < size; ++i) {
+            table->slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+        size_t count = entries_.size();
+        for (size_t i = 0; i < count; ++i) {
+            Entry* entry = entries_.data()[i];
+            table->slots[Probe(*table, entry->key)].store(entry, std::memory_order_relaxed);
+        }
+        table_.store(table.get(), std::memory_order_release);
+        tables_.push_back(std::move(table));
+    }
+
+    std::deque<Entry> storage_;                 // 只由写线程追加，元素地址不变
+    AppendVector<Entry*> entries_;              // 按插入顺序，供读线程遍历
+    std::atomic<const Table*> table_{nullptr};
+    std::vector<std::unique_ptr<Table>> tables_;  // 最后一张为当前的表，只由写线程访问
+};
+
+} // namespace ns_index
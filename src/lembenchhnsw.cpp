@@ -0,0 +1,271 @@
+// lembenchhnsw.cpp
+// HNSW 参数扫描：按网格组合 M、ef_construction、ef_search，在词条向量上构建 HNSW 并检索，
+// 以精确检索（FlatEngine）的结果为基准统计 recall@k，同时记录 QPS、p50/p99 延迟、构建耗时和内存占用，
+// 结果输出到终端并写入 JSON 报告。
+// 用法: ./lembenchhnsw [选项] [lexeme_vectors.bin]
+//   --queries FILE      查询向量文件（与 lexeme_vectors.bin 格式相同），缺省时从语料中等间隔抽取，
+//                       抽出的向量不放入索引（否则每个查询的最近邻都是它自己，recall 偏高）
+//   --num-queries N     从语料中抽取的查询数，默认 1000
+//   --m LIST            逗号分隔的 M 取值，默认 8,16,32
+//   --efc LIST          逗号分隔的 ef_construction 取值，默认 100,200,400
+//   --ef LIST           逗号分隔的 ef_search 取值，默认 16,32,64,128,256；小于 k 的按 k 检索，报告中记录实际的值
+//   --k N               每个查询返回的结果数，默认 20
+//   --threads N         构建 HNSW 和计算基准的线程数，默认使用全部硬件线程
+//   --vector-threads N  只改变构建 HNSW 的线程数，基准仍按 --threads 计算
+//   --deterministic     单线程按序号插入 HNSW，重复运行得到相同的图和 recall（构建耗时随之变长）
+//   --int8              HNSW 中存放 int8 量化向量（查询时取 ef 个候选精排）
+//   --report FILE       JSON 报告路径，默认 ./data/hnsw_sweep.json
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include <unistd.h>
+#include <jsoncpp/json/json.h>
+#include "lemvecfile.hpp"
+#include "lemflat.hpp"
+
+// 当前进程的常驻内存（字节）
+static size_t ResidentBytes()
+{
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    if (!(statm >> pages >> resident))
+        return 0;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+static bool ParseList(const std::string &text, std::vector<size_t> *values)
+{
+    values->clear();
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        char *end = nullptr;
+        unsigned long value = std::strtoul(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || value == 0)
+            return false;
+        values->push_back(value);
+    }
+    return !values->empty();
+}
+
+// 有序数组的分位数
+static double Percentile(const std::vector<double> &sorted, double p)
+{
+    if (sorted.empty())
+        return 0.0;
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+int main(int argc, char *argv[])
+{
+    std::string vector_input = "./data/lexeme_vectors.bin";
+    std::string query_input;
+    std::string report_output = "./data/hnsw_sweep.json";
+    size_t num_queries = 1000;
+    size_t k = 20;
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    int vector_threads = 0;
+    bool deterministic = false;
+    bool quantize = false;
+    std::vector<size_t> ms = {8, 16, 32}, efcs = {100, 200, 400}, efs = {16, 32, 64, 128, 256};
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        bool ok = true;
+        if (arg == "--queries" && has_value) {
+            query_input = argv[++i];
+        } else if (arg == "--num-queries" && has_value) {
+            num_queries = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--m" && has_value) {
+            ok = ParseList(argv[++i], &ms);
+        } else if (arg == "--efc" && has_value) {
+            ok = ParseList(argv[++i], &efcs);
+        } else if (arg == "--ef" && has_value) {
+            ok = ParseList(argv[++i], &efs);
+        } else if (arg == "--k" && has_value) {
+            k = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--threads" && has_value) {
+            threads = std::atoi(argv[++i]);
+        } else if (arg == "--vector-threads" && has_value) {
+            vector_threads = std::atoi(argv[++i]);
+            ok = vector_threads > 0;
+        } else if (arg == "--deterministic") {
+            deterministic = true;
+        } else if (arg == "--int8") {
+            quantize = true;
+        } else if (arg == "--report" && has_value) {
+            report_output = argv[++i];
+        } else if (arg.compare(0, 2, "--") != 0) {
+            vector_input = arg;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            std::cerr << "无效的参数: " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (k == 0) {
+        std::cerr << "k 必须大于 0。" << std::endl;
+        return 1;
+    }
+
+    // 语料向量直接使用映射内存，向量的序号即 HNSW 的 label
+    ns_vecfile::VecFileReader corpus;
+    if (!corpus.Open(vector_input))
+        return 1;
+    size_t dim = corpus.dim();
+    std::vector<const float*> sources(corpus.count());
+    for (size_t i = 0; i < corpus.count(); ++i)
+        sources[i] = corpus.vector(i);
+
+    std::vector<float> queries;
+    ns_vecfile::VecFileReader query_file;
+    if (!query_input.empty()) {
+        if (!query_file.Open(query_input))
+            return 1;
+        if (query_file.dim() != dim) {
+            std::cerr << "查询向量维度 " << query_file.dim() << " 与语料维度 " << dim << " 不一致。" << std::endl;
+            return 1;
+        }
+        queries.assign(query_file.vector(0), query_file.vector(0) + query_file.count() * dim);
+    } else {
+        // 抽出的查询从语料中去掉，基准和 HNSW 都只含其余的向量
+        num_queries = std::min(num_queries, corpus.count() / 2);
+        for (size_t i = 0; i < num_queries; ++i) {
+            size_t row = i * corpus.count() / num_queries;
+            queries.insert(queries.end(), corpus.vector(row), corpus.vector(row) + dim);
+            sources[row] = nullptr;
+        }
+    }
+    size_t nq = dim == 0 ? 0 : queries.size() / dim;
+    if (nq == 0 || corpus.count() == 0) {
+        std::cerr << "语料或查询为空。" << std::endl;
+        return 1;
+    }
+    size_t indexed = 0;
+    for (const float *vec : sources)
+        indexed += vec != nullptr;
+    std::cout << "语料 " << indexed << " 个向量，" << dim << " 维；查询 " << nq << " 个，k = " << k << std::endl;
+
+    // 检索时的候选队列长度为 max(ef, k)，小于 k 的 ef 按 k 检索；换算后重复的取值只测一次
+    std::vector<size_t> effective_efs;
+    for (size_t ef : efs) {
+        size_t effective = std::max(ef, k);
+        if (effective != ef)
+            std::cout << "ef = " << ef << " 小于 k，按 ef = " << effective << " 检索。" << std::endl;
+        if (std::find(effective_efs.begin(), effective_efs.end(), effective) == effective_efs.end())
+            effective_efs.push_back(effective);
+    }
+
+    // 基准：精确检索的前 k 个
+    ns_index::BuildOptions options;
+    options.progress_interval = 0;
+    options.vector_threads = vector_threads > 0 ? vector_threads : threads;
+    options.deterministic = deterministic;
+    options.quantize_vectors = quantize;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::vector<ns_index::VectorHit>> truth;
+    {
+        ns_index::FlatEngine flat(static_cast<int>(dim));
+        flat.Build(sources, sources.size(), options);
+        flat.SearchBatch(queries.data(), nq, k, threads, &truth);
+    }
+    double truth_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "精确检索基准计算完毕，耗时 " << truth_secs << " 秒。" << std::endl;
+
+    Json::Value report;
+    report["vectors"] = static_cast<Json::UInt64>(indexed);
+    report["held_out_queries"] = query_input.empty();
+    report["dim"] = static_cast<Json::UInt64>(dim);
+    report["queries"] = static_cast<Json::UInt64>(nq);
+    report["k"] = static_cast<Json::UInt64>(k);
+    report["int8"] = quantize;
+    report["build_threads"] = deterministic ? 1 : options.vector_threads;
+    report["deterministic"] = deterministic;
+    report["ground_truth_seconds"] = truth_secs;
+    Json::Value &results = report["results"];
+    results = Json::Value(Json::arrayValue);
+
+    std::cout << "M\tefC\tef\trecall@" << k << "\tQPS\tp50(ms)\tp99(ms)\t构建(s)\t内存(MB)" << std::endl;
+    for (size_t m : ms) {
+        for (size_t efc : efcs) {
+            options.hnsw_m = m;
+            options.hnsw_ef_construction = efc;
+            // 先把上一轮释放的内存归还给系统，两次常驻内存之差才是本轮索引的占用
+            malloc_trim(0);
+            size_t rss_before = ResidentBytes();
+            start = std::chrono::steady_clock::now();
+            ns_index::HnswEngine engine(static_cast<int>(dim));
+            if (!engine.Build(sources, sources.size(), options)) {
+                std::cerr << "构建 HNSW 失败：M = " << m << "，ef_construction = " << efc << std::endl;
+                return 1;
+            }
+            double build_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            size_t rss_after = ResidentBytes();
+            size_t memory = rss_after > rss_before ? rss_after - rss_before : 0;
+
+            for (size_t ef : effective_efs) {
+                // 单线程依次检索，延迟不受其他查询干扰；ef 作为每个查询的搜索宽度传入（int8 时同时是精排的候选数）
+                std::vector<double> latencies(nq);
+                size_t found = 0;
+                auto search_start = std::chrono::steady_clock::now();
+                for (size_t q = 0; q < nq; ++q) {
+                    std::vector<ns_index::VectorHit> hits;
+                    auto t0 = std::chrono::steady_clock::now();
+                    engine.Search(queries.data() + q * dim, k, ef, &hits);
+                    latencies[q] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+                    for (const auto &expect : truth[q]) {
+                        for (const auto &hit : hits) {
+                            if (hit.ordinal == expect.ordinal) {
+                                ++found;
+                                break;
+                            }
+                        }
+                    }
+                }
+                double search_secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - search_start).count();
+                std::sort(latencies.begin(), latencies.end());
+                size_t expected = 0;
+                for (const auto &hits : truth)
+                    expected += hits.size();
+                double recall = expected == 0 ? 1.0 : static_cast<double>(found) / expected;
+                double qps = search_secs > 0 ? nq / search_secs : 0.0;
+
+                Json::Value row;
+                row["m"] = static_cast<Json::UInt64>(m);
+                row["ef_construction"] = static_cast<Json::UInt64>(efc);
+                row["ef_search"] = static_cast<Json::UInt64>(ef);
+                row["recall"] = recall;
+                row["qps"] = qps;
+                row["p50_ms"] = Percentile(latencies, 0.50);
+                row["p99_ms"] = Percentile(latencies, 0.99);
+                row["build_seconds"] = build_secs;
+                row["memory_bytes"] = static_cast<Json::UInt64>(memory);
+                results.append(row);
+                std::cout << m << "\t" << efc << "\t" << ef << "\t" << recall << "\t" << qps << "\t"
+                          << row["p50_ms"].asDouble() << "\t" << row["p99_ms"].asDouble() << "\t"
+                          << build_secs << "\t" << memory / (1024.0 * 1024.0) << std::endl;
+            }
+        }
+    }
+
+    std::ofstream out(report_output);
+    if (!out.is_open()) {
+        std::cerr << "无法写入报告: " << report_output << std::endl;
+        return 1;
+    }
+    Json::StyledWriter writer;
+    out << writer.write(report);
+    std::cout << "报告已写入: " << report_output << std::endl;
+    return 0;
+}
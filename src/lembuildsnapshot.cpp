@@ -0,0 +1,72 @@
+// lembuildsnapshot.cpp
+// 离线构建索引快照：解析简化后的 JSON、分词、加载向量并构建向量索引，
+// 然后把结果写入快照目录，lemserver 启动时直接 mmap 加载，无需重新构建。
+// 用法: ./lembuildsnapshot [--int8 | --ivfpq [--ivfpq-rerank] | --flat] [--no-positions]
+//                         [--threads N] [--vector-threads N] [--deterministic] [simplified_lexemes.json] [lexeme_vectors.bin] [输出目录]
+//   --int8   HNSW 中存放 int8 量化向量，查询时用原始向量精排
+//   --ivfpq  用 IVF-PQ 代替 HNSW，每个词条的向量只存几十字节的编码，查询按编码的近似内积排序
+//   --ivfpq-rerank  同 --ivfpq，另存有向量的词条的原始向量（每个多占 dim * 4 字节），查询时用它精排候选
+//   --flat   不建近似索引，查询时暴力扫描全部向量，结果精确
+//   --no-positions  位置倒排只记录文档、不保留位置，快照更小，+/- 条件不变，短语查询退化为各词同时出现
+//   --threads N         解析和分词的线程数，默认使用全部硬件线程，1 表示单线程流式构建（同样的输入结果与多线程相同）
+//   --vector-threads N  构建向量索引的线程数，默认使用全部硬件线程
+//   --deterministic     单线程按文档序号插入 HNSW，同样的输入每次得到完全相同的图（构建较慢）
+#include "lemindex.hpp"
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <memory>
+#include <vector>
+
+int main(int argc, char *argv[])
+{
+    std::string input = "./data/simplified_lexemes.json";
+    std::string vector_input = "./data/lexeme_vectors.bin";
+    std::string snapshot_output = "./data/lexeme_index";
+    ns_index::BuildOptions options;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--int8") {
+            options.quantize_vectors = true;
+        } else if (std::string(argv[i]) == "--ivfpq") {
+            options.vector_engine = ns_index::VECTOR_ENGINE_IVFPQ;
+        } else if (std::string(argv[i]) == "--ivfpq-rerank") {
+            options.vector_engine = ns_index::VECTOR_ENGINE_IVFPQ;
+            options.ivf_rerank = true;
+        } else if (std::string(argv[i]) == "--flat") {
+            options.vector_engine = ns_index::VECTOR_ENGINE_FLAT;
+        } else if (std::string(argv[i]) == "--no-positions") {
+            options.positions = false;
+        } else if (std::string(argv[i]) == "--threads" && i + 1 < argc) {
+            options.threads = std::atoi(argv[++i]);
+            if (options.threads <= 0) {
+                std::cerr << "无效的线程数: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::string(argv[i]) == "--vector-threads" && i + 1 < argc) {
+            options.vector_threads = std::atoi(argv[++i]);
+            if (options.vector_threads <= 0) {
+                std::cerr << "无效的向量构建线程数: " << argv[i] << std::endl;
+                return 1;
+            }
+        } else if (std::string(argv[i]) == "--deterministic") {
+            options.deterministic = true;
+        } else {
+            args.push_back(argv[i]);
+        }
+    }
+    if (args.size() > 0) input = args[0];
+    if (args.size() > 1) vector_input = args[1];
+    if (args.size() > 2) snapshot_output = args[2];
+
+    std::unique_ptr<ns_index::Index> index(new ns_index::Index());
+    if (!index->BuildIndex(input, vector_input, options)) {
+        std::cerr << "索引构建失败，未生成快照。" << std::endl;
+        return 1;
+    }
+    if (!index->SaveSnapshot(snapshot_output)) {
+        std::cerr << "保存索引快照失败。" << std::endl;
+        return 1;
+    }
+    return 0;
+}
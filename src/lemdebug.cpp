@@ -5,12 +5,13 @@
 #include <string>    
     
 const std::string input = "./data/simplified_lexemes.json";    
-const std::string vector_input = "./data/lexeme_vectors.txt";    
+const std::string vector_input = "./data/lexeme_vectors.bin";    
+const std::string snapshot_input = "./data/lexeme_index";    // 由 lembuildsnapshot 离线生成
 
 int main()    
 {    
     ns_searcher::Searcher *search = new ns_searcher::Searcher();    
-    search->InitSearcher(input,vector_input);  //初始化search，创建单例，并构建索引  
+    search->InitSearcher(input,vector_input,snapshot_input);  //初始化search，并构建索引  
     
     // 初始化结束标志：###INITEND###
     std::cout << "###INITEND###" << std::endl;
@@ -31,6 +32,13 @@ int main()
         
         std::string input_text = root.get("input_text", "").asString();
         std::string embedding_str = root.get("embedding", "").asString();
+        ns_searcher::SearchOptions options;    // 可选的 k、ef、exact、fuzzy、offset、limit，含义同 /s 接口
+        options.k = root.get("k", 20).asUInt();
+        options.ef = root.get("ef", 0).asUInt();
+        options.exact = root.get("exact", false).asBool();
+        options.fuzzy = root.get("fuzzy", false).asBool();
+        options.offset = root.get("offset", 0).asUInt();
+        options.limit = root.get("limit", static_cast<Json::UInt>(ns_searcher::DEFAULT_PAGE_SIZE)).asUInt();
         
         // 将 embedding_str 解析为 vector<float>
         std::vector<float> query_embedding;
@@ -46,7 +54,7 @@ int main()
         
         // 这里调用你的搜索函数，比如 SearchCombinedWithEmbedding(query_embedding, &json_result)
         std::string json_result;
-        search->SearchCombined(input_text,query_embedding,&json_result);
+        search->SearchCombined(input_text,query_embedding,&json_result,options);
         
         // 这里简单输出，实际应输出搜索结果
         std::cout << "收到查询文本: " << input_text << std::endl;
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// 不依赖 cppjieba 的文件与ID工具，lemvec2bin 等离线小工具只需包含本文件，
+// 不会在启动时加载分词词典
+
+namespace ns_util
+{
+    // 将 Wikidata 词条ID（如 "L123"，也兼容纯数字 "123"）转换为数值ID，失败时返回 false
+    inline bool ParseLexemeId(const std::string &str, uint64_t *id)
+    {
+        try {
+            if (!str.empty() && str.front() == 'L')
+                *id = std::stoull(str.substr(1));
+            else
+                *id = std::stoull(str);
+        } catch (...) {
+            return false;
+        }
+        return true;
+    }
+
+    // 只读内存映射文件：索引快照、二进制向量文件等大文件通过 mmap 直接映射，
+    // 由操作系统按需换页，避免一次性读入内存再拷贝
+    class MmapFile
+    {
+    public:
+        MmapFile() = default;
+        ~MmapFile() { Close(); }
+        MmapFile(const MmapFile&) = delete;
+        MmapFile& operator=(const MmapFile&) = delete;
+
+        bool Open(const std::string &path)
+        {
+            Close();
+            int fd = ::open(path.c_str(), O_RDONLY);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat st;
+            if (::fstat(fd, &st) != 0 || st.st_size == 0) {
+                ::close(fd);
+                return false;
+            }
+            void *addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            ::close(fd);  // 映射建立后即可关闭文件描述符
+            if (addr == MAP_FAILED) {
+                return false;
+            }
+            data_ = static_cast<const char*>(addr);
+            size_ = static_cast<size_t>(st.st_size);
+            return true;
+        }
+
+        void Close()
+        {
+            if (data_) {
+                ::munmap(const_cast<char*>(data_), size_);
+                data_ = nullptr;
+                size_ = 0;
+            }
+        }
+
+        const char* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool is_open() const { return data_ != nullptr; }
+
+    private:
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+
+    // 连续只读数组：既可以持有自己的 std::vector（构建时），也可以零拷贝地指向
+    // mmap 映射的快照内存（加载时），使用方无需关心数据来自哪里
+    template<typename T>
+    class MappedArray
+    {
+    public:
+        MappedArray() = default;
+        MappedArray(const MappedArray&) = delete;
+        MappedArray& operator=(const MappedArray&) = delete;
+        MappedArray(MappedArray&&) = default;
+        MappedArray& operator=(MappedArray&&) = default;
+
+        void Assign(std::vector<T> data)
+        {
+            owned_ = std::move(data);
+            data_ = owned_.data();
+            size_ = owned_.size();
+        }
+
+        void Map(const T *data, size_t size)
+        {
+            owned_ = std::vector<T>();
+            data_ = data;
+            size_ = size;
+        }
+
+        void Clear()
+        {
+            owned_ = std::vector<T>();
+            data_ = nullptr;
+            size_ = 0;
+        }
+
+        const T* data() const { return data_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        const T& operator[](size_t i) const { return data_[i]; }
+        const T* begin() const { return data_; }
+        const T* end() const { return data_ + size_; }
+
+    private:
+        std::vector<T> owned_;
+        const T *data_ = nullptr;
+        size_t size_ = 0;
+    };
+}
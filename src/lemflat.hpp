@@ -0,0 +1,375 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <functional>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEMFLAT_DISPATCH 1
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "lemvecengine.hpp"
+
+// 精确检索（暴力扫描）
+// 查询与每一行向量逐个求内积，结果与真实的最近邻完全一致，用于：
+//   小规模语料或过滤后的小子集直接精确检索；
+//   作为 HNSW、IVF-PQ 召回率评估的基准（ground truth）。
+// 内积有 AVX-512 / AVX2+FMA / SSE2 三种实现，x86 上用 GCC 的 target 属性分别编译，不依赖 -march 等编译选项，
+// 第一次检索时按 CPU 实际支持的指令集选用最快的一种（其他平台只有编译时可用的那种）。
+// 多个查询一起检索时按 "行块 x 4 个查询" 分块计算：一块行向量留在缓存中依次与各组查询求内积，
+// 每组 4 个查询共用一次行数据的加载（即分块的矩阵乘法）。行块在多个线程之间分配，
+// 每个线程为每个查询维护一个前 k 小顶堆，最后合并。
+
+namespace ns_index {
+
+namespace ns_flat {
+
+    const size_t QUERY_TILE = 4;   // 同时与一行求内积的查询数
+    const size_t ROW_TILE = 64;    // 一块行向量的行数（384 维时 96KB，留在 L2 中）
+    const size_t ROW_BLOCK = 4096; // 分给一个线程的行数
+
+    // 内积的两个核心函数，在定义了 Vec、VEC_WIDTH、VecZero/VecLoad/VecFma/VecAdd/VecSum 的命名空间中展开：
+    //   Dot：两个向量的内积，两路累加器隐藏 FMA 的延迟；
+    //   Dot4：4 个查询与同一行的内积，行数据每段只加载一次
+#define LEMFLAT_KERNELS                                                                          \
+    inline float Dot(const float* x, const float* y, size_t dim) {                              \
+        Vec acc0 = VecZero(), acc1 = VecZero();                                                  \
+        size_t i = 0;                                                                            \
+        for (; i + 2 * VEC_WIDTH <= dim; i += 2 * VEC_WIDTH) {                                   \
+            acc0 = VecFma(VecLoad(x + i), VecLoad(y + i), acc0);                                 \
+            acc1 = VecFma(VecLoad(x + i + VEC_WIDTH), VecLoad(y + i + VEC_WIDTH), acc1);         \
+        }                                                                                        \
+        for (; i + VEC_WIDTH <= dim; i += VEC_WIDTH) {                                           \
+            acc0 = VecFma(VecLoad(x + i), VecLoad(y + i), acc0);                                 \
+        }                                                                                        \
+        float sum = VecSum(VecAdd(acc0, acc1));                                                  \
+        for (; i < dim; ++i) {                                                                   \
+            sum += x[i] * y[i];                                                                  \
+        }                                                                                        \
+        return sum;                                                                              \
+    }                                                                                            \
+    inline void Dot4(const float* const* queries, const float* row, size_t dim, float* out) {    \
+        Vec acc0 = VecZero(), acc1 = VecZero(), acc2 = VecZero(), acc3 = VecZero();              \
+        size_t i = 0;                                                                            \
+        for (; i + VEC_WIDTH <= dim; i += VEC_WIDTH) {                                           \
+            Vec r = VecLoad(row + i);                                                            \
+            acc0 = VecFma(VecLoad(queries[0] + i), r, acc0);                                     \
+            acc1 = VecFma(VecLoad(queries[1] + i), r, acc1);                                     \
+            acc2 = VecFma(VecLoad(queries[2] + i), r, acc2);                                     \
+            acc3 = VecFma(VecLoad(queries[3] + i), r, acc3);                                     \
+        }                                                                                        \
+        out[0] = VecSum(acc0);                                                                   \
+        out[1] = VecSum(acc1);                                                                   \
+        out[2] = VecSum(acc2);                                                                   \
+        out[3] = VecSum(acc3);                                                                   \
+        for (; i < dim; ++i) {                                                                   \
+            for (size_t q = 0; q < QUERY_TILE; ++q) {                                            \
+                out[q] += queries[q][i] * row[i];                                                \
+            }                                                                                    \
+        }                                                                                        \
+    }
+
+    // 不依赖编译选项的基础实现：x86-64 上总有 SSE2
+    namespace ns_base {
+#if defined(__SSE2__)
+        typedef __m128 Vec;
+        const size_t VEC_WIDTH = 4;
+        inline Vec VecZero() { return _mm_setzero_ps(); }
+        inline Vec VecLoad(const float* p) { return _mm_loadu_ps(p); }
+        inline Vec VecFma(Vec a, Vec b, Vec c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+        inline Vec VecAdd(Vec a, Vec b) { return _mm_add_ps(a, b); }
+        inline float VecSum(Vec v) {
+            float lanes[4];
+            _mm_storeu_ps(lanes, v);
+            return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+        }
+#else
+        typedef float Vec;
+        const size_t VEC_WIDTH = 1;
+        inline Vec VecZero() { return 0.0f; }
+        inline Vec VecLoad(const float* p) { return *p; }
+        inline Vec VecFma(Vec a, Vec b, Vec c) { return a * b + c; }
+        inline Vec VecAdd(Vec a, Vec b) { return a + b; }
+        inline float VecSum(Vec v) { return v; }
+#endif
+        LEMFLAT_KERNELS
+    } // namespace ns_base
+
+#if defined(LEMFLAT_DISPATCH)
+#pragma GCC push_options
+#pragma GCC target("avx2,fma")
+    namespace ns_avx2 {
+        typedef __m256 Vec;
+        const size_t VEC_WIDTH = 8;
+        inline Vec VecZero() { return _mm256_setzero_ps(); }
+        inline Vec VecLoad(const float* p) { return _mm256_loadu_ps(p); }
+        inline Vec VecFma(Vec a, Vec b, Vec c) { return _mm256_fmadd_ps(a, b, c); }
+        inline Vec VecAdd(Vec a, Vec b) { return _mm256_add_ps(a, b); }
+        inline float VecSum(Vec v) {
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+            return _mm_cvtss_f32(sum);
+        }
+        LEMFLAT_KERNELS
+    } // namespace ns_avx2
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+    namespace ns_avx512 {
+        typedef __m512 Vec;
+        const size_t VEC_WIDTH = 16;
+        inline Vec VecZero() { return _mm512_setzero_ps(); }
+        inline Vec VecLoad(const float* p) { return _mm512_loadu_ps(p); }
+        inline Vec VecFma(Vec a, Vec b, Vec c) { return _mm512_fmadd_ps(a, b, c); }
+        inline Vec VecAdd(Vec a, Vec b) { return _mm512_add_ps(a, b); }
+        inline float VecSum(Vec v) { return _mm512_reduce_add_ps(v); }
+        LEMFLAT_KERNELS
+    } // namespace ns_avx512
+#pragma GCC pop_options
+#endif
+
+#undef LEMFLAT_KERNELS
+
+    // 当前 CPU 上使用的内积实现
+    struct Kernels {
+        float (*dot)(const float* x, const float* y, size_t dim);
+        void (*dot4)(const float* const* queries, const float* row, size_t dim, float* out);
+        const char* name;
+    };
+
+    inline const Kernels& SelectKernels() {
+        static const Kernels kernels = [] {
+#if defined(LEMFLAT_DISPATCH)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("avx512f")) {
+                return Kernels{ns_avx512::Dot, ns_avx512::Dot4, "AVX-512"};
+            }
+            if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+                return Kernels{ns_avx2::Dot, ns_avx2::Dot4, "AVX2+FMA"};
+            }
+#endif
+            return Kernels{ns_base::Dot, ns_base::Dot4, ns_base::VEC_WIDTH > 1 ? "SSE2" : "标量"};
+        }();
+        return kernels;
+    }
+
+    // 按相似度保留前 k 个结果的小顶堆
+    class TopK {
+    public:
+        explicit TopK(size_t k = 0) : k_(k) {}
+
+        void Push(float similarity, uint32_t id) {
+            if (heap_.size() < k_) {
+                heap_.push_back({id, similarity});
+                std::push_heap(heap_.begin(), heap_.end(), Greater);
+            } else if (k_ > 0 && similarity > heap_.front().similarity) {
+                std::pop_heap(heap_.begin(), heap_.end(), Greater);
+                heap_.back() = {id, similarity};
+                std::push_heap(heap_.begin(), heap_.end(), Greater);
+            }
+        }
+
+        void Merge(const TopK& other) {
+            for (const auto& hit : other.heap_) {
+                Push(hit.similarity, hit.ordinal);
+            }
+        }
+
+        // 按相似度降序排列的结果
+        std::vector<VectorHit> Sorted() const {
+            std::vector<VectorHit> hits(heap_);
+            std::sort(hits.begin(), hits.end(), [](const VectorHit& a, const VectorHit& b) {
+                return a.similarity > b.similarity || (a.similarity == b.similarity && a.ordinal < b.ordinal);
+            });
+            return hits;
+        }
+
+    private:
+        static bool Greater(const VectorHit& a, const VectorHit& b) { return a.similarity > b.similarity; }
+
+        size_t k_;
+        std::vector<VectorHit> heap_;
+    };
+
+    // 对 nrows 行做精确检索，row_of(i) 返回第 i 行的向量，返回 nullptr 表示跳过（没有向量或已删除）。
+    // queries 为 nq 个连续存放的查询，results[q] 为第 q 个查询按相似度降序的前 k 个结果，ordinal 为行号
+    template<typename RowOf>
+    void SearchRows(const float* queries, size_t nq, size_t nrows, size_t dim, size_t k, int threads,
+                    RowOf row_of, std::vector<std::vector<VectorHit>>* results) {
+        results->assign(nq, std::vector<VectorHit>());
+        if (nq == 0 || k == 0) {
+            return;
+        }
+        size_t blocks = (nrows + ROW_BLOCK - 1) / ROW_BLOCK;
+        threads = static_cast<int>(std::max<size_t>(1, std::min<size_t>(std::max(threads, 1), blocks)));
+        std::vector<std::vector<TopK>> tops(threads, std::vector<TopK>(nq, TopK(k)));
+        const Kernels& kernels = SelectKernels();
+        ns_util::ParallelFor(0, blocks, threads, [&](size_t block, int tid) {
+            std::vector<TopK>& top = tops[tid];
+            const float* rows[ROW_TILE];
+            uint32_t ids[ROW_TILE];
+            float scores[QUERY_TILE];
+            size_t end = std::min(nrows, (block + 1) * ROW_BLOCK);
+            size_t next = block * ROW_BLOCK;
+            while (next < end) {
+                // 收集一块有效的行，再让每组查询依次扫过这块行
+                size_t count = 0;
+                for (; next < end && count < ROW_TILE; ++next) {
+                    if (const float* row = row_of(next)) {
+                        rows[count] = row;
+                        ids[count] = static_cast<uint32_t>(next);
+                        ++count;
+                    }
+                }
+                size_t q = 0;
+                for (; q + QUERY_TILE <= nq; q += QUERY_TILE) {
+                    const float* group[QUERY_TILE];
+                    for (size_t t = 0; t < QUERY_TILE; ++t) {
+                        group[t] = queries + (q + t) * dim;
+                    }
+                    for (size_t r = 0; r < count; ++r) {
+                        kernels.dot4(group, rows[r], dim, scores);
+                        for (size_t t = 0; t < QUERY_TILE; ++t) {
+                            top[q + t].Push(scores[t], ids[r]);
+                        }
+                    }
+                }
+                for (; q < nq; ++q) {
+                    for (size_t r = 0; r < count; ++r) {
+                        top[q].Push(kernels.dot(queries + q * dim, rows[r], dim), ids[r]);
+                    }
+                }
+            }
+        });
+        for (size_t q = 0; q < nq; ++q) {
+            for (int t = 1; t < threads; ++t) {
+                tops[0][q].Merge(tops[t][q]);
+            }
+            (*results)[q] = tops[0][q].Sorted();
+        }
+    }
+
+} // namespace ns_flat
+
+// 精确检索引擎：有向量的文档按文档序号顺序连续存放为一个 float 矩阵，查询时整体扫描
+class FlatEngine : public VectorEngine {
+public:
+    explicit FlatEngine(int dim) : dim_(dim) {}
+
+    bool Build(const std::vector<const float*>& sources, size_t doc_count, const BuildOptions& options);
+    bool Load(const ns_snapshot::SnapshotReader& reader, size_t doc_count);
+
+    uint32_t Format() const override { return ns_snapshot::VECTOR_FLAT; }
+    bool Exact() const override { return true; }
+    void Search(const float* query, size_t k, size_t /*candidates*/, std::vector<VectorHit>* hits) const override {
+        std::vector<std::vector<VectorHit>> results;
+        SearchBatch(query, 1, k, 1, &results);
+        hits->insert(hits->end(), results[0].begin(), results[0].end());
+    }
+    const float* GetVector(uint32_t ordinal) const override;
+    void MarkDeleted(uint32_t ordinal) override;
+    bool Save(const std::string& dir, ns_snapshot::SnapshotWriter* writer) const override;
+
+    // 多个查询一起检索，按行块在 threads 个线程间并行，results[q] 中的 ordinal 为文档序号
+    void SearchBatch(const float* queries, size_t nq, size_t k, int threads,
+                     std::vector<std::vector<VectorHit>>* results) const;
+
+private:
+    void Prepare(size_t doc_count);
+
+    int dim_;
+    ns_util::MappedArray<float> matrix_;      // 行号 -> 向量，每行 dim 个
+    ns_util::MappedArray<uint32_t> labels_;   // 行号 -> 文档序号（升序）
+    std::vector<uint32_t> rows_;              // 文档序号 -> 行号，没有向量为 UINT32_MAX
+    std::unique_ptr<std::atomic<uint8_t>[]> deleted_;  // 行号 -> 是否已删除
+};
+
+bool FlatEngine::Build(const std::vector<const float*>& sources, size_t doc_count, const BuildOptions& options) {
+    std::vector<float> matrix;
+    std::vector<uint32_t> labels;
+    for (size_t ordinal = 0; ordinal < doc_count && ordinal < sources.size(); ++ordinal) {
+        if (sources[ordinal] != nullptr) {
+            matrix.insert(matrix.end(), sources[ordinal], sources[ordinal] + dim_);
+            labels.push_back(static_cast<uint32_t>(ordinal));
+        }
+    }
+    if (options.progress_interval > 0) {
+        std::cout << "精确检索向量矩阵构建完毕，共 " << labels.size() << " 个向量，内积使用 "
+                  << ns_flat::SelectKernels().name << " 实现。" << std::endl;
+    }
+    matrix_.Assign(std::move(matrix));
+    labels_.Assign(std::move(labels));
+    Prepare(doc_count);
+    return true;
+}
+
+bool FlatEngine::Load(const ns_snapshot::SnapshotReader& reader, size_t doc_count) {
+    if (!reader.GetArray(ns_snapshot::SECTION_FLAT_VECTORS, &matrix_) ||
+        !reader.GetArray(ns_snapshot::SECTION_FLAT_LABELS, &labels_) ||
+        matrix_.size() != labels_.size() * dim_) {
+        std::cerr << "快照精确检索向量损坏。" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < labels_.size(); ++i) {
+        if (labels_[i] >= doc_count || (i > 0 && labels_[i] <= labels_[i - 1])) {
+            std::cerr << "快照精确检索文档序号损坏。" << std::endl;
+            return false;
+        }
+    }
+    Prepare(doc_count);
+    return true;
+}
+
+void FlatEngine::Prepare(size_t doc_count) {
+    rows_.assign(doc_count, UINT32_MAX);
+    for (size_t i = 0; i < labels_.size(); ++i) {
+        rows_[labels_[i]] = static_cast<uint32_t>(i);
+    }
+    deleted_.reset(new std::atomic<uint8_t>[labels_.size()]);
+    for (size_t i = 0; i < labels_.size(); ++i) {
+        deleted_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool FlatEngine::Save(const std::string&, ns_snapshot::SnapshotWriter* writer) const {
+    writer->PutArray(ns_snapshot::SECTION_FLAT_VECTORS, matrix_.data(), matrix_.size());
+    writer->PutArray(ns_snapshot::SECTION_FLAT_LABELS, labels_.data(), labels_.size());
+    return true;
+}
+
+void FlatEngine::SearchBatch(const float* queries, size_t nq, size_t k, int threads,
+                             std::vector<std::vector<VectorHit>>* results) const {
+    ns_flat::SearchRows(queries, nq, labels_.size(), dim_, k, threads, [this](size_t row) -> const float* {
+        return deleted_[row].load(std::memory_order_relaxed) != 0 ? nullptr : matrix_.data() + row * dim_;
+    }, results);
+    for (auto& hits : *results) {
+        for (auto& hit : hits) {
+            hit.ordinal = labels_[hit.ordinal];
+        }
+    }
+}
+
+const float* FlatEngine::GetVector(uint32_t ordinal) const {
+    if (ordinal >= rows_.size() || rows_[ordinal] == UINT32_MAX ||
+        deleted_[rows_[ordinal]].load(std::memory_order_relaxed) != 0) {
+        return nullptr;
+    }
+    return matrix_.data() + static_cast<size_t>(rows_[ordinal]) * dim_;
+}
+
+void FlatEngine::MarkDeleted(uint32_t ordinal) {
+    if (ordinal < rows_.size() && rows_[ordinal] != UINT32_MAX) {
+        deleted_[rows_[ordinal]].store(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace ns_index
@@ -0,0 +1,146 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "lemfileutil.hpp"
+
+// 列式正排存储
+// 每个文本字段单独成列：该字段所有文档的内容按文档序号拼接在一个字节数组（arena）中，
+// offsets[ordinal] .. offsets[ordinal + 1] 为第 ordinal 个文档的区间。
+// 整个正排索引只有 2 * FIELD_COUNT 块连续内存，没有逐文档的小块分配；
+// 读取返回指向 arena 的 std::string_view，快照加载时 arena 直接映射文件，不做拷贝。
+
+namespace ns_index {
+
+enum DocField {
+    FIELD_TITLE = 0,     // 词条标题（lemma）
+    FIELD_LANGUAGE = 1,  // 词条语言
+    FIELD_FORMS = 2,     // 词形变化（空格分隔）
+    FIELD_SENSES = 3,    // 释义（分号分隔）
+    FIELD_URL = 4,       // 词条 URL
+    FIELD_COUNT = 5,
+};
+
+// 构建期的词条记录：解析 JSON 后暂存，分配文档序号时写入列式正排存储并释放
+struct DocInfo {
+    std::string title;       // 词条标题（使用 lemma 字段）
+    std::string language;    // 词条语言
+    std::string forms;       // 词形变化（多个形式以空格分隔）
+    std::string senses;      // 释义（多个释义以分号分隔）
+    std::string url;         // 词条对应的 URL
+    uint64_t doc_id;         // 文档ID（可从 lexeme id 提取），索引内部一律使用文档序号
+    uint64_t seq = 0;        // 在输入中的顺序号，同一 doc_id 出现多次时保留 seq 最大的一个，与解析线程数无关
+};
+
+// 正排索引中一个文档的只读视图，所有字段都指向列存储内部，视图的有效期与索引相同
+struct DocView {
+    uint64_t doc_id = 0;
+    std::string_view title;
+    std::string_view language;
+    std::string_view forms;
+    std::string_view senses;
+    std::string_view url;
+};
+
+// 一列变长字符串
+class StringColumn {
+public:
+    std::string_view Get(size_t ordinal) const {
+        return std::string_view(bytes.data() + offsets[ordinal], offsets[ordinal + 1] - offsets[ordinal]);
+    }
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    // 校验 offsets 单调且不越界，加载快照时使用
+    bool Validate(size_t count) const {
+        if (offsets.size() != count + 1 || offsets[0] != 0) {
+            return false;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            if (offsets[i] > offsets[i + 1]) {
+                return false;
+            }
+        }
+        return offsets[count] == bytes.size();
+    }
+
+    void Clear() {
+        bytes.Clear();
+        offsets.Clear();
+    }
+
+    ns_util::MappedArray<char> bytes;
+    ns_util::MappedArray<uint64_t> offsets;
+};
+
+// 按文档序号顺序追加字符串，Finish 后交给 StringColumn
+class StringColumnBuilder {
+public:
+    StringColumnBuilder() { offsets_.push_back(0); }
+
+    void Add(std::string_view value) {
+        bytes_.insert(bytes_.end(), value.begin(), value.end());
+        offsets_.push_back(bytes_.size());
+    }
+
+    void Finish(StringColumn* column) {
+        bytes_.shrink_to_fit();
+        column->bytes.Assign(std::move(bytes_));
+        column->offsets.Assign(std::move(offsets_));
+        bytes_ = std::vector<char>();
+        offsets_.assign(1, 0);
+    }
+
+private:
+    std::vector<char> bytes_;
+    std::vector<uint64_t> offsets_;
+};
+
+class ForwardStore {
+public:
+    size_t size() const { return columns[FIELD_TITLE].size(); }
+
+    std::string_view Field(uint32_t ordinal, DocField field) const {
+        return columns[field].Get(ordinal);
+    }
+
+    // doc_id 由调用方从文档序号表中取出后填入
+    void Get(uint32_t ordinal, uint64_t doc_id, DocView* doc) const {
+        doc->doc_id = doc_id;
+        doc->title = columns[FIELD_TITLE].Get(ordinal);
+        doc->language = columns[FIELD_LANGUAGE].Get(ordinal);
+        doc->forms = columns[FIELD_FORMS].Get(ordinal);
+        doc->senses = columns[FIELD_SENSES].Get(ordinal);
+        doc->url = columns[FIELD_URL].Get(ordinal);
+    }
+
+    bool Validate(size_t count) const {
+        for (const auto& column : columns) {
+            if (!column.Validate(count)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // 文本数据占用的字节数
+    size_t bytes() const {
+        size_t total = 0;
+        for (const auto& column : columns) {
+            total += column.bytes.size() + column.offsets.size() * sizeof(uint64_t);
+        }
+        return total;
+    }
+
+    void Clear() {
+        for (auto& column : columns) {
+            column.Clear();
+        }
+    }
+
+    StringColumn columns[FIELD_COUNT];
+};
+
+} // namespace ns_index
@@ -0,0 +1,194 @@
+#pragma once
+#include <cstdint>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "lempostings.hpp"
+
+// 模糊查词：在有序词典上找出与查询词编辑距离不超过 1~2 的词，用于挽救拼写错误（如 recieve -> receive）。
+// 距离为 OSA（限制的 Damerau-Levenshtein）：插入、删除、替换和相邻两个字符交换各算一次编辑。
+// 距离和长度都按 UTF-8 解码后的字符计算：一个汉字占 3 个字节，按字节算时两个字的词长度为 6、换一个字要 2~3 次编辑，
+// 会把不认识的中文词扩展成毫不相干的词。
+// 词典按字典序排列，相邻的词共享前缀，逐个词计算动态规划时公共前缀对应的行直接复用；
+// 某一行的最小值已经超过最大距离时，以这一行对应前缀开头的所有词都不可能匹配，跳过整段，
+// 相当于在隐式的前缀树上做 Levenshtein 自动机的剪枝遍历，不需要额外的删除邻域索引，词典本身（含快照 mmap 的词典）即可直接使用。
+
+namespace ns_index {
+
+// 从 *pos 开始解码一个 UTF-8 字符并前进到下一个字符。非法或截断的字节按单个字符计，
+// 解码为 0x110000 + 字节值，不会与任何合法字符相同
+inline uint32_t NextFuzzyChar(std::string_view s, size_t* pos) {
+    unsigned char lead = static_cast<unsigned char>(s[*pos]);
+    size_t length = lead < 0x80 ? 1 : (lead >> 5) == 0x06 ? 2 : (lead >> 4) == 0x0e ? 3 : (lead >> 3) == 0x1e ? 4 : 0;
+    if (length == 0 || *pos + length > s.size()) {
+        ++*pos;
+        return lead < 0x80 ? lead : 0x110000 + lead;
+    }
+    uint32_t value = length == 1 ? lead : lead & (0x7f >> length);
+    for (size_t k = 1; k < length; ++k) {
+        unsigned char next = static_cast<unsigned char>(s[*pos + k]);
+        if ((next & 0xc0) != 0x80) {
+            ++*pos;
+            return 0x110000 + lead;
+        }
+        value = (value << 6) | (next & 0x3f);
+    }
+    *pos += length;
+    return value;
+}
+
+inline void DecodeFuzzyChars(std::string_view s, std::vector<uint32_t>* chars) {
+    chars->clear();
+    for (size_t pos = 0; pos < s.size();) {
+        chars->push_back(NextFuzzyChar(s, &pos));
+    }
+}
+
+// 查询词允许的最大编辑距离，length 为字符数：太短的词几乎与任何短词都相近，不做模糊匹配
+// （两三个字的中文词因此不扩展，四字词允许换一个字）
+inline uint32_t FuzzyMaxDistance(size_t length) {
+    if (length < 4) {
+        return 0;
+    }
+    return length < 6 ? 1 : 2;
+}
+
+inline uint32_t FuzzyMaxDistance(std::string_view word) {
+    size_t length = 0;
+    for (size_t pos = 0; pos < word.size(); ++length) {
+        NextFuzzyChar(word, &pos);
+    }
+    return FuzzyMaxDistance(length);
+}
+
+// 由上一行 prev（词典词前 d 个字符）和再上一行 prev2（前 d - 1 个字符，d 为 0 时不用）算出加上字符 c 后的一行，返回该行最小值。
+// c_prev 为词典词的第 d 个字符（用于判断相邻交换），各行长度为 word.size() + 1
+inline uint32_t FuzzyRow(const uint32_t* prev2, const uint32_t* prev, uint32_t* row, const std::vector<uint32_t>& word,
+                         uint32_t c, uint32_t c_prev, bool has_prev) {
+    row[0] = prev[0] + 1;
+    uint32_t row_min = row[0];
+    for (size_t j = 1; j <= word.size(); ++j) {
+        uint32_t value = std::min(prev[j] + 1, row[j - 1] + 1);
+        value = std::min(value, prev[j - 1] + (word[j - 1] == c ? 0 : 1));
+        if (has_prev && j >= 2 && word[j - 2] == c && word[j - 1] == c_prev) {
+            value = std::min(value, prev2[j - 2] + 1);
+        }
+        row[j] = value;
+        row_min = std::min(row_min, value);
+    }
+    return row_min;
+}
+
+// 两个字符序列的 OSA 距离，超过 max_distance 时返回 max_distance + 1（提前结束）
+inline uint32_t BoundedEditDistance(const std::vector<uint32_t>& term, const std::vector<uint32_t>& word, uint32_t max_distance) {
+    size_t diff = term.size() > word.size() ? term.size() - word.size() : word.size() - term.size();
+    if (diff > max_distance) {
+        return max_distance + 1;
+    }
+    size_t width = word.size() + 1;
+    std::vector<uint32_t> rows((term.size() + 1) * width);
+    for (size_t j = 0; j < width; ++j) {
+        rows[j] = static_cast<uint32_t>(j);
+    }
+    for (size_t d = 0; d < term.size(); ++d) {
+        const uint32_t* prev2 = d > 0 ? rows.data() + (d - 1) * width : nullptr;
+        uint32_t row_min = FuzzyRow(prev2, rows.data() + d * width, rows.data() + (d + 1) * width, word, term[d],
+                                    d > 0 ? term[d - 1] : 0, d > 0);
+        if (row_min > max_distance) {
+            return max_distance + 1;
+        }
+    }
+    return std::min(rows[term.size() * width + word.size()], max_distance + 1);
+}
+
+inline uint32_t BoundedEditDistance(std::string_view term, std::string_view word, uint32_t max_distance) {
+    std::vector<uint32_t> term_chars, word_chars;
+    DecodeFuzzyChars(term, &term_chars);
+    DecodeFuzzyChars(word, &word_chars);
+    return BoundedEditDistance(term_chars, word_chars, max_distance);
+}
+
+// 逐个产出词典中与 word 距离不超过 max_distance 的词 emit(term_id, distance)，term_id 升序
+template <typename Emit>
+inline void FuzzyScan(const TermDictionary& dictionary, std::string_view word, uint32_t max_distance, Emit emit) {
+    std::vector<uint32_t> chars;
+    DecodeFuzzyChars(word, &chars);
+    size_t width = chars.size() + 1;
+    std::vector<uint32_t> rows(width);  // 第 d 行为当前词前 d 个字符与 word 的距离
+    for (size_t j = 0; j < width; ++j) {
+        rows[j] = static_cast<uint32_t>(j);
+    }
+    std::vector<uint32_t> term_chars;   // 上一个词的前 valid 个字符，rows 中前 valid + 1 行有效
+    std::vector<size_t> ends(1, 0);     // ends[d] 为上一个词前 d 个字符的字节数
+    size_t valid = 0;
+    size_t count = dictionary.size();
+    size_t i = 0;
+    while (i < count) {
+        std::string_view term = dictionary.Term(i);
+        // 与上一个词相同的前几个字符（字符值和字节跨度都相同）的行直接复用
+        size_t d = 0, pos = 0;
+        while (d < valid && pos < term.size()) {
+            size_t next = pos;
+            uint32_t c = NextFuzzyChar(term, &next);
+            if (c != term_chars[d] || next != ends[d + 1]) {
+                break;
+            }
+            pos = next;
+            ++d;
+        }
+        bool pruned = false;
+        while (pos < term.size()) {
+            uint32_t c = NextFuzzyChar(term, &pos);
+            if (term_chars.size() < d + 1) {
+                term_chars.resize(d + 1);
+                ends.resize(d + 2);
+                rows.resize((d + 2) * width);
+            }
+            term_chars[d] = c;
+            ends[d + 1] = pos;
+            const uint32_t* prev2 = d > 0 ? rows.data() + (d - 1) * width : nullptr;
+            uint32_t row_min = FuzzyRow(prev2, rows.data() + d * width, rows.data() + (d + 1) * width, chars, c,
+                                        d > 0 ? term_chars[d - 1] : 0, d > 0);
+            ++d;
+            if (row_min > max_distance) {
+                pruned = true;
+                break;
+            }
+        }
+        valid = d;
+        if (!pruned) {
+            uint32_t distance = rows[d * width + chars.size()];
+            if (distance <= max_distance) {
+                emit(static_cast<uint32_t>(i), distance);
+            }
+            ++i;
+            continue;
+        }
+        // 以 term 前 d 个字符开头的词都不可能匹配，它们在词典中连续，跳到这一段之后。
+        // 这一段通常很短，先倍增步长找到越过它的位置，再在最后一步内二分。
+        // 前缀中有非法字节时，同样的字节开头的词未必解码出同样的字符，只前进一个词
+        if (std::any_of(term_chars.begin(), term_chars.begin() + d, [](uint32_t c) { return c >= 0x110000; })) {
+            ++i;
+            continue;
+        }
+        std::string_view prefix = term.substr(0, pos);
+        size_t lo = i + 1, step = 1;
+        while (lo + step <= count && dictionary.Term(lo + step - 1).compare(0, prefix.size(), prefix) <= 0) {
+            lo += step;
+            step *= 2;
+        }
+        size_t hi = std::min(count, lo + step - 1);
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            if (dictionary.Term(mid).compare(0, prefix.size(), prefix) <= 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        i = lo;
+    }
+}
+
+} // namespace ns_index
@@ -10,217 +10,689 @@
 #include <algorithm>
 #include <cctype>
 #include <cmath>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <condition_variable>
+#include <iterator>
 
 // 引入项目自定义的头文件
 #include "lemutil.hpp"
 #include "lemlog.hpp"
-
-// 引入 HNSWlib 头文件（假定路径正确）
-#include "hnswlib/hnswlib.h"
-#include "hnswlib/space_ip.h"
+#include "lemjsonstream.hpp"
+#include "lemsegment.hpp"
 
 namespace ns_index {
 
-struct DocInfo {
-    std::string title;       // 词条标题（使用 lemma 字段）
-    std::string language;    // 词条语言
-    std::string forms;       // 词形变化（多个形式以空格分隔）
-    std::string senses;      // 释义（多个释义以分号分隔）
-    std::string url;         // 词条对应的 URL
-    uint64_t doc_id;         // 文档ID（可从 lexeme id 提取）
-    std::vector<float> vec;  // 词条向量表示
-};
-
-struct InvertedElem {
-    uint64_t doc_id;  // 文档ID
-    std::string word; // 关键词
-    int weight;       // 权重：例如按关键词在标题和词形变化中的出现次数加权
+// 一次查询看到的索引：持有发布时的段集合，并记下其中每个内存段当时已发布的文档数（MemSnapshot）。
+// 视图存活期间段不会被释放，正排视图、拉链指针都保持有效；视图不持有任何锁，
+// 增量写入继续追加到内存段，本次查询看不到之后写入的词条，也不会阻塞写入
+struct IndexView {
+    std::shared_ptr<const SegmentSet> set;
+    std::vector<MemSnapshot> mem_segments;  // 与 set->mem_segments 一一对应
 };
 
-using InvertedList = std::vector<InvertedElem>;
-
+// 一份完整的索引。进程内可以同时存在多个实例：热重载时在后台构建新实例，
+// 由 Searcher 原子地替换，旧实例在正在进行的查询结束后释放
 class Index {
 public:
-    // 获取单例实例
-    static Index* GetInstance();
-
+    Index() = default;
     ~Index();
 
-    // 构建索引：先构建正排和倒排索引，再加载向量数据，并构建向量索引
-    bool BuildIndex(const std::string& simplifiedFile, const std::string& vectorFile);
+    // 构建索引：先构建正排和倒排索引，再加载向量数据，并构建向量索引，结果作为第一个索引段发布
+    bool BuildIndex(const std::string& simplifiedFile, const std::string& vectorFile,
+                    const BuildOptions& options = BuildOptions());
+
+    // 获取当前所有段的只读视图，查询全程持有它
+    IndexView Acquire() const;
+
+    // 未删除的文档总数
+    size_t DocCount() const;
+
+    // ---- 增量更新 ----
+    // 已发布的段是不可变的，增量更新不改动它们：
+    //   新增或更新的词条写入当前的内存段（容量为 mem_segment_docs），写满后冻结并另开一个；
+    //   被更新或删除的旧版本只打上删除标记（tombstone），向量索引中同时删除。
+    // 后台合并线程把冻结的内存段封存为不可变段，并按大小分层合并：同一层的段达到 merge_fanout 个时合并为一个，
+    // 删除过半的段单独重写以回收空间。合并在旧段上进行，完成后替换段集合，查询不需要等待。
+
+    // 新增或更新一个词条，lex 的格式与 simplified_lexemes.json 中的元素相同。
+    // vec 为空时该词条只参与倒排检索
+    bool UpsertLexeme(const Json::Value& lex, const std::vector<float>& vec, std::string* err);
+
+    // 删除一个词条，词条不存在或已删除时返回 false
+    bool DeleteLexeme(uint64_t doc_id);
+
+    // 等待后台合并把所有冻结的内存段封存完毕、各层都不再需要合并
+    void WaitForMerges();
 
-    // 根据 doc_id 获取正排索引中的文档
-    DocInfo* GetForwardIndex(uint64_t doc_id);
+    // 向量维度
+    int Dim() const { return dim; }
 
-    // 根据关键词获取倒排拉链
-    InvertedList* GetInvertedList(const std::string& word);
+    // 将索引保存为快照目录：index.snap（正排、倒排、向量）+ vector.hnsw（使用 HNSW 引擎时的图）。
+    // 存在多个段或增量更新时先把它们全部合并为一个段再保存
+    bool SaveSnapshot(const std::string& snapshotDir);
 
-    // 获取向量索引指针
-    hnswlib::HierarchicalNSW<float>* GetVectorIndex();
+    // 从快照目录加载索引，成功后无需再调用 BuildIndex
+    bool LoadSnapshot(const std::string& snapshotDir);
 
 private:
-    Index() = default;
     Index(const Index&) = delete;
     Index& operator=(const Index&) = delete;
 
-    // 构建正排和倒排索引（从简化后的 JSON 文件中读取）
+    // 构建正排和倒排索引（从简化后的 JSON 文件中流式读取）
     bool BuildForwardIndex(const std::string& simplifiedFile);
 
+    // 将一个词条 JSON 对象解析为 DocInfo，id 无法解析时使用 fallback_id
+    void ParseLexeme(const Json::Value& lex, uint64_t fallback_id, DocInfo* doc);
+
+    // 多线程构建：读取线程只负责切分出每个词条的原始文本，解析和分词由工作线程完成，
+    // 每个工作线程写入自己的正排/倒排缓冲区，全部结束后再一次性合并到全局索引
+    bool BuildForwardIndexParallel(const std::string& simplifiedFile, int threads);
+
     // 针对单个文档构建倒排索引
     bool BuildInvertedIndex(const DocInfo& doc);
 
-    // 从向量数据文件加载向量，并更新正排索引中对应文档的向量字段
-    bool LoadVectors(const std::string& vectorFile);
+    // 对文档分词并把倒排拉链节点追加到 postings 中（可以是全局的构建期拉链，也可以是线程局部缓冲区）；
+    // 另按精确模式分词，把各词在 title、forms、senses 中的位置记入 positions（编号规则见 lempositions.hpp），
+    // 用于判断 +/- 条件和短语；不保留位置时段只取其中的词
+    void TokenizeDoc(const DocInfo& doc, RawPostings* postings, DocPositions* positions);
+
+    // 当前发布的段集合
+    std::shared_ptr<const SegmentSet> Current() const { return std::atomic_load(&segments); }
+
+    // 发布新的段集合，调用方需持有 write_mtx
+    void Publish(std::shared_ptr<const SegmentSet> set) { std::atomic_store(&segments, std::move(set)); }
+
+    // 在所有段中查找 doc_id 未删除的副本并打上删除标记，调用方需持有 write_mtx
+    bool MarkDeleted(const SegmentSet& set, uint64_t doc_id);
+
+    // 后台合并线程
+    void StartMerger();
+    void MergeLoop();
+
+    // 执行一步合并：封存一个冻结的内存段，或合并同一层的若干段，或重写删除过半的段。
+    // 没有需要做的事时返回 false。调用方需持有 merge_mtx
+    bool MergeStep();
+
+    // 用 merged 替换 sources 和 mem_sources，并补上合并期间新增的删除标记，调用方需持有 merge_mtx
+    void Replace(const std::vector<std::shared_ptr<Segment>>& sources,
+                 const std::vector<std::vector<uint32_t>>& included,
+                 const std::shared_ptr<MemSegment>& mem_source, const std::vector<uint32_t>& mem_included,
+                 std::shared_ptr<Segment> merged);
+
+    // 把所有段（含内存段）合并为一个，SaveSnapshot 使用
+    bool MergeAll();
+
+    // 段所在的层级：文档数每扩大 merge_fanout 倍升一层
+    size_t Tier(const Segment& segment) const;
 
-    // 构建向量索引：利用 HNSWlib 将每个文档的向量插入到索引中
-    bool BuildVectorIndex();
+    // 后台合并使用的构建参数（不输出进度）
+    BuildOptions MergeOptions() const;
 
     // 辅助：对向量归一化
     void normalizeVector(std::vector<float>& vec);
 
-    std::unordered_map<uint64_t, DocInfo> forward_index;              // 正排索引（以 doc_id 为 key）
-    std::unordered_map<std::string, InvertedList> inverted_index;       // 倒排索引（以关键词为 key）
-    hnswlib::HierarchicalNSW<float>* vector_index = nullptr;            // 向量索引
-    hnswlib::SpaceInterface<float>* space = nullptr;                    // 距离空间
+    // 释放所有索引数据，恢复到未构建状态
+    void Clear();
+
+    std::vector<DocInfo> raw_docs;                                      // 构建期词条，写入列式正排后即释放
+    RawPostings raw_postings;                                           // 构建期倒排拉链，压实后即释放
+    RawPositions raw_positions;                                         // 构建期位置倒排，压实后即释放
+    std::shared_ptr<const SegmentSet> segments = std::make_shared<SegmentSet>();  // 当前发布的段集合，只通过 atomic_load/atomic_store 访问
+    std::mutex write_mtx;                                               // 串行化增量更新与段集合的发布
+    std::mutex merge_mtx;                                               // 同一时刻只有一个合并在进行
+    std::condition_variable merge_cv;                                   // 有冻结的内存段或需要退出时唤醒合并线程
+    std::condition_variable merge_done_cv;                              // 合并线程空闲时通知 WaitForMerges
+    std::mutex merge_state_mtx;                                         // 保护 merge_pending / merge_idle / merge_stop
+    bool merge_pending = false;
+    bool merge_idle = true;
+    bool merge_stop = false;
+    std::thread merger;
+    std::atomic<uint64_t> next_segment_id{0};
     int dim = 384;  // 向量维度（例如 Sentence‑BERT 为384）
-
-    static Index* instance;
-    static std::mutex mtx;
+    std::shared_ptr<const ns_quant::ScalarQuantizer> quantizer;           // 量化索引的量化参数，新的内存段沿用它
+    BuildOptions build_options;                                          // 当前构建所用的参数
 };
 
-// 单例成员初始化
-Index* Index::instance = nullptr;
-std::mutex Index::mtx;
-
-Index* Index::GetInstance() {
-    if (!instance) {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (!instance) {
-            instance = new Index();
-        }
-    }
-    return instance;
-}
-
 Index::~Index() {
-    if (vector_index) {
-        delete vector_index;
-        vector_index = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(merge_state_mtx);
+        merge_stop = true;
     }
-    if (space) {
-        delete space;
-        space = nullptr;
+    merge_cv.notify_all();
+    if (merger.joinable()) {
+        merger.join();
     }
+    Clear();
 }
 
-bool Index::BuildIndex(const std::string& simplifiedFile, const std::string& vectorFile) {
-    if (!BuildForwardIndex(simplifiedFile)) {
+void Index::Clear() {
+    raw_docs = std::vector<DocInfo>();
+    raw_postings.clear();
+    raw_positions.Clear();
+    std::lock_guard<std::mutex> lock(write_mtx);
+    Publish(std::make_shared<SegmentSet>());
+}
+
+bool Index::BuildIndex(const std::string& simplifiedFile, const std::string& vectorFile,
+                       const BuildOptions& options) {
+    std::lock_guard<std::mutex> merge_lock(merge_mtx);
+    Clear();
+    build_options = options;
+    int threads = build_options.threads > 0 ? build_options.threads
+                                            : static_cast<int>(std::thread::hardware_concurrency());
+    bool ok = threads > 1 ? BuildForwardIndexParallel(simplifiedFile, threads)
+                          : BuildForwardIndex(simplifiedFile);
+    if (!ok) {
         std::cerr << "构建正排索引失败" << std::endl;
         return false;
     }
-    if (!LoadVectors(vectorFile)) {
+    auto segment = std::make_shared<Segment>(next_segment_id++, dim);
+    segment->Finalize(&raw_docs, &raw_postings, &raw_positions, build_options.positions, build_options.bm25);
+    std::cout << "正排索引共 " << segment->Forward().size() << " 个词条，文本占 "
+              << segment->Forward().bytes() / 1024 << " KB。" << std::endl;
+    std::cout << "倒排索引压实完毕，共 " << segment->Dictionary().size() << " 个关键词，"
+              << segment->Postings().posting_count() << " 个倒排节点，文档序号压缩后占 "
+              << segment->Postings().doc_bytes() / 1024 << " KB。" << std::endl;
+    std::cout << "位置倒排共 " << segment->Positions().dictionary.size() << " 个关键词，占 "
+              << segment->Positions().bytes() / 1024 << " KB" << (segment->HasPositions() ? "" : "（未保留位置）") << "。"
+              << std::endl;
+    if (segment->DocCount() == 0) {
+        std::cerr << "正排索引为空，无法构建向量索引。" << std::endl;
+        return false;
+    }
+    if (!segment->LoadVectors(vectorFile)) {
         std::cerr << "加载向量数据失败" << std::endl;
         return false;
     }
-    if (!BuildVectorIndex()) {
+    dim = segment->dim();
+    if (!segment->BuildVectorIndex(build_options)) {
         std::cerr << "构建向量索引失败" << std::endl;
         return false;
     }
+    quantizer = segment->Quantizer();
+    auto set = std::make_shared<SegmentSet>();
+    set->segments.push_back(std::move(segment));
+    {
+        std::lock_guard<std::mutex> lock(write_mtx);
+        Publish(std::move(set));
+    }
     std::cout << "索引构建完成！" << std::endl;
     return true;
 }
 
-DocInfo* Index::GetForwardIndex(uint64_t doc_id) {
-    auto it = forward_index.find(doc_id);
-    if (it == forward_index.end()) {
-        std::cerr << "doc_id " << doc_id << " 不存在于正排索引中！" << std::endl;
-        return nullptr;
+IndexView Index::Acquire() const {
+    IndexView view;
+    view.set = Current();
+    view.mem_segments.reserve(view.set->mem_segments.size());
+    for (const auto& mem : view.set->mem_segments) {
+        view.mem_segments.emplace_back(mem.get(), mem->DocCount());
     }
-    return &it->second;
+    return view;
 }
 
-InvertedList* Index::GetInvertedList(const std::string& word) {
-    auto it = inverted_index.find(word);
-    if (it == inverted_index.end())
-        return nullptr;
-    return &it->second;
+size_t Index::DocCount() const {
+    IndexView view = Acquire();
+    size_t count = 0;
+    for (const auto& segment : view.set->segments) {
+        count += segment->LiveCount();
+    }
+    for (const auto& mem : view.mem_segments) {
+        for (uint32_t ordinal = 0; ordinal < mem.DocCount(); ++ordinal) {
+            count += mem.IsDeleted(ordinal) ? 0 : 1;
+        }
+    }
+    return count;
 }
 
-hnswlib::HierarchicalNSW<float>* Index::GetVectorIndex() {
-    return vector_index;
+bool Index::MarkDeleted(const SegmentSet& set, uint64_t doc_id) {
+    // 同一个词条至多有一份未删除的副本，新写入的段更可能持有它，从后往前找
+    for (auto it = set.mem_segments.rbegin(); it != set.mem_segments.rend(); ++it) {
+        uint32_t ordinal = 0;
+        if ((*it)->FindOrdinal(doc_id, &ordinal) && (*it)->MarkDeleted(ordinal)) {
+            return true;
+        }
+    }
+    for (auto it = set.segments.rbegin(); it != set.segments.rend(); ++it) {
+        uint32_t ordinal = 0;
+        if ((*it)->FindOrdinal(doc_id, &ordinal) && (*it)->MarkDeleted(ordinal)) {
+            return true;
+        }
+    }
+    return false;
 }
 
-bool Index::BuildForwardIndex(const std::string& simplifiedFile) {
-    std::ifstream in(simplifiedFile);
-    if (!in.is_open()) {
-        std::cerr << "无法打开简化文件: " << simplifiedFile << std::endl;
+bool Index::UpsertLexeme(const Json::Value& lex, const std::vector<float>& vec, std::string* err) {
+    DocInfo doc;
+    if (!ns_util::ParseLexemeId(lex.get("id", "").asString(), &doc.doc_id)) {
+        *err = "缺少有效的词条 id";
+        return false;
+    }
+    ParseLexeme(lex, doc.doc_id, &doc);
+    if (!vec.empty() && vec.size() != static_cast<size_t>(dim)) {
+        *err = "向量维度不匹配，索引维度为 " + std::to_string(dim);
+        return false;
+    }
+    // 分词不涉及索引状态，放在写锁之外完成
+    RawPostings tokens;
+    DocPositions positions;
+    TokenizeDoc(doc, &tokens, &positions);
+
+    std::lock_guard<std::mutex> lock(write_mtx);
+    std::shared_ptr<const SegmentSet> set = Current();
+    if (set->segments.empty() && set->mem_segments.empty()) {
+        *err = "索引尚未构建";
+        return false;
+    }
+    // 当前内存段写满后冻结，交给后台线程封存，新词条写入新开的内存段
+    if (set->mem_segments.empty() || set->mem_segments.back()->full()) {
+        bool freeze = !set->mem_segments.empty();
+        auto next = std::make_shared<SegmentSet>(*set);
+        next->mem_segments.push_back(std::make_shared<MemSegment>(
+            next_segment_id++, dim, std::max<size_t>(build_options.mem_segment_docs, 1), build_options.bm25,
+            build_options.positions, quantizer));
+        set = next;
+        Publish(std::move(next));
+        if (freeze) {
+            StartMerger();
+        }
+    }
+    MemSegment& active = *set->mem_segments.back();
+    uint64_t doc_id = doc.doc_id;
+    uint32_t old_ordinal = 0;
+    bool replaced = active.FindOrdinal(doc_id, &old_ordinal);
+    // 先写入新版本，失败时旧版本保持可见
+    if (!active.Add(std::move(doc), tokens, positions, vec, err)) {
+        return false;
+    }
+    // 再删除旧版本：它可能在本内存段（以新的序号取代后需要直接按旧序号删除），也可能在更早的段中
+    if (replaced) {
+        active.MarkDeleted(old_ordinal);
+    } else {
+        SegmentSet older = *set;
+        older.mem_segments.pop_back();
+        MarkDeleted(older, doc_id);
+    }
+    return true;
+}
+
+bool Index::DeleteLexeme(uint64_t doc_id) {
+    std::lock_guard<std::mutex> lock(write_mtx);
+    return MarkDeleted(*Current(), doc_id);
+}
+
+void Index::StartMerger() {
+    {
+        std::lock_guard<std::mutex> lock(merge_state_mtx);
+        merge_pending = true;
+        merge_idle = false;
+    }
+    if (!merger.joinable()) {
+        merger = std::thread([this]() { MergeLoop(); });
+    }
+    merge_cv.notify_one();
+}
+
+void Index::MergeLoop() {
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(merge_state_mtx);
+            merge_cv.wait(lock, [this]() { return merge_pending || merge_stop; });
+            if (merge_stop) {
+                return;
+            }
+            merge_pending = false;
+        }
+        while (true) {
+            std::lock_guard<std::mutex> lock(merge_mtx);
+            if (!MergeStep()) {
+                break;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(merge_state_mtx);
+            if (!merge_pending) {
+                merge_idle = true;
+                merge_done_cv.notify_all();
+            }
+        }
+    }
+}
+
+void Index::WaitForMerges() {
+    std::unique_lock<std::mutex> lock(merge_state_mtx);
+    merge_done_cv.wait(lock, [this]() { return merge_idle || merge_stop; });
+}
+
+size_t Index::Tier(const Segment& segment) const {
+    size_t fanout = std::max<size_t>(build_options.merge_fanout, 2);
+    size_t tier = 0;
+    size_t bound = std::max<size_t>(build_options.mem_segment_docs, 1) * fanout;
+    while (segment.LiveCount() >= bound) {
+        ++tier;
+        bound *= fanout;
+    }
+    return tier;
+}
+
+BuildOptions Index::MergeOptions() const {
+    BuildOptions options = build_options;
+    options.progress_interval = 0;
+    return options;
+}
+
+bool Index::MergeStep() {
+    std::shared_ptr<const SegmentSet> set = Current();
+    BuildOptions options = MergeOptions();
+
+    // 1. 封存最早冻结的内存段（最后一个是正在写入的，不动它）
+    if (set->mem_segments.size() > 1) {
+        std::shared_ptr<MemSegment> mem = set->mem_segments.front();
+        std::vector<uint32_t> included;
+        std::shared_ptr<Segment> sealed = mem->Seal(next_segment_id++, options, &included);
+        if (sealed == nullptr) {
+            std::cerr << "封存内存段 #" << mem->id() << " 失败" << std::endl;
+            return false;
+        }
+        Replace({}, {}, mem, included, std::move(sealed));
+        return true;
+    }
+
+    // 2. 同一层的段达到 merge_fanout 个时合并其中最小的 merge_fanout 个
+    size_t fanout = std::max<size_t>(build_options.merge_fanout, 2);
+    std::unordered_map<size_t, std::vector<std::shared_ptr<Segment>>> tiers;
+    for (const auto& segment : set->segments) {
+        tiers[Tier(*segment)].push_back(segment);
+    }
+    std::vector<std::shared_ptr<Segment>> sources;
+    for (auto& pair : tiers) {
+        if (pair.second.size() >= fanout && (sources.empty() || pair.first < Tier(*sources.front()))) {
+            sources = pair.second;
+        }
+    }
+    if (!sources.empty()) {
+        std::sort(sources.begin(), sources.end(), [](const std::shared_ptr<Segment>& a, const std::shared_ptr<Segment>& b) {
+            return a->LiveCount() < b->LiveCount();
+        });
+        sources.resize(fanout);
+    } else {
+        // 3. 删除过半的段单独重写，回收正排、拉链和向量索引中的空间
+        for (const auto& segment : set->segments) {
+            if (segment->DocCount() > 0 && segment->DeletedCount() * 2 > segment->DocCount()) {
+                sources.push_back(segment);
+                break;
+            }
+        }
+    }
+    if (sources.empty()) {
+        return false;
+    }
+    std::vector<std::vector<uint32_t>> included;
+    std::shared_ptr<Segment> merged = MergeSegments(sources, next_segment_id++, dim, options, &included);
+    if (merged == nullptr) {
+        std::cerr << "合并索引段失败" << std::endl;
+        return false;
+    }
+    Replace(sources, included, nullptr, {}, std::move(merged));
+    return true;
+}
+
+void Index::Replace(const std::vector<std::shared_ptr<Segment>>& sources,
+                    const std::vector<std::vector<uint32_t>>& included,
+                    const std::shared_ptr<MemSegment>& mem_source, const std::vector<uint32_t>& mem_included,
+                    std::shared_ptr<Segment> merged) {
+    std::lock_guard<std::mutex> lock(write_mtx);
+    // 合并期间源段上新增的删除标记同步到新段：源段从此不再可见，写线程也在等待本锁
+    auto reapply = [&merged](uint64_t doc_id) {
+        uint32_t ordinal = 0;
+        if (merged->FindOrdinal(doc_id, &ordinal)) {
+            merged->MarkDeleted(ordinal);
+        }
+    };
+    for (size_t s = 0; s < sources.size(); ++s) {
+        for (uint32_t ordinal : included[s]) {
+            if (sources[s]->IsDeleted(ordinal)) {
+                reapply(sources[s]->GetDocId(ordinal));
+            }
+        }
+    }
+    if (mem_source) {
+        for (uint32_t ordinal : mem_included) {
+            if (mem_source->IsDeleted(ordinal)) {
+                reapply(mem_source->Doc(ordinal).doc_id);
+            }
+        }
+    }
+
+    std::shared_ptr<const SegmentSet> set = Current();
+    auto next = std::make_shared<SegmentSet>();
+    for (const auto& segment : set->segments) {
+        if (std::find(sources.begin(), sources.end(), segment) == sources.end()) {
+            next->segments.push_back(segment);
+        }
+    }
+    if (merged->LiveCount() > 0) {
+        next->segments.push_back(std::move(merged));
+    }
+    for (const auto& mem : set->mem_segments) {
+        if (mem != mem_source) {
+            next->mem_segments.push_back(mem);
+        }
+    }
+    Publish(std::move(next));
+}
+
+bool Index::MergeAll() {
+    std::shared_ptr<const SegmentSet> set = Current();
+    // 冻结当前的内存段，之后的写入进入新的内存段（快照不包含它们）
+    if (!set->mem_segments.empty() && set->mem_segments.back()->DocCount() > 0) {
+        std::lock_guard<std::mutex> lock(write_mtx);
+        auto next = std::make_shared<SegmentSet>(*Current());
+        next->mem_segments.push_back(std::make_shared<MemSegment>(
+            next_segment_id++, dim, std::max<size_t>(build_options.mem_segment_docs, 1), build_options.bm25,
+            build_options.positions, quantizer));
+        Publish(std::move(next));
+    }
+    BuildOptions options = MergeOptions();
+    options.progress_interval = build_options.progress_interval;
+    while (Current()->mem_segments.size() > 1) {
+        std::shared_ptr<MemSegment> mem = Current()->mem_segments.front();
+        std::vector<uint32_t> included;
+        std::shared_ptr<Segment> sealed = mem->Seal(next_segment_id++, options, &included);
+        if (sealed == nullptr) {
+            return false;
+        }
+        Replace({}, {}, mem, included, std::move(sealed));
+    }
+    set = Current();
+    if (set->segments.size() == 1 && set->segments[0]->DeletedCount() == 0) {
+        return true;
+    }
+    if (set->segments.empty()) {
         return false;
     }
-    std::stringstream buffer;
-    buffer << in.rdbuf();
-    std::string fileContent = buffer.str();
-    in.close();
-
-    Json::Value root;
-    Json::CharReaderBuilder builder;
-    std::string errs;
-    std::istringstream iss(fileContent);
-    if (!Json::parseFromStream(builder, iss, &root, &errs)) {
-        std::cerr << "JSON解析错误: " << errs << std::endl;
+    std::vector<std::vector<uint32_t>> included;
+    std::shared_ptr<Segment> merged = MergeSegments(set->segments, next_segment_id++, dim, options, &included);
+    if (merged == nullptr) {
         return false;
     }
-    if (!root.isArray()) {
-        std::cerr << "错误：预期 JSON 根元素为数组。" << std::endl;
+    Replace(set->segments, included, nullptr, {}, std::move(merged));
+    return true;
+}
+
+bool Index::BuildForwardIndex(const std::string& simplifiedFile) {
+    // 流式逐个读取顶层数组中的词条，读一个建一个，不再把整个文件读入内存并建立完整的 DOM
+    ns_util::JsonArrayStreamReader reader;
+    if (!reader.Open(simplifiedFile)) {
+        std::cerr << "无法打开简化文件: " << simplifiedFile << std::endl;
         return false;
     }
 
     int count = 0;
-    for (const auto& lex : root) {
+    Json::Value lex;
+    while (reader.Next(&lex)) {
         DocInfo doc;
-        doc.title = lex.get("lemma", "").asString();
-        doc.language = lex.get("language", "").asString();
-        if (lex["forms"].isArray()) {
-            for (Json::Value::ArrayIndex i = 0; i < lex["forms"].size(); ++i) {
-                if (lex["forms"][i].isString()) {
-                    if (i > 0) {
-                        doc.forms += " ";
+        ParseLexeme(lex, count, &doc);
+        doc.seq = count;
+        BuildInvertedIndex(doc);
+        raw_docs.push_back(std::move(doc));
+        count++;
+    }
+    if (!reader.error().empty()) {
+        std::cerr << "JSON解析错误: " << reader.error() << std::endl;
+        return false;
+    }
+    std::cout << "正排和倒排索引构建完毕，总共加载 " << count << " 个词条。" << std::endl;
+    return true;
+}
+
+bool Index::BuildForwardIndexParallel(const std::string& simplifiedFile, int threads) {
+    ns_util::JsonArrayStreamReader reader;
+    if (!reader.Open(simplifiedFile)) {
+        std::cerr << "无法打开简化文件: " << simplifiedFile << std::endl;
+        return false;
+    }
+
+    // 原始文本按批次分发，first 为该批第一个词条的序号（id 无法解析时用作文档ID）
+    struct Batch {
+        uint64_t first = 0;
+        std::vector<std::string> raws;
+    };
+    struct WorkerResult {
+        std::vector<DocInfo> docs;
+        RawPostings postings;
+        RawPositions positions;
+    };
+    const size_t batch_size = 1024;
+    ns_util::BoundedQueue<Batch> queue(threads * 2);  // 限制在途批次，内存占用不随文件增长
+    std::vector<WorkerResult> results(threads);
+    std::atomic<bool> parse_failed(false);
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t]() {
+            Json::CharReaderBuilder builder;
+            std::unique_ptr<Json::CharReader> json_reader(builder.newCharReader());
+            WorkerResult& result = results[t];
+            DocPositions positions;
+            Batch batch;
+            while (queue.Pop(&batch)) {
+                for (size_t i = 0; i < batch.raws.size(); ++i) {
+                    const std::string& raw = batch.raws[i];
+                    Json::Value lex;
+                    std::string errs;
+                    if (!json_reader->parse(raw.data(), raw.data() + raw.size(), &lex, &errs)) {
+                        std::cerr << "JSON解析错误: " << errs << std::endl;
+                        parse_failed = true;
+                        continue;
                     }
-                    doc.forms += lex["forms"][i].asString();
+                    DocInfo doc;
+                    ParseLexeme(lex, batch.first + i, &doc);
+                    doc.seq = batch.first + i;
+                    positions.clear();
+                    TokenizeDoc(doc, &result.postings, &positions);
+                    result.positions.AddDoc(doc.doc_id, doc.seq, positions);
+                    result.docs.push_back(std::move(doc));
                 }
             }
+        });
+    }
+
+    uint64_t count = 0;
+    Batch batch;
+    batch.first = count;
+    std::string raw;
+    while (reader.NextRaw(&raw)) {
+        batch.raws.push_back(std::move(raw));
+        if (++count % batch_size == 0) {
+            queue.Push(std::move(batch));
+            batch = Batch();
+            batch.first = count;
         }
-        if (lex["senses"].isArray()) {
-            for (Json::Value::ArrayIndex i = 0; i < lex["senses"].size(); ++i) {
-                if (lex["senses"][i].isString()) {
-                    if (i > 0) {
-                        doc.senses += ";";
-                    }
-                    doc.senses += lex["senses"][i].asString();
+    }
+    if (!batch.raws.empty()) {
+        queue.Push(std::move(batch));
+    }
+    queue.Close();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    if (!reader.error().empty() || parse_failed) {
+        if (!reader.error().empty()) {
+            std::cerr << "JSON解析错误: " << reader.error() << std::endl;
+        }
+        return false;
+    }
+
+    // 合并：正排直接移动，倒排拉链按线程顺序一次拼接
+    raw_docs.reserve(count);
+    for (auto& result : results) {
+        std::move(result.docs.begin(), result.docs.end(), std::back_inserter(raw_docs));
+        result.docs = std::vector<DocInfo>();
+    }
+    for (auto& result : results) {
+        for (auto& pair : result.postings) {
+            std::vector<RawPosting>& dst = raw_postings[pair.first];
+            if (dst.empty()) {
+                dst = std::move(pair.second);
+            } else {
+                dst.insert(dst.end(), std::make_move_iterator(pair.second.begin()),
+                           std::make_move_iterator(pair.second.end()));
+            }
+        }
+        result.postings.clear();
+        raw_positions.Append(std::move(result.positions));
+    }
+    std::cout << "正排和倒排索引构建完毕（" << threads << " 个线程），总共加载 " << count << " 个词条。" << std::endl;
+    return true;
+}
+
+void Index::ParseLexeme(const Json::Value& lex, uint64_t fallback_id, DocInfo* doc) {
+    doc->title = lex.get("lemma", "").asString();
+    doc->language = lex.get("language", "").asString();
+    const Json::Value& forms = lex["forms"];
+    if (forms.isArray()) {
+        for (Json::Value::ArrayIndex i = 0; i < forms.size(); ++i) {
+            if (forms[i].isString()) {
+                if (i > 0) {
+                    doc->forms += " ";
                 }
+                doc->forms += forms[i].asString();
             }
         }
-        doc.url = lex.get("url", "").asString();
-        std::string lexId = lex.get("id", "").asString();
-        try {
-            if (!lexId.empty() && lexId.front() == 'L')
-                doc.doc_id = std::stoull(lexId.substr(1));
-            else
-                doc.doc_id = std::stoull(lexId);
-        } catch (...) {
-            doc.doc_id = count;
+    }
+    const Json::Value& senses = lex["senses"];
+    if (senses.isArray()) {
+        for (Json::Value::ArrayIndex i = 0; i < senses.size(); ++i) {
+            if (senses[i].isString()) {
+                if (i > 0) {
+                    doc->senses += ";";
+                }
+                doc->senses += senses[i].asString();
+            }
         }
-        forward_index[doc.doc_id] = std::move(doc);
-        BuildInvertedIndex(forward_index[doc.doc_id]);
-        count++;
     }
-    std::cout << "正排和倒排索引构建完毕，总共加载 " << count << " 个词条。" << std::endl;
-    return true;
+    doc->url = lex.get("url", "").asString();
+    if (!ns_util::ParseLexemeId(lex.get("id", "").asString(), &doc->doc_id)) {
+        doc->doc_id = fallback_id;
+    }
 }
 
 bool Index::BuildInvertedIndex(const DocInfo& doc) {
+    DocPositions positions;
+    TokenizeDoc(doc, &raw_postings, &positions);
+    raw_positions.AddDoc(doc.doc_id, doc.seq, positions);
+    return true;
+}
+
+void Index::TokenizeDoc(const DocInfo& doc, RawPostings* postings, DocPositions* positions) {
+    // 只记录各字段的词频，得分在段构建完成、拿到文档频率和平均字段长度之后统一计算（BM25F，见 lemscoring.hpp）
     struct word_cnt {
-        int title_cnt = 0;
-        int content_cnt = 0;
+        uint16_t title_cnt = 0;
+        uint16_t content_cnt = 0;
     };
     std::unordered_map<std::string, word_cnt> word_map;
     std::vector<std::string> title_words;
@@ -239,87 +711,83 @@ bool Index::BuildInvertedIndex(const DocInfo& doc) {
         std::transform(s.begin(), s.end(), s.begin(), [](unsigned char c) { return std::tolower(c); });
         word_map[s].content_cnt++;
     }
-    const int X = 10;
-    const int Y = 1;
     for (auto& pair : word_map) {
-        InvertedElem item;
+        RawPosting item;
         item.doc_id = doc.doc_id;
-        item.word = pair.first;
-        item.weight = X * pair.second.title_cnt + Y * pair.second.content_cnt;
-        inverted_index[pair.first].push_back(std::move(item));
+        item.tf[SCORED_TITLE] = pair.second.title_cnt;
+        item.tf[SCORED_FORMS] = pair.second.content_cnt;
+        (*postings)[pair.first].push_back(item);
+    }
+    // 位置：title 从 0 开始连续编号，forms 接着 title 的词数再隔开 POSITION_GAP，senses 接着 forms 再隔开 POSITION_GAP，
+    // 每条释义之间也隔开 POSITION_GAP（ParseLexeme 用分号拼接释义）
+    uint32_t position = 0;
+    std::vector<std::string> words;
+    for (const std::string* field : {&doc.title, &doc.forms}) {
+        words.clear();
+        ns_util::JiebaUtil::CutPrecise(*field, &words);
+        for (auto& word : words) {
+            ns_util::removeSpacesAndPunctuation(word);
+            if (word.empty()) continue;
+            std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::tolower(c); });
+            (*positions)[word].push_back(position++);
+        }
+        position += POSITION_GAP;
+    }
+    words.clear();
+    ns_util::JiebaUtil::CutPrecise(doc.senses, &words);
+    for (auto& word : words) {
+        if (word == ";") {
+            position += POSITION_GAP;
+            continue;
+        }
+        ns_util::removeSpacesAndPunctuation(word);
+        if (word.empty()) continue;
+        std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::tolower(c); });
+        (*positions)[word].push_back(position++);
     }
-    return true;
 }
 
-bool Index::LoadVectors(const std::string& vectorFile) {
-    std::ifstream in(vectorFile);
-    if (!in.is_open()) {
-        std::cerr << "无法打开向量文件: " << vectorFile << std::endl;
+
+bool Index::SaveSnapshot(const std::string& snapshotDir) {
+    std::lock_guard<std::mutex> merge_lock(merge_mtx);
+    if (!MergeAll()) {
+        std::cerr << "索引尚未构建，无法保存快照。" << std::endl;
         return false;
     }
-    std::string line;
-    while (std::getline(in, line)) {
-        if (line.empty())
-            continue;
-        std::istringstream iss(line);
-        std::string idStr, lemma, vecStr;
-        if (!std::getline(iss, idStr, '\t'))
-            continue;
-        if (!std::getline(iss, lemma, '\t'))
-            continue;
-        if (!std::getline(iss, vecStr))
-            continue;
-        uint64_t id = 0;
-        try {
-            if (!idStr.empty() && idStr.front() == 'L')
-                id = std::stoull(idStr.substr(1));
-            else
-                id = std::stoull(idStr);
-        } catch (const std::exception& e) {
-            std::cerr << "转换 docID 失败: " << idStr << ", 错误: " << e.what() << std::endl;
-            continue;
-        }
-        std::istringstream vecStream(vecStr);
-        std::vector<float> vec;
-        float val;
-        while (vecStream >> val) {
-            vec.push_back(val);
-        }
-        auto it = forward_index.find(id);
-        if (it == forward_index.end()) {
-            std::cerr << "正排索引中未找到 docID: " << id << std::endl;
-            continue;
-        }
-        it->second.vec = std::move(vec);
+    std::shared_ptr<const SegmentSet> set = Current();
+    if (set->segments.size() != 1 || !set->segments[0]->Save(snapshotDir)) {
+        return false;
     }
-    in.close();
-    std::cout << "加载向量文件成功: " << vectorFile << std::endl;
+    std::cout << "索引快照已保存到: " << snapshotDir << std::endl;
     return true;
 }
 
-bool Index::BuildVectorIndex() {
-    if (forward_index.empty()) {
-        std::cerr << "正排索引为空，无法构建向量索引。" << std::endl;
+bool Index::LoadSnapshot(const std::string& snapshotDir) {
+    std::lock_guard<std::mutex> merge_lock(merge_mtx);
+    auto segment = std::make_shared<Segment>(next_segment_id++, dim);
+    if (!segment->Load(snapshotDir)) {
         return false;
     }
-    int count = 0;
-    // 使用 InnerProductSpace，假设向量已归一化，则内积即为余弦相似度
-    space = new hnswlib::InnerProductSpace(dim);
-    size_t max_elements = forward_index.size();
-    vector_index = new hnswlib::HierarchicalNSW<float>(space, max_elements, 16, 200);
-    for (auto& pair : forward_index) {
-        DocInfo& doc = pair.second;
-        if (doc.vec.size() != static_cast<size_t>(dim)) {
-            std::cerr << "文档 " << doc.doc_id << " 向量维度不匹配。" << std::endl;
-            continue;
-        }
-        // 若需要归一化，请取消下行注释
-        // normalizeVector(doc.vec);
-        vector_index->addPoint(doc.vec.data(), doc.doc_id);
-        if ((++count) % 5000 == 0) {
-            std::cout << "向量索引构建中：第 " << count << " 个向量构建完成。" << std::endl;
-        }
+    Clear();
+    dim = segment->dim();
+    quantizer = segment->Quantizer();
+    // 之后合并出的段沿用快照的向量格式和 BM25F 参数
+    build_options.bm25 = segment->Bm25();
+    build_options.positions = segment->HasPositions();
+    build_options.quantize_vectors = quantizer != nullptr;
+    build_options.vector_engine = VECTOR_ENGINE_HNSW;
+    if (segment->VectorFormat() == ns_snapshot::VECTOR_IVFPQ) {
+        build_options.vector_engine = VECTOR_ENGINE_IVFPQ;
+        build_options.ivf_rerank = segment->StoresVectors();
+    } else if (segment->VectorFormat() == ns_snapshot::VECTOR_FLAT) {
+        build_options.vector_engine = VECTOR_ENGINE_FLAT;
     }
+    std::cout << "从快照加载索引完成，共 " << segment->DocCount() << " 个词条，"
+              << segment->Dictionary().size() << " 个关键词。" << std::endl;
+    auto set = std::make_shared<SegmentSet>();
+    set->segments.push_back(std::move(segment));
+    std::lock_guard<std::mutex> lock(write_mtx);
+    Publish(std::move(set));
     return true;
 }
 
@@ -0,0 +1,545 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+#include <queue>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define LEMIVFPQ_DISPATCH 1
+#include <tmmintrin.h>
+#endif
+
+#include "lemvecengine.hpp"
+
+// IVF-PQ 向量引擎
+// 粗聚类：用 k-means 把向量分到 nlist 个倒排列表，查询时只扫描与查询最近的 nprobe 个列表。
+// 乘积量化：残差 r = x - c（c 为所属列表的聚类中心）补零到 8 的倍数维后按每 4 维切成 m 个子空间，
+// 每个子空间用 k-means 训练 16 个码字，一个向量编码为 m 个 4 位码字下标（384 维为 48 字节）。
+// 内积可以拆成 <q, x> ≈ <q, c> + Σ_j <q_j, codebook_j[code_j]>，后一项查表得到（ADC），
+// 查询表只和查询有关，所有列表共用一张。查询表量化为 uint8，16 个向量一块交错存放编码，
+// 扫描时用 SSSE3 的 pshufb 一次查 16 个向量的表并以 uint16 累加；该函数用 target 属性单独编译，
+// 运行时 CPU 支持 SSSE3 就使用，不依赖编译选项（否则退化为逐个查表）。
+// 默认直接按 4 位编码的近似内积排序，不保存原始向量，每个向量只占编码的几十字节；
+// BuildOptions::ivf_rerank 为 true 时另存有向量的文档的原始向量（每个多占 dim * 4 字节），先取更多候选再用它精排。
+// 不保存原始向量时 GetVector 返回 nullptr，合并段、精确检索改用 DecodeVector 由编码还原的近似向量。
+
+namespace ns_index {
+
+namespace ns_ivfpq {
+
+    const size_t SUB_DIM = 4;         // 每个子空间的维数
+    const size_t CODEBOOK_SIZE = 16;  // 每个子空间的码字数（4 位编码）
+    const size_t BLOCK_SIZE = 16;     // 一块交错存放的向量数，与一次 pshufb 查表的宽度一致
+    const uint32_t EMPTY_SLOT = std::numeric_limits<uint32_t>::max();  // 补齐到整块的空槽位
+    const size_t COARSE_TRAINING_PER_LIST = 64;  // 粗聚类每个列表最多使用的训练样本数
+    const size_t PQ_TRAINING_SAMPLES = 65536;    // 训练码本最多使用的残差数
+    const int KMEANS_ITERATIONS = 10;
+
+    inline float L2Sqr(const float* x, const float* y, size_t dim) {
+        float sum = 0.0f;
+        for (size_t i = 0; i < dim; ++i) {
+            float diff = x[i] - y[i];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    // 距离 x 最近（L2）的聚类中心
+    inline uint32_t Nearest(const float* x, const float* centroids, size_t k, size_t dim) {
+        uint32_t best = 0;
+        float best_dist = std::numeric_limits<float>::max();
+        for (size_t c = 0; c < k; ++c) {
+            float dist = L2Sqr(x, centroids + c * dim, dim);
+            if (dist < best_dist) {
+                best_dist = dist;
+                best = static_cast<uint32_t>(c);
+            }
+        }
+        return best;
+    }
+
+    // 按 L2 距离做 k-means，data 为 n 行 dim 列。初始中心在样本中等间隔选取，空簇用固定位置的样本重新播种，
+    // 相同输入总是得到相同的结果。k 大于 n 时部分中心重复
+    inline void KMeans(const float* data, size_t n, size_t dim, size_t k, int threads, std::vector<float>* centroids) {
+        centroids->assign(k * dim, 0.0f);
+        if (n == 0) {
+            return;
+        }
+        for (size_t c = 0; c < k; ++c) {
+            size_t i = k <= n ? c * n / k : c % n;
+            std::copy(data + i * dim, data + (i + 1) * dim, centroids->data() + c * dim);
+        }
+        std::vector<uint32_t> assign(n, 0);
+        std::vector<double> sums(k * dim);
+        std::vector<size_t> counts(k);
+        for (int iter = 0; iter < KMEANS_ITERATIONS; ++iter) {
+            ns_util::ParallelFor(0, n, threads, [&](size_t i, int) {
+                assign[i] = Nearest(data + i * dim, centroids->data(), k, dim);
+            });
+            std::fill(sums.begin(), sums.end(), 0.0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (size_t i = 0; i < n; ++i) {
+                const float* x = data + i * dim;
+                double* sum = sums.data() + assign[i] * dim;
+                for (size_t d = 0; d < dim; ++d) {
+                    sum[d] += x[d];
+                }
+                ++counts[assign[i]];
+            }
+            for (size_t c = 0; c < k; ++c) {
+                float* centroid = centroids->data() + c * dim;
+                if (counts[c] == 0) {
+                    size_t i = (c * 7919 + static_cast<size_t>(iter) * 104729) % n;
+                    std::copy(data + i * dim, data + (i + 1) * dim, centroid);
+                    continue;
+                }
+                for (size_t d = 0; d < dim; ++d) {
+                    centroid[d] = static_cast<float>(sums[c * dim + d] / counts[c]);
+                }
+            }
+        }
+    }
+
+    // 对一块 16 个向量查表累加：codes 为 m / 2 组，每组 16 字节（低 4 位是子空间 2p，高 4 位是 2p + 1），
+    // lut 为 m 张 16 项的 uint8 查询表，sums 返回 16 个向量的查表之和。逐个向量查表的实现
+    inline void ScanBlockScalar(const uint8_t* codes, const uint8_t* lut, size_t m, uint16_t* sums) {
+        std::fill(sums, sums + BLOCK_SIZE, 0);
+        for (size_t p = 0; p < m / 2; ++p) {
+            const uint8_t* group = codes + p * BLOCK_SIZE;
+            const uint8_t* lut_lo = lut + 2 * p * CODEBOOK_SIZE;
+            const uint8_t* lut_hi = lut + (2 * p + 1) * CODEBOOK_SIZE;
+            for (size_t lane = 0; lane < BLOCK_SIZE; ++lane) {
+                sums[lane] += lut_lo[group[lane] & 0x0f] + lut_hi[group[lane] >> 4];
+            }
+        }
+    }
+
+#if defined(LEMIVFPQ_DISPATCH)
+    // 同 ScanBlockScalar，用 pshufb 一次查 16 个向量
+    __attribute__((target("ssse3")))
+    inline void ScanBlockSsse3(const uint8_t* codes, const uint8_t* lut, size_t m, uint16_t* sums) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i mask = _mm_set1_epi8(0x0f);
+        __m128i acc_lo = _mm_setzero_si128(), acc_hi = _mm_setzero_si128();
+        for (size_t p = 0; p < m / 2; ++p) {
+            __m128i packed = _mm_loadu_si128(reinterpret_cast<const __m128i*>(codes + p * BLOCK_SIZE));
+            __m128i lo = _mm_and_si128(packed, mask);
+            __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), mask);
+            __m128i a = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + 2 * p * CODEBOOK_SIZE)), lo);
+            __m128i b = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(lut + (2 * p + 1) * CODEBOOK_SIZE)), hi);
+            acc_lo = _mm_add_epi16(acc_lo, _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero)));
+            acc_hi = _mm_add_epi16(acc_hi, _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero)));
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), acc_lo);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(sums + 8), acc_hi);
+    }
+#endif
+
+    typedef void (*ScanBlockFn)(const uint8_t* codes, const uint8_t* lut, size_t m, uint16_t* sums);
+
+    // 当前 CPU 上使用的查表实现，第一次调用时选定
+    inline ScanBlockFn SelectScanBlock() {
+        static const ScanBlockFn scan = [] {
+#if defined(LEMIVFPQ_DISPATCH)
+            __builtin_cpu_init();
+            if (__builtin_cpu_supports("ssse3")) {
+                return &ScanBlockSsse3;
+            }
+#endif
+            return &ScanBlockScalar;
+        }();
+        return scan;
+    }
+
+} // namespace ns_ivfpq
+
+class IvfPqEngine : public VectorEngine {
+public:
+    explicit IvfPqEngine(int dim)
+        : dim_(dim), padded_dim_((dim + 7) / 8 * 8), m_(padded_dim_ / ns_ivfpq::SUB_DIM) {}
+
+    // 训练粗聚类中心和码本，再把 sources 中的向量编码写入倒排列表，sources 中缺失的为 nullptr
+    bool Build(const std::vector<const float*>& sources, size_t doc_count, const BuildOptions& options);
+
+    // 从快照恢复，所有数组直接指向 reader 的映射内存
+    bool Load(const ns_snapshot::SnapshotReader& reader, size_t doc_count);
+
+    uint32_t Format() const override { return ns_snapshot::VECTOR_IVFPQ; }
+    void Search(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const override;
+    const float* GetVector(uint32_t ordinal) const override;
+    bool DecodeVector(uint32_t ordinal, float* out) const override;
+    bool StoresVectors() const override { return rerank_; }
+    void MarkDeleted(uint32_t ordinal) override;
+    bool Save(const std::string& dir, ns_snapshot::SnapshotWriter* writer) const override;
+
+    size_t ListCount() const { return nlist_; }
+    size_t CodeSize() const { return m_ / 2; }  // 每个向量的编码字节数
+
+private:
+    // 计算 centroid_norms_、slots_、rows_ 并清空删除标记
+    void Prepare(size_t doc_count);
+
+    int dim_;
+    size_t padded_dim_;
+    size_t m_;                                     // 子空间数
+    size_t nlist_ = 0;
+    size_t nprobe_ = 8;
+    bool rerank_ = false;                          // 保存原始向量并用它精排
+    ns_util::MappedArray<float> centroids_;        // nlist * dim
+    ns_util::MappedArray<float> codebooks_;        // m * 16 * 4
+    ns_util::MappedArray<uint32_t> list_offsets_;  // nlist + 1，以槽位计，都是 16 的倍数
+    ns_util::MappedArray<uint32_t> ids_;           // 槽位 -> 文档序号，空槽位为 EMPTY_SLOT
+    ns_util::MappedArray<uint8_t> codes_;          // 每块 m / 2 * 16 字节
+    ns_util::MappedArray<float> exact_vectors_;    // 精排用的原始向量：有向量的文档按序号顺序每行 dim 个，不精排时为空
+    std::vector<float> centroid_norms_;            // |c|^2，用于按 L2 挑选要探查的列表
+    std::vector<uint32_t> slots_;                  // 文档序号 -> 槽位，没有向量为 EMPTY_SLOT
+    std::vector<uint32_t> rows_;                   // 文档序号 -> exact_vectors_ 中的行（只在精排时使用）
+    std::unique_ptr<std::atomic<uint8_t>[]> deleted_;
+};
+
+bool IvfPqEngine::Build(const std::vector<const float*>& sources, size_t doc_count, const BuildOptions& options) {
+    using namespace ns_ivfpq;
+    auto start = std::chrono::steady_clock::now();
+    int threads = options.vector_threads > 0 ? options.vector_threads
+                                             : static_cast<int>(std::thread::hardware_concurrency());
+    std::vector<uint32_t> docs;
+    for (size_t ordinal = 0; ordinal < doc_count; ++ordinal) {
+        if (ordinal < sources.size() && sources[ordinal] != nullptr) {
+            docs.push_back(static_cast<uint32_t>(ordinal));
+        }
+    }
+    size_t n = docs.size();
+    nlist_ = options.ivf_lists > 0 ? options.ivf_lists : static_cast<size_t>(std::sqrt(static_cast<double>(n)));
+    nlist_ = std::max<size_t>(1, std::min(nlist_, n));
+    if (n == 0) {
+        nlist_ = 0;
+    }
+    nprobe_ = std::max<size_t>(1, options.ivf_nprobe);
+    rerank_ = options.ivf_rerank;
+
+    // 粗聚类：在等间隔抽取的样本上训练
+    size_t samples = std::min(n, nlist_ * COARSE_TRAINING_PER_LIST);
+    std::vector<float> training(samples * dim_);
+    for (size_t i = 0; i < samples; ++i) {
+        const float* vec = sources[docs[i * n / samples]];
+        std::copy(vec, vec + dim_, training.data() + i * dim_);
+    }
+    std::vector<float> centroids;
+    KMeans(training.data(), samples, dim_, nlist_, threads, &centroids);
+
+    std::vector<uint32_t> lists(n, 0);
+    ns_util::ParallelFor(0, n, threads, [&](size_t i, int) {
+        lists[i] = Nearest(sources[docs[i]], centroids.data(), nlist_, dim_);
+    });
+
+    // 码本：每个子空间在残差样本上单独训练 16 个码字
+    samples = std::min(n, PQ_TRAINING_SAMPLES);
+    std::vector<float> residuals(samples * padded_dim_, 0.0f);
+    for (size_t i = 0; i < samples; ++i) {
+        size_t index = i * n / samples;
+        const float* vec = sources[docs[index]];
+        const float* centroid = centroids.data() + static_cast<size_t>(lists[index]) * dim_;
+        for (int d = 0; d < dim_; ++d) {
+            residuals[i * padded_dim_ + d] = vec[d] - centroid[d];
+        }
+    }
+    std::vector<float> codebooks(m_ * CODEBOOK_SIZE * SUB_DIM, 0.0f);
+    ns_util::ParallelFor(0, m_, threads, [&](size_t j, int) {
+        std::vector<float> sub(samples * SUB_DIM);
+        for (size_t i = 0; i < samples; ++i) {
+            std::copy(residuals.data() + i * padded_dim_ + j * SUB_DIM,
+                      residuals.data() + i * padded_dim_ + (j + 1) * SUB_DIM, sub.data() + i * SUB_DIM);
+        }
+        std::vector<float> codebook;
+        KMeans(sub.data(), samples, SUB_DIM, CODEBOOK_SIZE, 1, &codebook);
+        std::copy(codebook.begin(), codebook.end(), codebooks.data() + j * CODEBOOK_SIZE * SUB_DIM);
+    });
+    residuals = std::vector<float>();
+
+    // 编码：每个子空间取最近的码字
+    std::vector<uint8_t> doc_codes(n * m_);
+    ns_util::ParallelFor(0, n, threads, [&](size_t i, int) {
+        const float* vec = sources[docs[i]];
+        const float* centroid = centroids.data() + static_cast<size_t>(lists[i]) * dim_;
+        float residual[SUB_DIM];
+        for (size_t j = 0; j < m_; ++j) {
+            for (size_t t = 0; t < SUB_DIM; ++t) {
+                size_t d = j * SUB_DIM + t;
+                residual[t] = d < static_cast<size_t>(dim_) ? vec[d] - centroid[d] : 0.0f;
+            }
+            doc_codes[i * m_ + j] = static_cast<uint8_t>(
+                Nearest(residual, codebooks.data() + j * CODEBOOK_SIZE * SUB_DIM, CODEBOOK_SIZE, SUB_DIM));
+        }
+    });
+
+    // 按列表排布槽位，每个列表补齐到整块；同一列表内按文档序号升序
+    std::vector<uint32_t> offsets(nlist_ + 1, 0);
+    for (uint32_t list : lists) {
+        ++offsets[list + 1];
+    }
+    for (size_t l = 0; l < nlist_; ++l) {
+        offsets[l + 1] = offsets[l] + static_cast<uint32_t>((offsets[l + 1] + BLOCK_SIZE - 1) / BLOCK_SIZE * BLOCK_SIZE);
+    }
+    size_t slots = offsets[nlist_];
+    std::vector<uint32_t> ids(slots, EMPTY_SLOT);
+    std::vector<uint8_t> codes(slots * m_ / 2, 0);
+    std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < n; ++i) {
+        uint32_t slot = fill[lists[i]]++;
+        ids[slot] = docs[i];
+        uint8_t* block = codes.data() + static_cast<size_t>(slot / BLOCK_SIZE) * BLOCK_SIZE * m_ / 2;
+        for (size_t p = 0; p < m_ / 2; ++p) {
+            block[p * BLOCK_SIZE + slot % BLOCK_SIZE] =
+                static_cast<uint8_t>(doc_codes[i * m_ + 2 * p] | (doc_codes[i * m_ + 2 * p + 1] << 4));
+        }
+    }
+
+    std::vector<float> exact(rerank_ ? n * dim_ : 0);
+    for (size_t i = 0; rerank_ && i < n; ++i) {
+        std::copy(sources[docs[i]], sources[docs[i]] + dim_, exact.data() + i * dim_);
+    }
+    centroids_.Assign(std::move(centroids));
+    codebooks_.Assign(std::move(codebooks));
+    list_offsets_.Assign(std::move(offsets));
+    ids_.Assign(std::move(ids));
+    codes_.Assign(std::move(codes));
+    exact_vectors_.Assign(std::move(exact));
+    Prepare(doc_count);
+    if (options.progress_interval > 0) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "IVF-PQ 向量索引构建完毕，共 " << n << " 个向量、" << nlist_ << " 个倒排列表，每个向量编码 "
+                  << CodeSize() << " 字节" << (rerank_ ? "（另存原始向量用于精排）" : "") << "，耗时 " << secs << " 秒。" << std::endl;
+    }
+    return true;
+}
+
+void IvfPqEngine::Prepare(size_t doc_count) {
+    centroid_norms_.assign(nlist_, 0.0f);
+    for (size_t l = 0; l < nlist_; ++l) {
+        const float* centroid = centroids_.data() + l * dim_;
+        centroid_norms_[l] = ns_quant::Dot(centroid, centroid, dim_);
+    }
+    slots_.assign(doc_count, ns_ivfpq::EMPTY_SLOT);
+    for (size_t slot = 0; slot < ids_.size(); ++slot) {
+        if (ids_[slot] != ns_ivfpq::EMPTY_SLOT) {
+            slots_[ids_[slot]] = static_cast<uint32_t>(slot);
+        }
+    }
+    rows_.clear();
+    if (rerank_) {
+        rows_.assign(doc_count, ns_ivfpq::EMPTY_SLOT);
+        uint32_t row = 0;
+        for (size_t ordinal = 0; ordinal < doc_count; ++ordinal) {
+            if (slots_[ordinal] != ns_ivfpq::EMPTY_SLOT) {
+                rows_[ordinal] = row++;
+            }
+        }
+    }
+    deleted_.reset(new std::atomic<uint8_t>[doc_count]);
+    for (size_t i = 0; i < doc_count; ++i) {
+        deleted_[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+bool IvfPqEngine::Load(const ns_snapshot::SnapshotReader& reader, size_t doc_count) {
+    using namespace ns_ivfpq;
+    ns_snapshot::BufferReader meta;
+    uint32_t nlist = 0, m = 0, nprobe = 0;
+    if (!reader.GetSection(ns_snapshot::SECTION_IVF_META, &meta) || !meta.Get(&nlist) || !meta.Get(&m) ||
+        !meta.Get(&nprobe) || m != m_) {
+        std::cerr << "快照 IVF-PQ 元信息损坏。" << std::endl;
+        return false;
+    }
+    nlist_ = nlist;
+    nprobe_ = std::max<uint32_t>(1, nprobe);
+    if (!reader.GetArray(ns_snapshot::SECTION_IVF_CENTROIDS, &centroids_) ||
+        !reader.GetArray(ns_snapshot::SECTION_IVF_CODEBOOKS, &codebooks_) ||
+        !reader.GetArray(ns_snapshot::SECTION_IVF_LIST_OFFSETS, &list_offsets_) ||
+        !reader.GetArray(ns_snapshot::SECTION_IVF_IDS, &ids_) ||
+        !reader.GetArray(ns_snapshot::SECTION_IVF_CODES, &codes_) ||
+        centroids_.size() != nlist_ * dim_ || codebooks_.size() != m_ * CODEBOOK_SIZE * SUB_DIM ||
+        list_offsets_.size() != nlist_ + 1 || list_offsets_[0] != 0 || list_offsets_[nlist_] != ids_.size() ||
+        ids_.size() % BLOCK_SIZE != 0 || codes_.size() != ids_.size() * m_ / 2) {
+        std::cerr << "快照 IVF-PQ 向量索引损坏。" << std::endl;
+        return false;
+    }
+    for (size_t l = 0; l < nlist_; ++l) {
+        if (list_offsets_[l] > list_offsets_[l + 1] || list_offsets_[l] % BLOCK_SIZE != 0) {
+            std::cerr << "快照 IVF-PQ 倒排列表损坏。" << std::endl;
+            return false;
+        }
+    }
+    size_t vectors = 0;
+    for (uint32_t ordinal : ids_) {
+        if (ordinal != EMPTY_SLOT && ordinal >= doc_count) {
+            std::cerr << "快照 IVF-PQ 文档序号越界。" << std::endl;
+            return false;
+        }
+        vectors += ordinal != EMPTY_SLOT ? 1 : 0;
+    }
+    // 构建时开启了精排才有原始向量
+    rerank_ = reader.HasSection(ns_snapshot::SECTION_EXACT_VECTORS);
+    if (rerank_ && (!reader.GetArray(ns_snapshot::SECTION_EXACT_VECTORS, &exact_vectors_) ||
+                    exact_vectors_.size() != vectors * dim_)) {
+        std::cerr << "快照 IVF-PQ 原始向量损坏。" << std::endl;
+        return false;
+    }
+    Prepare(doc_count);
+    return true;
+}
+
+bool IvfPqEngine::Save(const std::string&, ns_snapshot::SnapshotWriter* writer) const {
+    writer->BeginSection(ns_snapshot::SECTION_IVF_META);
+    writer->Put<uint32_t>(static_cast<uint32_t>(nlist_));
+    writer->Put<uint32_t>(static_cast<uint32_t>(m_));
+    writer->Put<uint32_t>(static_cast<uint32_t>(nprobe_));
+    writer->EndSection();
+    writer->PutArray(ns_snapshot::SECTION_IVF_CENTROIDS, centroids_.data(), centroids_.size());
+    writer->PutArray(ns_snapshot::SECTION_IVF_CODEBOOKS, codebooks_.data(), codebooks_.size());
+    writer->PutArray(ns_snapshot::SECTION_IVF_LIST_OFFSETS, list_offsets_.data(), list_offsets_.size());
+    writer->PutArray(ns_snapshot::SECTION_IVF_IDS, ids_.data(), ids_.size());
+    writer->PutArray(ns_snapshot::SECTION_IVF_CODES, codes_.data(), codes_.size());
+    if (rerank_) {
+        writer->PutArray(ns_snapshot::SECTION_EXACT_VECTORS, exact_vectors_.data(), exact_vectors_.size());
+    }
+    return true;
+}
+
+void IvfPqEngine::Search(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const {
+    using namespace ns_ivfpq;
+    if (nlist_ == 0 || k == 0) {
+        return;
+    }
+    // 挑选 L2 距离最近的 nprobe 个列表：|q - c|^2 = |q|^2 + |c|^2 - 2<q, c>，|q|^2 对所有列表相同
+    std::vector<float> coarse(nlist_);
+    std::vector<std::pair<float, uint32_t>> order(nlist_);
+    for (size_t l = 0; l < nlist_; ++l) {
+        coarse[l] = ns_quant::Dot(query, centroids_.data() + l * dim_, dim_);
+        order[l] = {centroid_norms_[l] - 2 * coarse[l], static_cast<uint32_t>(l)};
+    }
+    size_t nprobe = std::min(nprobe_, nlist_);
+    std::partial_sort(order.begin(), order.begin() + nprobe, order.end());
+
+    // 查询表：每个子空间 16 个码字与查询子向量的内积，减去该子空间的最小值后按统一步长量化到 uint8。
+    // 步长保证 m 个表项相加不超过 uint16 的范围
+    std::vector<float> padded(padded_dim_, 0.0f);
+    std::copy(query, query + dim_, padded.begin());
+    std::vector<float> table(m_ * CODEBOOK_SIZE);
+    float bias = 0.0f, range = 0.0f;
+    for (size_t j = 0; j < m_; ++j) {
+        float lo = std::numeric_limits<float>::max(), hi = std::numeric_limits<float>::lowest();
+        for (size_t c = 0; c < CODEBOOK_SIZE; ++c) {
+            float value = ns_quant::Dot(padded.data() + j * SUB_DIM,
+                                        codebooks_.data() + (j * CODEBOOK_SIZE + c) * SUB_DIM, SUB_DIM);
+            table[j * CODEBOOK_SIZE + c] = value;
+            lo = std::min(lo, value);
+            hi = std::max(hi, value);
+        }
+        for (size_t c = 0; c < CODEBOOK_SIZE; ++c) {
+            table[j * CODEBOOK_SIZE + c] -= lo;
+        }
+        bias += lo;
+        range = std::max(range, hi - lo);
+    }
+    float levels = static_cast<float>(std::min<size_t>(255, 65535 / m_));
+    float step = range > 0.0f ? range / levels : 1.0f;
+    std::vector<uint8_t> lut(m_ * CODEBOOK_SIZE);
+    for (size_t i = 0; i < lut.size(); ++i) {
+        lut[i] = static_cast<uint8_t>(std::min(levels, std::round(table[i] / step)));
+    }
+
+    // 扫描选中的列表，用小顶堆保留近似内积最大的 max(k, candidates) 个候选（不精排时只需 k 个）
+    size_t keep = rerank_ ? std::max(k, candidates) : k;
+    std::priority_queue<std::pair<float, uint32_t>, std::vector<std::pair<float, uint32_t>>,
+                        std::greater<std::pair<float, uint32_t>>> top;
+    uint16_t sums[BLOCK_SIZE];
+    const ScanBlockFn scan_block = SelectScanBlock();
+    size_t block_bytes = BLOCK_SIZE * m_ / 2;
+    for (size_t p = 0; p < nprobe; ++p) {
+        uint32_t list = order[p].second;
+        float base = coarse[list] + bias;
+        for (uint32_t slot = list_offsets_[list]; slot < list_offsets_[list + 1]; slot += BLOCK_SIZE) {
+            scan_block(codes_.data() + static_cast<size_t>(slot / BLOCK_SIZE) * block_bytes, lut.data(), m_, sums);
+            for (size_t lane = 0; lane < BLOCK_SIZE; ++lane) {
+                uint32_t ordinal = ids_[slot + lane];
+                if (ordinal == EMPTY_SLOT || deleted_[ordinal].load(std::memory_order_relaxed) != 0) {
+                    continue;
+                }
+                float score = base + step * sums[lane];
+                if (top.size() < keep) {
+                    top.emplace(score, ordinal);
+                } else if (score > top.top().first) {
+                    top.pop();
+                    top.emplace(score, ordinal);
+                }
+            }
+        }
+    }
+    std::vector<VectorHit> found;
+    found.reserve(top.size());
+    while (!top.empty()) {
+        found.push_back({top.top().second, top.top().first});
+        top.pop();
+    }
+    if (rerank_) {
+        RerankHits(query, dim_, k, &found, [this](uint32_t ordinal) {
+            return exact_vectors_.data() + static_cast<size_t>(rows_[ordinal]) * dim_;
+        });
+    } else {
+        // 近似内积即相似度，堆按从小到大弹出
+        std::reverse(found.begin(), found.end());
+    }
+    hits->insert(hits->end(), found.begin(), found.end());
+}
+
+const float* IvfPqEngine::GetVector(uint32_t ordinal) const {
+    if (!rerank_ || ordinal >= slots_.size() || slots_[ordinal] == ns_ivfpq::EMPTY_SLOT ||
+        deleted_[ordinal].load(std::memory_order_relaxed) != 0) {
+        return nullptr;
+    }
+    return exact_vectors_.data() + static_cast<size_t>(rows_[ordinal]) * dim_;
+}
+
+bool IvfPqEngine::DecodeVector(uint32_t ordinal, float* out) const {
+    using namespace ns_ivfpq;
+    if (ordinal >= slots_.size() || slots_[ordinal] == EMPTY_SLOT || deleted_[ordinal].load(std::memory_order_relaxed) != 0) {
+        return false;
+    }
+    if (const float* vec = GetVector(ordinal)) {
+        std::copy(vec, vec + dim_, out);
+        return true;
+    }
+    // x ≈ 所属列表的中心 + 各子空间码字拼接的残差
+    uint32_t slot = slots_[ordinal];
+    size_t list = static_cast<size_t>(std::upper_bound(list_offsets_.begin(), list_offsets_.end(), slot) - list_offsets_.begin()) - 1;
+    const float* centroid = centroids_.data() + list * dim_;
+    const uint8_t* block = codes_.data() + static_cast<size_t>(slot / BLOCK_SIZE) * BLOCK_SIZE * m_ / 2;
+    for (size_t j = 0; j < m_; ++j) {
+        uint8_t packed = block[j / 2 * BLOCK_SIZE + slot % BLOCK_SIZE];
+        uint8_t code = j % 2 == 0 ? packed & 0x0f : packed >> 4;
+        const float* codeword = codebooks_.data() + (j * CODEBOOK_SIZE + code) * SUB_DIM;
+        for (size_t t = 0; t < SUB_DIM; ++t) {
+            size_t d = j * SUB_DIM + t;
+            if (d < static_cast<size_t>(dim_)) {
+                out[d] = centroid[d] + codeword[t];
+            }
+        }
+    }
+    return true;
+}
+
+void IvfPqEngine::MarkDeleted(uint32_t ordinal) {
+    if (ordinal < slots_.size()) {
+        deleted_[ordinal].store(1, std::memory_order_relaxed);
+    }
+}
+
+} // namespace ns_index
@@ -0,0 +1,173 @@
+#pragma once
+#include <cctype>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <jsoncpp/json/json.h>
+
+namespace ns_util
+{
+    // 流式读取 JSON 顶层数组：按固定大小的块读取文件，扫描出顶层数组中的一个元素后立即交给
+    // jsoncpp 解析成一个小的 Json::Value，调用方处理完再读取下一个。
+    // 整个过程中内存里只有一个读缓冲区和当前这一个元素，不会为整个文件建立 DOM。
+    class JsonArrayStreamReader
+    {
+    public:
+        explicit JsonArrayStreamReader(size_t chunk_size = 1 << 20)
+            : buf_(chunk_size)
+        {
+            Json::CharReaderBuilder builder;
+            reader_.reset(builder.newCharReader());
+        }
+
+        bool Open(const std::string &path)
+        {
+            in_.open(path, std::ios::binary);
+            pos_ = len_ = 0;
+            started_ = finished_ = false;
+            error_.clear();
+            return in_.is_open();
+        }
+
+        // 读取数组中的下一个元素。数组结束或出错时返回 false，可通过 error() 区分两种情况
+        bool Next(Json::Value *value)
+        {
+            if (!NextRaw(&elem_)) {
+                return false;
+            }
+            std::string errs;
+            if (!reader_->parse(elem_.data(), elem_.data() + elem_.size(), value, &errs)) {
+                return Fail(errs);
+            }
+            return true;
+        }
+
+        // 只截取下一个元素的原始文本而不解析，便于把解析工作交给其他线程
+        bool NextRaw(std::string *text)
+        {
+            if (finished_) {
+                return false;
+            }
+            char c;
+            if (!started_) {
+                if (!SkipWhitespace(&c) || c != '[') {
+                    return Fail("预期 JSON 根元素为数组。");
+                }
+                ++pos_;
+                started_ = true;
+            }
+            // 跳过元素之间的空白和逗号
+            while (true) {
+                if (!SkipWhitespace(&c)) {
+                    return Fail("JSON 数组未正常结束。");
+                }
+                if (c != ',') {
+                    break;
+                }
+                ++pos_;
+            }
+            if (c == ']') {
+                ++pos_;
+                finished_ = true;
+                return false;
+            }
+
+            // 截取一个完整的元素：对象/数组按括号深度匹配，字符串按引号匹配（跳过转义），
+            // 其余标量读到逗号、右括号或空白为止
+            text->clear();
+            int depth = 0;
+            bool in_string = false;
+            bool escaped = false;
+            bool scalar = (c != '{' && c != '[' && c != '"');
+            bool done = false;
+            while (!done) {
+                if (pos_ == len_ && !Fill()) {
+                    return Fail("JSON 元素未正常结束。");
+                }
+                size_t start = pos_;
+                for (; pos_ < len_; ++pos_) {
+                    char ch = buf_[pos_];
+                    if (in_string) {
+                        if (escaped) {
+                            escaped = false;
+                        } else if (ch == '\\') {
+                            escaped = true;
+                        } else if (ch == '"') {
+                            in_string = false;
+                            if (depth == 0) {
+                                ++pos_;
+                                done = true;
+                                break;
+                            }
+                        }
+                        continue;
+                    }
+                    if (scalar) {
+                        if (ch == ',' || ch == ']' || std::isspace(static_cast<unsigned char>(ch))) {
+                            done = true;
+                            break;
+                        }
+                        continue;
+                    }
+                    if (ch == '"') {
+                        in_string = true;
+                    } else if (ch == '{' || ch == '[') {
+                        ++depth;
+                    } else if (ch == '}' || ch == ']') {
+                        if (--depth == 0) {
+                            ++pos_;
+                            done = true;
+                            break;
+                        }
+                    }
+                }
+                text->append(buf_.data() + start, pos_ - start);
+            }
+            return true;
+        }
+
+        // 为空表示数组已正常读完
+        const std::string &error() const { return error_; }
+
+    private:
+        bool Fill()
+        {
+            in_.read(buf_.data(), buf_.size());
+            len_ = static_cast<size_t>(in_.gcount());
+            pos_ = 0;
+            return len_ > 0;
+        }
+
+        bool SkipWhitespace(char *c)
+        {
+            while (true) {
+                if (pos_ == len_ && !Fill()) {
+                    return false;
+                }
+                *c = buf_[pos_];
+                if (!std::isspace(static_cast<unsigned char>(*c))) {
+                    return true;
+                }
+                ++pos_;
+            }
+        }
+
+        bool Fail(const std::string &err)
+        {
+            error_ = err;
+            finished_ = true;
+            return false;
+        }
+
+        std::ifstream in_;
+        std::vector<char> buf_;
+        size_t pos_ = 0;
+        size_t len_ = 0;
+        bool started_ = false;
+        bool finished_ = false;
+        std::string elem_;     // 当前元素的原始文本，复用容量避免反复分配
+        std::string error_;
+        std::unique_ptr<Json::CharReader> reader_;
+    };
+}
@@ -0,0 +1,321 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "lemfileutil.hpp"
+#include "lempostings.hpp"
+#include "lemappend.hpp"
+
+// 位置倒排：记录每个词在标题（title）、词形变化（forms）和释义（senses）中出现的位置，支撑短语查询和 +/- 布尔查询（见 lemquery.hpp）。
+// 它与打分用的倒排拉链（lempostings.hpp）相互独立：有自己的词典，按精确模式的分词结果建立（相邻的词在原文中也相邻），
+// 只判断文档是否满足查询条件，不参与打分。+/- 条件总是在这里判断，字段范围不随构建选项变化；
+// 构建时可以只保留文档区间、不保留位置（BuildOptions::positions 为 false），此时短语退化为各词同时出现。
+// 存储同样是 CSR 形式的结构数组：
+//   offsets[term_id] .. offsets[term_id + 1] 为该词的文档区间，docs 中的文档序号升序、不压缩，求交时直接倍增查找；
+//   第 e 个文档的位置为 positions[pos_offsets[e] .. pos_offsets[e + 1])，升序（不保留位置时两者为空）。
+// 位置编号：一个文档中的词连续编号，title 从 0 开始；forms 从 title 的词数 + POSITION_GAP 开始，
+// senses 接着 forms 的最后一个位置再隔开 POSITION_GAP，每条释义之间也隔开 POSITION_GAP。
+// 各段的起点随前面的词数变化，不是固定值；相邻两段之间至少相差 POSITION_GAP，短语不会跨越字段或释义匹配。
+// forms 中的多个词形以空格拼接，与词形内部的空格无法区分，短语可能跨越相邻的两个词形。
+
+namespace ns_index {
+
+const uint32_t POSITION_GAP = 1024;
+
+// 一个文档中每个词出现的位置（升序），分词时产生
+using DocPositions = std::unordered_map<std::string, std::vector<uint32_t>>;
+
+// 构建期的位置倒排：各文档的位置拼接在同一个数组中，避免每个节点单独分配内存
+struct RawPositions {
+    struct Entry {
+        uint64_t doc_id;
+        uint64_t seq;     // 所属词条在输入中的顺序号（DocInfo::seq）
+        uint64_t begin;   // 在 pool 中的起点
+        uint32_t count;
+    };
+    std::unordered_map<std::string, std::vector<Entry>> terms;
+    std::vector<uint32_t> pool;
+
+    void Add(const std::string& term, uint64_t doc_id, const uint32_t* positions, uint32_t count, uint64_t seq = 0) {
+        terms[term].push_back({doc_id, seq, pool.size(), count});
+        pool.insert(pool.end(), positions, positions + count);
+    }
+
+    void AddDoc(uint64_t doc_id, uint64_t seq, const DocPositions& doc) {
+        for (const auto& pair : doc) {
+            Add(pair.first, doc_id, pair.second.data(), static_cast<uint32_t>(pair.second.size()), seq);
+        }
+    }
+
+    // 并入另一个线程的结果
+    void Append(RawPositions&& other) {
+        uint64_t shift = pool.size();
+        pool.insert(pool.end(), other.pool.begin(), other.pool.end());
+        for (auto& pair : other.terms) {
+            std::vector<Entry>& dst = terms[pair.first];
+            for (Entry entry : pair.second) {
+                entry.begin += shift;
+                dst.push_back(entry);
+            }
+        }
+        other = RawPositions();
+    }
+
+    void Clear() { *this = RawPositions(); }
+};
+
+// 一个词的位置拉链视图，不可变段指向 PositionStore 内部，内存段指向 MemPositionList
+struct PositionList {
+    uint32_t size = 0;
+    const uint32_t* docs = nullptr;         // 升序文档序号
+    const uint64_t* pos_offsets = nullptr;  // size + 1 个，第 i 个文档的位置区间
+    const uint32_t* positions = nullptr;
+
+    const uint32_t* PositionsBegin(uint32_t i) const { return positions + pos_offsets[i]; }
+    const uint32_t* PositionsEnd(uint32_t i) const { return positions + pos_offsets[i + 1]; }
+};
+
+// 内存段中一个词的位置拉链：新文档的序号总是更大，按写入顺序追加即保持升序。
+// 写线程依次追加位置、位置区间和文档序号，查询线程不加锁地读取前 doc_count 个文档（见 lemappend.hpp）。
+// with_positions 为 false 时只记录文档序号
+struct MemPositionList {
+    AppendVector<uint32_t> docs;
+    AppendVector<uint64_t> pos_offsets;
+    AppendVector<uint32_t> positions;
+
+    MemPositionList() { pos_offsets.push_back(0); }
+
+    void Append(uint32_t ordinal, const std::vector<uint32_t>& doc_positions, bool with_positions) {
+        if (with_positions) {
+            positions.append(doc_positions.begin(), doc_positions.end());
+            pos_offsets.push_back(positions.size());
+        }
+        docs.push_back(ordinal);
+    }
+
+    // 只含序号小于 doc_count 的文档，先读文档序号：它之前追加的位置区间和位置都已可见
+    PositionList View(uint32_t doc_count, bool with_positions) const {
+        size_t size = docs.size();
+        const uint32_t* ordinals = docs.data();
+        PositionList list;
+        list.size = static_cast<uint32_t>(std::lower_bound(ordinals, ordinals + size, doc_count) - ordinals);
+        list.docs = ordinals;
+        if (with_positions) {
+            list.pos_offsets = pos_offsets.data();
+            list.positions = positions.data();
+        }
+        return list;
+    }
+};
+
+// 不可变段的位置倒排
+class PositionStore {
+public:
+    bool Find(std::string_view word, PositionList* list) const {
+        uint32_t term_id = 0;
+        if (!dictionary.Find(word, &term_id)) {
+            return false;
+        }
+        uint64_t begin = offsets[term_id];
+        list->size = static_cast<uint32_t>(offsets[term_id + 1] - begin);
+        list->docs = docs.data() + begin;
+        list->pos_offsets = HasPositions() ? pos_offsets.data() + begin : nullptr;
+        list->positions = HasPositions() ? positions.data() : nullptr;
+        return true;
+    }
+
+    // 构建时关闭了位置（BuildOptions::positions）则只有文档区间
+    bool HasPositions() const { return !pos_offsets.empty(); }
+
+    size_t bytes() const {
+        return dictionary.bytes.size() + dictionary.offsets.size() * sizeof(uint64_t) + offsets.size() * sizeof(uint64_t) +
+               docs.size() * sizeof(uint32_t) + pos_offsets.size() * sizeof(uint64_t) + positions.size() * sizeof(uint32_t);
+    }
+
+    bool Validate(size_t doc_count) const {
+        size_t term_count = dictionary.size();
+        if (offsets.size() != term_count + 1 || offsets[term_count] != docs.size()) {
+            return false;
+        }
+        if (HasPositions() ? pos_offsets.size() != docs.size() + 1 || pos_offsets[docs.size()] != positions.size()
+                           : !positions.empty()) {
+            return false;
+        }
+        for (uint32_t doc : docs) {
+            if (doc >= doc_count) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Clear() {
+        dictionary.Clear();
+        offsets.Clear();
+        docs.Clear();
+        pos_offsets.Clear();
+        positions.Clear();
+    }
+
+    TermDictionary dictionary;
+    ns_util::MappedArray<uint64_t> offsets;
+    ns_util::MappedArray<uint32_t> docs;
+    ns_util::MappedArray<uint64_t> pos_offsets;
+    ns_util::MappedArray<uint32_t> positions;
+};
+
+// 把构建期的位置倒排压实为 PositionStore，doc_id 通过 ordinals 映射为文档序号，with_positions 为 false 时只保留文档区间。
+// 同一 doc_id 出现多次时保留 seq 最大的一份（与正排保留的词条一致，不受并行构建时的拼接顺序影响）。处理完一个词就释放它的构建期拉链
+inline void BuildPositionStore(RawPositions* raw, const std::unordered_map<uint64_t, uint32_t>& ordinals,
+                               bool with_positions, PositionStore* store) {
+    std::vector<std::string> terms;
+    terms.reserve(raw->terms.size());
+    for (const auto& pair : raw->terms) {
+        terms.push_back(pair.first);
+    }
+    std::sort(terms.begin(), terms.end());
+
+    std::vector<uint64_t> term_offsets{0};
+    std::vector<uint32_t> docs;
+    std::vector<uint64_t> pos_offsets{0};
+    std::vector<uint32_t> positions;
+    term_offsets.reserve(terms.size() + 1);
+    using OrdinalEntry = std::pair<uint32_t, const RawPositions::Entry*>;
+    std::vector<OrdinalEntry> list;
+    for (const auto& term : terms) {
+        auto it = raw->terms.find(term);
+        list.clear();
+        for (const auto& entry : it->second) {
+            auto ord = ordinals.find(entry.doc_id);
+            if (ord != ordinals.end()) {
+                list.emplace_back(ord->second, &entry);
+            }
+        }
+        std::stable_sort(list.begin(), list.end(), [](const OrdinalEntry& a, const OrdinalEntry& b) {
+            return a.first != b.first ? a.first < b.first : a.second->seq < b.second->seq;
+        });
+        for (size_t i = 0; i < list.size(); ++i) {
+            if (i + 1 < list.size() && list[i + 1].first == list[i].first) {
+                continue;
+            }
+            const RawPositions::Entry& entry = *list[i].second;
+            docs.push_back(list[i].first);
+            if (with_positions) {
+                positions.insert(positions.end(), raw->pool.begin() + entry.begin, raw->pool.begin() + entry.begin + entry.count);
+                pos_offsets.push_back(positions.size());
+            }
+        }
+        term_offsets.push_back(docs.size());
+        raw->terms.erase(it);
+    }
+    raw->Clear();
+    store->dictionary.Build(terms);
+    store->offsets.Assign(std::move(term_offsets));
+    store->docs.Assign(std::move(docs));
+    if (with_positions) {
+        store->pos_offsets.Assign(std::move(pos_offsets));
+        store->positions.Assign(std::move(positions));
+    }
+}
+
+// ---- 升序数组的查找与求交 ----
+
+// 在 [first, last) 中线性查找第一个 >= target 的位置，只用于很短的区间；SSE2 一次比较 4 个
+inline const uint32_t* ScanTo(const uint32_t* first, const uint32_t* last, uint32_t target) {
+#if defined(__SSE2__)
+    // SSE2 只有有符号比较，两边都翻转最高位后再比较
+    const __m128i bias = _mm_set1_epi32(INT32_MIN);
+    const __m128i key = _mm_xor_si128(_mm_set1_epi32(static_cast<int>(target)), bias);
+    for (; last - first >= 4; first += 4) {
+        __m128i values = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(first)), bias);
+        int less = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(values, key)));
+        if (less != 0xF) {
+            // 数组升序，小于 target 的总是前缀
+            return first + (less & 1) + ((less >> 1) & 1) + ((less >> 2) & 1);
+        }
+    }
+#endif
+    while (first < last && *first < target) {
+        ++first;
+    }
+    return first;
+}
+
+// 倍增查找（galloping）：从 first 开始按 1、2、4… 的步长越过小于 target 的部分，再在最后一步的区间内查找。
+// 目标离起点越近代价越小，适合在长数组上按升序依次查找一批目标
+inline const uint32_t* GallopTo(const uint32_t* first, const uint32_t* last, uint32_t target) {
+    if (first == last || *first >= target) {
+        return first;
+    }
+    size_t step = 1;
+    while (step < static_cast<size_t>(last - first) && first[step] < target) {
+        first += step;
+        step <<= 1;
+    }
+    // 此时 *first < target，答案在 (first, first + step] 中
+    const uint32_t* hi = step < static_cast<size_t>(last - first) ? first + step : last;
+    if (hi - first <= 16) {
+        return ScanTo(first + 1, hi, target);
+    }
+    return std::lower_bound(first + 1, hi, target);
+}
+
+// 两个升序数组求交，结果写入 out（不能与 a、b 重叠）：遍历较短的一个，在较长的一个上倍增查找，
+// 代价约为 O(短 * log(长 / 短))，选择性越高越快
+inline void IntersectSorted(const uint32_t* a, size_t na, const uint32_t* b, size_t nb, std::vector<uint32_t>* out) {
+    if (na > nb) {
+        std::swap(a, b);
+        std::swap(na, nb);
+    }
+    out->clear();
+    const uint32_t* pos = b;
+    const uint32_t* end = b + nb;
+    for (size_t i = 0; i < na && pos != end; ++i) {
+        pos = GallopTo(pos, end, a[i]);
+        if (pos != end && *pos == a[i]) {
+            out->push_back(a[i]);
+        }
+    }
+}
+
+// 升序数组 [*cursor, last) 中是否含有 target：倍增查找后 cursor 停在第一个 >= target 的位置，
+// 依次查找一批单调不减的目标时，每次都从上次停下的位置继续
+inline bool ContainsSorted(const uint32_t** cursor, const uint32_t* last, uint32_t target) {
+    *cursor = GallopTo(*cursor, last, target);
+    return *cursor != last && **cursor == target;
+}
+
+// 短语匹配：spans[i] 为短语第 i 个词在同一文档中的位置区间（升序），
+// 判断是否存在 p 使第 i 个词出现在位置 p + i。spans 的起点作为游标原地推进
+inline bool MatchPhrase(std::vector<std::pair<const uint32_t*, const uint32_t*>>* spans) {
+    auto& s = *spans;
+    if (s.empty()) {
+        return false;
+    }
+    for (const uint32_t* p = s[0].first; p != s[0].second; ++p) {
+        bool matched = true;
+        for (size_t i = 1; i < s.size(); ++i) {
+            if (!ContainsSorted(&s[i].first, s[i].second, *p + static_cast<uint32_t>(i))) {
+                matched = false;
+                if (s[i].first == s[i].second) {
+                    return false;  // 第 i 个词已没有更靠后的位置
+                }
+                break;
+            }
+        }
+        if (matched) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace ns_index
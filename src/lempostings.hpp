@@ -0,0 +1,447 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+#include "lemfileutil.hpp"
+#include "lembitpack.hpp"
+#include "lemscoring.hpp"
+
+// 词典与倒排拉链的紧凑存储
+// 关键词按字典序排列后，其下标即为 term_id；倒排拉链采用 CSR 形式的结构数组（SoA）布局：
+//   offsets[term_id] .. offsets[term_id + 1] 为该词的倒排节点区间，impacts 按此区间存放预先算好的不含 IDF 的 BM25F 得分（float，见 lemscoring.hpp），
+//   field_tfs 存放各字段的词频（uint16，每个节点 SCORED_FIELD_COUNT 个），只在合并段、重新计算得分时使用；
+//   文档序号按升序切成 128 个一块，整块做差值 + 位打包压缩（见 lembitpack.hpp），
+//   每块记录最大文档序号作为跳表指针；不足一块的尾部原样存放在 tail_docs 中。
+//   block_max 与 blocks 一一对应，记录块内的最大得分；term_max 记录每个词整条拉链的最大得分（也是尾部的上界），
+//   供 Block-Max WAND 判断一整块能否进入前 k（见 lemwand.hpp）。
+// 短拉链（绝大多数关键词）只有尾部，不产生任何块开销；长拉链压缩后通常只剩原来的 1/4 左右。
+// 所有数组都是 MappedArray，既可以在构建时持有数据，也可以直接映射快照文件。
+
+namespace ns_index {
+
+// 构建期的倒排拉链节点：分词时按 doc_id 记录，全部文档分完后再压实为 PostingStore
+struct RawPosting {
+    uint64_t doc_id;                    // 文档ID
+    uint16_t tf[SCORED_FIELD_COUNT];    // 关键词在标题和词形变化中的出现次数
+};
+
+using RawPostings = std::unordered_map<std::string, std::vector<RawPosting>>;
+
+// 增量更新追加的倒排节点：新文档的序号总是大于已有序号，按写入顺序追加即保持升序
+struct DeltaPosting {
+    uint32_t ordinal;                   // 文档序号
+    uint16_t tf[SCORED_FIELD_COUNT];    // 各字段词频，与 RawPosting 相同
+};
+
+// 词频累加，超出 uint16 时饱和
+inline void AddFieldTfs(uint16_t* dst, const uint16_t* src) {
+    for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+        dst[f] = static_cast<uint16_t>(std::min<uint32_t>(uint32_t(dst[f]) + src[f], UINT16_MAX));
+    }
+}
+
+const uint32_t POSTING_BLOCK_SIZE = ns_util::BITPACK_BLOCK_SIZE;
+
+// 压缩块的跳表项，写入快照时原样落盘
+struct PostingBlock {
+    uint32_t last_doc;     // 块内最大的文档序号，小于目标时整块跳过，无需解压
+    uint32_t data_offset;  // 压缩数据在 PostingStore::packed 中的起始下标（以 uint32 计）
+    uint8_t bits;          // 差值位宽，压缩数据长度为 4 * bits 个 uint32
+    uint8_t reserved[3];
+};
+static_assert(sizeof(PostingBlock) == 12, "PostingBlock 是快照格式的一部分，布局不能改变");
+
+// 一条倒排拉链的只读视图，指向 PostingStore 内部的连续数组。
+// 拉链按块访问：前 block_count 块是压缩块，最后一块（如果有）是未压缩的尾部，
+// 第 chunk 块中第 i 个文档的得分为 impacts[chunk * POSTING_BLOCK_SIZE + i]
+struct InvertedList {
+    uint32_t term_id = 0;
+    uint32_t size = 0;
+    uint32_t block_count = 0;              // 压缩块数量
+    const PostingBlock* blocks = nullptr;
+    const uint32_t* packed = nullptr;      // 整个 PostingStore 的压缩数据，按 blocks[i].data_offset 定位
+    const uint32_t* tail = nullptr;        // 尾部文档序号，共 size - block_count * POSTING_BLOCK_SIZE 个
+    const float* impacts = nullptr;        // 与文档一一对应的 BM25F 得分
+    const uint16_t* field_tfs = nullptr;   // 与文档一一对应的字段词频，每个文档 SCORED_FIELD_COUNT 个
+    const float* block_max = nullptr;      // 每个压缩块的最大得分
+    float max_impact = 0.0f;               // 整条拉链的最大得分
+
+    uint32_t chunk_count() const {
+        return block_count + (size > block_count * POSTING_BLOCK_SIZE ? 1 : 0);
+    }
+
+    // 取出第 chunk 块的文档序号：压缩块解压到 buffer（至少 POSTING_BLOCK_SIZE 个），
+    // 尾部直接返回内部指针。count 返回该块的文档数
+    const uint32_t* DecodeChunk(uint32_t chunk, uint32_t* buffer, uint32_t* count) const {
+        if (chunk < block_count) {
+            uint32_t base = chunk == 0 ? 0 : blocks[chunk - 1].last_doc;
+            ns_util::UnpackBlock(packed + blocks[chunk].data_offset, base, blocks[chunk].bits, buffer);
+            *count = POSTING_BLOCK_SIZE;
+            return buffer;
+        }
+        *count = size - block_count * POSTING_BLOCK_SIZE;
+        return tail;
+    }
+
+    // 第 chunk 块的最大文档序号
+    uint32_t chunk_last_doc(uint32_t chunk) const {
+        if (chunk < block_count) {
+            return blocks[chunk].last_doc;
+        }
+        return tail[size - block_count * POSTING_BLOCK_SIZE - 1];
+    }
+
+    // 第 chunk 块得分的上界：压缩块为块内最大得分，尾部没有单独记录，用整条拉链的最大得分
+    float chunk_max(uint32_t chunk) const {
+        return chunk < block_count ? block_max[chunk] : max_impact;
+    }
+};
+
+// 在一条拉链上按文档序号前进的游标，每次只解压当前所在的块。
+// SkipTo 先用跳表项整块跳过，再在块内查找，适合多条拉链求交。
+// 另有一个只看跳表项、不解压的"浅"块指针（ShallowSkipTo），用来在解压之前查询某个文档所在块的得分上界
+class PostingCursor {
+public:
+    explicit PostingCursor(const InvertedList& list) : list_(list) {
+        chunks_ = list_.chunk_count();
+        LoadChunk(0);
+    }
+    // docs_ 可能指向自身的 buffer_，拷贝后会悬空
+    PostingCursor(const PostingCursor&) = delete;
+    PostingCursor& operator=(const PostingCursor&) = delete;
+
+    bool valid() const { return chunk_ < chunks_; }
+    uint32_t doc() const { return docs_[pos_]; }
+    float impact() const { return list_.impacts[chunk_ * POSTING_BLOCK_SIZE + pos_]; }
+
+    void Next() {
+        if (++pos_ == count_) {
+            LoadChunk(chunk_ + 1);
+        }
+    }
+
+    // 把浅块指针移到可能包含 target 的块（最大文档序号 >= target 的第一块），不解压。
+    // 返回该块的得分上界，越过末尾时返回 0。浅块指针只前进，target 需单调不减
+    float ShallowSkipTo(uint32_t target) {
+        while (shallow_ < chunks_ && list_.chunk_last_doc(shallow_) < target) {
+            ++shallow_;
+        }
+        return shallow_ < chunks_ ? list_.chunk_max(shallow_) : 0.0f;
+    }
+
+    // 浅块指针所在块的最大文档序号，越过末尾时为 UINT32_MAX
+    uint32_t shallow_last_doc() const { return shallow_ < chunks_ ? list_.chunk_last_doc(shallow_) : UINT32_MAX; }
+
+    // 前进到第一个文档序号 >= target 的位置，越过末尾后 valid() 为 false
+    void SkipTo(uint32_t target) {
+        if (!valid() || doc() >= target) {
+            return;
+        }
+        uint32_t chunk = chunk_;
+        while (chunk < chunks_ && list_.chunk_last_doc(chunk) < target) {
+            ++chunk;
+        }
+        if (chunk != chunk_) {
+            LoadChunk(chunk);
+            if (!valid()) {
+                return;
+            }
+        }
+        pos_ = static_cast<uint32_t>(std::lower_bound(docs_ + pos_, docs_ + count_, target) - docs_);
+    }
+
+private:
+    void LoadChunk(uint32_t chunk) {
+        chunk_ = chunk;
+        shallow_ = std::max(shallow_, chunk_);
+        pos_ = 0;
+        count_ = 0;
+        if (chunk_ < chunks_) {
+            docs_ = list_.DecodeChunk(chunk_, buffer_, &count_);
+        }
+    }
+
+    InvertedList list_;
+    uint32_t chunks_ = 0;
+    uint32_t chunk_ = 0;
+    uint32_t shallow_ = 0;
+    uint32_t pos_ = 0;
+    uint32_t count_ = 0;
+    const uint32_t* docs_ = nullptr;
+    uint32_t buffer_[POSTING_BLOCK_SIZE];
+};
+
+// 有序词典：所有关键词拼接在一个字节数组中，offsets 记录每个词的起止位置。
+// 查找通过二分完成，加载快照时无需重建哈希表
+class TermDictionary {
+public:
+    void Build(const std::vector<std::string>& sorted_terms) {
+        std::vector<char> term_bytes;
+        std::vector<uint64_t> term_offsets;
+        term_offsets.reserve(sorted_terms.size() + 1);
+        term_offsets.push_back(0);
+        for (const auto& term : sorted_terms) {
+            term_bytes.insert(term_bytes.end(), term.begin(), term.end());
+            term_offsets.push_back(term_bytes.size());
+        }
+        bytes.Assign(std::move(term_bytes));
+        offsets.Assign(std::move(term_offsets));
+    }
+
+    bool Find(std::string_view word, uint32_t* term_id) const {
+        size_t lo = 0, hi = size();
+        while (lo < hi) {
+            size_t mid = lo + (hi - lo) / 2;
+            int cmp = Term(mid).compare(word);
+            if (cmp == 0) {
+                *term_id = static_cast<uint32_t>(mid);
+                return true;
+            }
+            if (cmp < 0) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        return false;
+    }
+
+    std::string_view Term(size_t term_id) const {
+        return std::string_view(bytes.data() + offsets[term_id], offsets[term_id + 1] - offsets[term_id]);
+    }
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+
+    void Clear() {
+        bytes.Clear();
+        offsets.Clear();
+    }
+
+    ns_util::MappedArray<char> bytes;
+    ns_util::MappedArray<uint64_t> offsets;
+};
+
+// CSR 布局的块压缩倒排拉链存储。
+// term_id 的压缩块为 blocks[block_offsets[term_id] .. block_offsets[term_id + 1])，
+// 尾部在 tail_docs 中的起点可由前面所有词的尾部长度推出：offsets[term_id] - 128 * block_offsets[term_id]
+class PostingStore {
+public:
+    InvertedList Get(uint32_t term_id) const {
+        InvertedList list;
+        list.term_id = term_id;
+        uint64_t begin = offsets[term_id];
+        uint32_t first_block = block_offsets[term_id];
+        list.size = static_cast<uint32_t>(offsets[term_id + 1] - begin);
+        list.block_count = block_offsets[term_id + 1] - first_block;
+        list.blocks = blocks.data() + first_block;
+        list.packed = packed.data();
+        list.tail = tail_docs.data() + (begin - static_cast<uint64_t>(first_block) * POSTING_BLOCK_SIZE);
+        list.impacts = impacts.data() + begin;
+        list.field_tfs = field_tfs.data() + begin * SCORED_FIELD_COUNT;
+        list.block_max = block_max.data() + first_block;
+        list.max_impact = term_max[term_id];
+        return list;
+    }
+
+    size_t posting_count() const { return impacts.size(); }
+
+    // 文档序号部分占用的字节数，用于统计压缩效果
+    size_t doc_bytes() const {
+        return blocks.size() * sizeof(PostingBlock) + packed.size() * sizeof(uint32_t) +
+               tail_docs.size() * sizeof(uint32_t) + block_offsets.size() * sizeof(uint32_t);
+    }
+
+    // 校验各数组长度是否彼此一致，加载快照时使用
+    bool Validate(size_t term_count) const {
+        if (offsets.size() != term_count + 1 || block_offsets.size() != term_count + 1) {
+            return false;
+        }
+        if (term_count == 0) {
+            return true;
+        }
+        if (offsets[term_count] != impacts.size() || block_offsets[term_count] != blocks.size() ||
+            field_tfs.size() != impacts.size() * SCORED_FIELD_COUNT ||
+            block_max.size() != blocks.size() || term_max.size() != term_count ||
+            impacts.size() != static_cast<uint64_t>(blocks.size()) * POSTING_BLOCK_SIZE + tail_docs.size()) {
+            return false;
+        }
+        for (const auto& block : blocks) {
+            if (block.bits > 32 || static_cast<uint64_t>(block.data_offset) + 4 * block.bits > packed.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Clear() {
+        offsets.Clear();
+        block_offsets.Clear();
+        blocks.Clear();
+        packed.Clear();
+        tail_docs.Clear();
+        impacts.Clear();
+        field_tfs.Clear();
+        block_max.Clear();
+        term_max.Clear();
+    }
+
+    ns_util::MappedArray<uint64_t> offsets;
+    ns_util::MappedArray<uint32_t> block_offsets;
+    ns_util::MappedArray<PostingBlock> blocks;
+    ns_util::MappedArray<uint32_t> packed;
+    ns_util::MappedArray<uint32_t> tail_docs;
+    ns_util::MappedArray<float> impacts;
+    ns_util::MappedArray<uint16_t> field_tfs;
+    ns_util::MappedArray<float> block_max;
+    ns_util::MappedArray<float> term_max;
+};
+
+// 把构建期的倒排拉链压实为词典 + PostingStore：关键词按字典序编号，
+// doc_id 通过 ordinals 映射为文档序号，拉链按序号排序，同一文档的重复节点合并词频。
+// 此时只填入词频，得分由 ScorePostings 在全部拉链压实之后计算。
+// 处理完一个词就释放它的构建期拉链，峰值内存不会叠加两份倒排索引
+inline void BuildPostingStore(RawPostings* raw,
+                              const std::unordered_map<uint64_t, uint32_t>& ordinals,
+                              TermDictionary* dictionary, PostingStore* store) {
+    std::vector<std::string> terms;
+    terms.reserve(raw->size());
+    size_t total = 0;
+    for (const auto& pair : *raw) {
+        terms.push_back(pair.first);
+        total += pair.second.size();
+    }
+    std::sort(terms.begin(), terms.end());
+
+    std::vector<uint64_t> list_offsets;
+    std::vector<uint32_t> list_block_offsets;
+    std::vector<PostingBlock> list_blocks;
+    std::vector<uint32_t> list_packed;
+    std::vector<uint32_t> list_tail;
+    std::vector<uint16_t> list_tfs;
+    list_offsets.reserve(terms.size() + 1);
+    list_block_offsets.reserve(terms.size() + 1);
+    list_tfs.reserve(total * SCORED_FIELD_COUNT);
+    list_offsets.push_back(0);
+    list_block_offsets.push_back(0);
+    std::vector<std::pair<uint32_t, const uint16_t*>> list;
+    std::vector<uint32_t> docs;
+    for (const auto& term : terms) {
+        auto it = raw->find(term);
+        list.clear();
+        for (const auto& posting : it->second) {
+            auto ord = ordinals.find(posting.doc_id);
+            if (ord != ordinals.end()) {
+                list.emplace_back(ord->second, posting.tf);
+            }
+        }
+        std::stable_sort(list.begin(), list.end(),
+                         [](const std::pair<uint32_t, const uint16_t*>& a, const std::pair<uint32_t, const uint16_t*>& b) {
+                             return a.first < b.first;
+                         });
+        docs.clear();
+        for (const auto& entry : list) {
+            if (!docs.empty() && docs.back() == entry.first) {
+                AddFieldTfs(list_tfs.data() + list_tfs.size() - SCORED_FIELD_COUNT, entry.second);
+                continue;
+            }
+            docs.push_back(entry.first);
+            list_tfs.insert(list_tfs.end(), entry.second, entry.second + SCORED_FIELD_COUNT);
+        }
+        raw->erase(it);
+
+        // 整块压缩，剩余不足一块的部分原样放入尾部
+        size_t full = docs.size() / POSTING_BLOCK_SIZE;
+        uint32_t base = 0;
+        for (size_t b = 0; b < full; ++b) {
+            const uint32_t* values = docs.data() + b * POSTING_BLOCK_SIZE;
+            PostingBlock block{};
+            block.last_doc = values[POSTING_BLOCK_SIZE - 1];
+            block.data_offset = static_cast<uint32_t>(list_packed.size());
+            block.bits = static_cast<uint8_t>(ns_util::BlockBitWidth(values, base));
+            list_packed.resize(list_packed.size() + 4 * block.bits);
+            ns_util::PackBlock(values, base, block.bits, list_packed.data() + block.data_offset);
+            list_blocks.push_back(block);
+            base = block.last_doc;
+        }
+        list_tail.insert(list_tail.end(), docs.begin() + full * POSTING_BLOCK_SIZE, docs.end());
+        list_offsets.push_back(docs.size() + list_offsets.back());
+        list_block_offsets.push_back(static_cast<uint32_t>(list_blocks.size()));
+    }
+    dictionary->Build(terms);
+    store->offsets.Assign(std::move(list_offsets));
+    store->block_offsets.Assign(std::move(list_block_offsets));
+    store->blocks.Assign(std::move(list_blocks));
+    store->packed.Assign(std::move(list_packed));
+    store->tail_docs.Assign(std::move(list_tail));
+    store->impacts.Assign(std::vector<float>(list_tfs.size() / SCORED_FIELD_COUNT, 0.0f));
+    store->field_tfs.Assign(std::move(list_tfs));
+    store->block_max.Assign(std::vector<float>(store->blocks.size(), 0.0f));
+    store->term_max.Assign(std::vector<float>(terms.size(), 0.0f));
+}
+
+// 按段内的平均字段长度计算每个倒排节点不含 IDF 的 BM25F 得分（见 lemscoring.hpp），IDF 在查询时按整个视图计算。
+// 字段长度就是该文档在各字段中所有关键词词频之和，第一遍扫描拉链累加得到，第二遍逐个节点计算得分，
+// 同时记下每块和每条拉链的最大得分
+inline void ScorePostings(const Bm25Params& params, size_t doc_count, PostingStore* store) {
+    std::vector<uint32_t> lengths(doc_count * SCORED_FIELD_COUNT, 0);
+    uint64_t totals[SCORED_FIELD_COUNT] = {};
+    uint32_t buffer[POSTING_BLOCK_SIZE];
+    size_t term_count = store->offsets.empty() ? 0 : store->offsets.size() - 1;
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        InvertedList list = store->Get(term_id);
+        for (uint32_t chunk = 0; chunk < list.chunk_count(); ++chunk) {
+            uint32_t count = 0;
+            const uint32_t* docs = list.DecodeChunk(chunk, buffer, &count);
+            const uint16_t* tfs = list.field_tfs + static_cast<size_t>(chunk) * POSTING_BLOCK_SIZE * SCORED_FIELD_COUNT;
+            for (uint32_t i = 0; i < count; ++i) {
+                for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+                    lengths[static_cast<size_t>(docs[i]) * SCORED_FIELD_COUNT + f] += tfs[i * SCORED_FIELD_COUNT + f];
+                    totals[f] += tfs[i * SCORED_FIELD_COUNT + f];
+                }
+            }
+        }
+    }
+
+    Bm25FScorer scorer(params, doc_count, totals);
+    std::vector<float> impacts(store->posting_count());
+    std::vector<float> block_max(store->blocks.size(), 0.0f);
+    std::vector<float> term_max(term_count, 0.0f);
+    for (uint32_t term_id = 0; term_id < term_count; ++term_id) {
+        InvertedList list = store->Get(term_id);
+        size_t begin = store->offsets[term_id];
+        uint32_t first_block = store->block_offsets[term_id];
+        for (uint32_t chunk = 0; chunk < list.chunk_count(); ++chunk) {
+            uint32_t count = 0;
+            const uint32_t* docs = list.DecodeChunk(chunk, buffer, &count);
+            size_t first = static_cast<size_t>(chunk) * POSTING_BLOCK_SIZE;
+            float chunk_max = 0.0f;
+            for (uint32_t i = 0; i < count; ++i) {
+                float impact = scorer.Impact(list.field_tfs + (first + i) * SCORED_FIELD_COUNT,
+                                             lengths.data() + static_cast<size_t>(docs[i]) * SCORED_FIELD_COUNT);
+                impacts[begin + first + i] = impact;
+                chunk_max = std::max(chunk_max, impact);
+            }
+            if (chunk < list.block_count) {
+                block_max[first_block + chunk] = chunk_max;
+            }
+            term_max[term_id] = std::max(term_max[term_id], chunk_max);
+        }
+    }
+    store->impacts.Assign(std::move(impacts));
+    store->block_max.Assign(std::move(block_max));
+    store->term_max.Assign(std::move(term_max));
+}
+
+// 各字段的总词数（所有倒排节点的字段词频之和），用于计算整个视图的平均字段长度
+inline void SumFieldLengths(const PostingStore& store, uint64_t* totals) {
+    std::fill(totals, totals + SCORED_FIELD_COUNT, 0);
+    for (size_t i = 0; i < store.field_tfs.size(); ++i) {
+        totals[i % SCORED_FIELD_COUNT] += store.field_tfs[i];
+    }
+}
+
+} // namespace ns_index
@@ -0,0 +1,177 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "hnswlib/hnswlib.h"
+
+// int8 标量量化
+// 每一维单独计算偏移和步长：x[d] ≈ offset[d] + scale[d] * c[d]，c[d] 为 [-127, 127] 的 int8 编码。
+// 两个量化向量的内积可以拆成
+//   Σ offset[d]^2 + bias(x) + bias(y) + Σ scale[d]^2 * cx[d] * cy[d]，  bias(x) = Σ offset[d] * scale[d] * cx[d]
+// 第一项是常数，bias 在编码时算好和编码存在一起，只有最后一项需要逐维计算：
+// int8 乘积用 16 位整数完成，再按维度权重 scale[d]^2 累加。一个向量占 dim + 4 个字节（对齐到 4 后加一个 float），
+// 是 float 向量的约 1/4。量化后的内积只用于 HNSW 图内的导航，最终结果由调用方用原始向量精排。
+
+namespace ns_quant
+{
+    // 两个 float 向量的内积
+    inline float Dot(const float *x, const float *y, size_t dim)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < dim; ++i) {
+            sum += x[i] * y[i];
+        }
+        return sum;
+    }
+
+    // Σ weights[d] * x[d] * y[d]，x、y 为 int8 编码
+    inline float WeightedDotInt8(const int8_t *x, const int8_t *y, const float *weights, size_t dim)
+    {
+        size_t i = 0;
+        float sum = 0.0f;
+#if defined(__SSE2__)
+        const __m128i zero = _mm_setzero_si128();
+        __m128 acc0 = _mm_setzero_ps(), acc1 = _mm_setzero_ps(), acc2 = _mm_setzero_ps(), acc3 = _mm_setzero_ps();
+        for (; i + 16 <= dim; i += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(x + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(y + i));
+            // 符号扩展到 16 位后相乘，|c| <= 127，乘积不会溢出
+            __m128i sa = _mm_cmpgt_epi8(zero, a);
+            __m128i sb = _mm_cmpgt_epi8(zero, b);
+            __m128i lo = _mm_mullo_epi16(_mm_unpacklo_epi8(a, sa), _mm_unpacklo_epi8(b, sb));
+            __m128i hi = _mm_mullo_epi16(_mm_unpackhi_epi8(a, sa), _mm_unpackhi_epi8(b, sb));
+            __m128i slo = _mm_srai_epi16(lo, 15);
+            __m128i shi = _mm_srai_epi16(hi, 15);
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(lo, slo)), _mm_loadu_ps(weights + i)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(lo, slo)), _mm_loadu_ps(weights + i + 4)));
+            acc2 = _mm_add_ps(acc2, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(hi, shi)), _mm_loadu_ps(weights + i + 8)));
+            acc3 = _mm_add_ps(acc3, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(hi, shi)), _mm_loadu_ps(weights + i + 12)));
+        }
+        float lanes[4];
+        _mm_storeu_ps(lanes, _mm_add_ps(_mm_add_ps(acc0, acc1), _mm_add_ps(acc2, acc3)));
+        sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+        for (; i < dim; ++i) {
+            sum += weights[i] * static_cast<float>(static_cast<int>(x[i]) * static_cast<int>(y[i]));
+        }
+        return sum;
+    }
+
+    // 每维的偏移和步长
+    class ScalarQuantizer
+    {
+    public:
+        // 按每一维的最小、最大值训练，vectors 中的 nullptr 会被跳过
+        void Train(const std::vector<const float*> &vectors, size_t dim)
+        {
+            std::vector<float> lo(dim, 0.0f), hi(dim, 0.0f);
+            bool first = true;
+            for (const float *vec : vectors) {
+                if (vec == nullptr)
+                    continue;
+                for (size_t d = 0; d < dim; ++d) {
+                    lo[d] = first ? vec[d] : std::min(lo[d], vec[d]);
+                    hi[d] = first ? vec[d] : std::max(hi[d], vec[d]);
+                }
+                first = false;
+            }
+            std::vector<float> offsets(dim), scales(dim);
+            for (size_t d = 0; d < dim; ++d) {
+                offsets[d] = (lo[d] + hi[d]) / 2;
+                scales[d] = (hi[d] - lo[d]) / 254;
+            }
+            Init(std::move(offsets), std::move(scales));
+        }
+
+        // 从快照中恢复
+        void Init(std::vector<float> offsets, std::vector<float> scales)
+        {
+            offsets_ = std::move(offsets);
+            scales_ = std::move(scales);
+            dim_ = offsets_.size();
+        }
+
+        size_t dim() const { return dim_; }
+        const std::vector<float> &offsets() const { return offsets_; }
+        const std::vector<float> &scales() const { return scales_; }
+
+        // 编码后的字节数：int8 编码对齐到 4 字节，之后是 bias
+        size_t code_size() const { return BiasOffset() + sizeof(float); }
+
+        // 编码一个向量，超出训练范围的分量截断到 [-127, 127]
+        void Encode(const float *vec, char *out) const
+        {
+            std::memset(out, 0, code_size());
+            int8_t *codes = reinterpret_cast<int8_t*>(out);
+            float bias = 0.0f;
+            for (size_t d = 0; d < dim_; ++d) {
+                float c = scales_[d] > 0.0f ? std::round((vec[d] - offsets_[d]) / scales_[d]) : 0.0f;
+                c = std::max(-127.0f, std::min(127.0f, c));
+                codes[d] = static_cast<int8_t>(c);
+                bias += offsets_[d] * scales_[d] * c;
+            }
+            std::memcpy(out + BiasOffset(), &bias, sizeof(float));
+        }
+
+    private:
+        size_t BiasOffset() const { return (dim_ + 3) / 4 * 4; }
+
+        size_t dim_ = 0;
+        std::vector<float> offsets_;
+        std::vector<float> scales_;
+    };
+
+    // 量化内积的距离参数。第一个成员必须是维度：hnswlib 的 getDataByLabel 等函数按 size_t 读取它
+    struct Int8SpaceParams {
+        size_t dim;
+        size_t bias_offset;
+        float constant;              // Σ offset[d]^2
+        std::vector<float> weights;  // scale[d]^2
+    };
+
+    inline float Int8InnerProductDistance(const void *a, const void *b, const void *param)
+    {
+        const Int8SpaceParams *p = static_cast<const Int8SpaceParams*>(param);
+        const char *x = static_cast<const char*>(a);
+        const char *y = static_cast<const char*>(b);
+        float bx, by;
+        std::memcpy(&bx, x + p->bias_offset, sizeof(float));
+        std::memcpy(&by, y + p->bias_offset, sizeof(float));
+        float cross = WeightedDotInt8(reinterpret_cast<const int8_t*>(x), reinterpret_cast<const int8_t*>(y),
+                                      p->weights.data(), p->dim);
+        return 1.0f - (p->constant + bx + by + cross);
+    }
+
+    // 存放 ScalarQuantizer 编码的 HNSW 距离空间，与 InnerProductSpace 一样返回 1 - 内积
+    class Int8InnerProductSpace : public hnswlib::SpaceInterface<float>
+    {
+    public:
+        explicit Int8InnerProductSpace(const ScalarQuantizer &quantizer)
+        {
+            params_.dim = quantizer.dim();
+            params_.bias_offset = quantizer.code_size() - sizeof(float);
+            params_.constant = 0.0f;
+            params_.weights.resize(quantizer.dim());
+            for (size_t d = 0; d < quantizer.dim(); ++d) {
+                params_.constant += quantizer.offsets()[d] * quantizer.offsets()[d];
+                params_.weights[d] = quantizer.scales()[d] * quantizer.scales()[d];
+            }
+            data_size_ = quantizer.code_size();
+        }
+
+        size_t get_data_size() override { return data_size_; }
+        hnswlib::DISTFUNC<float> get_dist_func() override { return Int8InnerProductDistance; }
+        void *get_dist_func_param() override { return &params_; }
+
+    private:
+        Int8SpaceParams params_;
+        size_t data_size_ = 0;
+    };
+}
@@ -0,0 +1,205 @@
+#pragma once
+#include <cctype>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "lemutil.hpp"
+#include "lemsegment.hpp"
+
+// 查询语法
+//   word       可选关键词：命中越多得分越高（即原来的隐式 OR）
+//   +word      必须出现在标题、词形变化或释义中
+//   -word      不能出现在标题、词形变化或释义中
+//   "a b"      短语：各词必须按顺序相邻地出现在标题、词形变化或同一条释义中，等同于 +"a b"；-"a b" 排除含有该短语的词条
+// 操作符只在一项的开头生效（"well-known" 中的连字符不是操作符），未闭合的引号延续到查询末尾。
+// 一项分词后有多个词时（如 +苹果手机）要求这些词同时出现，但不要求相邻。
+// 可选项和必选项参与 BM25F 打分，排除项不计分；不含操作符和引号的查询与原来完全相同。
+// 条件总是用位置倒排判断（见 lempositions.hpp），与构建选项无关；构建时未保留位置的段只判断各词是否出现，短语退化为各词同时出现。
+
+namespace ns_searcher
+{
+    // 一个必须满足（或必须不满足）的条件：words 全部出现，phrase 为 true 时还要求按顺序相邻
+    struct QueryClause
+    {
+        std::vector<std::string> words;  // 精确模式分词、转小写后的词
+        bool phrase = false;
+    };
+
+    struct BooleanQuery
+    {
+        std::string scoring_text;           // 参与打分的文本（可选项和必选项）
+        std::vector<QueryClause> must;
+        std::vector<QueryClause> must_not;
+
+        // 含有条件时倒排检索只返回满足条件的文档，向量结果也按条件过滤
+        bool IsBoolean() const { return !must.empty() || !must_not.empty(); }
+    };
+
+    // 与位置倒排相同的分词方式：精确模式、去掉空白和标点、转小写
+    inline void CutClause(const std::string &text, std::vector<std::string> *words)
+    {
+        std::vector<std::string> tokens;
+        ns_util::JiebaUtil::CutPrecise(text, &tokens);
+        for (auto &token : tokens) {
+            ns_util::removeSpacesAndPunctuation(token);
+            if (token.empty())
+                continue;
+            std::transform(token.begin(), token.end(), token.begin(), [](unsigned char c) { return std::tolower(c); });
+            words->push_back(std::move(token));
+        }
+    }
+
+    inline void ParseBooleanQuery(const std::string &query, BooleanQuery *parsed)
+    {
+        auto space = [](char c) { return std::isspace(static_cast<unsigned char>(c)) != 0; };
+        std::string scoring;
+        size_t i = 0, n = query.size();
+        while (i < n) {
+            while (i < n && space(query[i]))
+                ++i;
+            if (i == n)
+                break;
+            char op = 0;
+            if ((query[i] == '+' || query[i] == '-') && i + 1 < n && !space(query[i + 1]))
+                op = query[i++];
+            bool quoted = query[i] == '"';
+            std::string text;
+            if (quoted) {
+                size_t end = query.find('"', i + 1);
+                if (end == std::string::npos)
+                    end = n;
+                text = query.substr(i + 1, end - i - 1);
+                i = std::min(end + 1, n);
+            } else {
+                size_t end = i;
+                while (end < n && !space(query[end]))
+                    ++end;
+                text = query.substr(i, end - i);
+                i = end;
+            }
+            if (op == 0 && !quoted) {
+                scoring += text;
+                scoring += ' ';
+                continue;
+            }
+            QueryClause clause;
+            CutClause(text, &clause.words);
+            clause.phrase = quoted && clause.words.size() > 1;
+            if (clause.words.empty())
+                continue;
+            if (op == '-') {
+                parsed->must_not.push_back(std::move(clause));
+            } else {
+                parsed->must.push_back(std::move(clause));
+                scoring += text;
+                scoring += ' ';
+            }
+        }
+        parsed->scoring_text = parsed->IsBoolean() ? scoring : query;
+    }
+
+    // 在一个段上判断条件：有位置倒排时查位置拉链，否则把打分用的倒排拉链解压成文档序号数组（缓存在本对象中）。
+    // 内存段使用 IndexView 中的快照，只看得到获取视图时已写入的文档
+    class ClauseMatcher
+    {
+    public:
+        explicit ClauseMatcher(const ns_index::Segment *segment) : segment_(segment) {}
+        explicit ClauseMatcher(const ns_index::MemSnapshot *mem) : mem_(mem) {}
+
+        // 满足 clause 的全部文档序号（升序，含已删除的文档）
+        void Match(const QueryClause &clause, std::vector<uint32_t> *docs)
+        {
+            docs->clear();
+            if (!Lookup(clause)) {
+                return;
+            }
+            // 从最短的拉链开始逐条求交，结果越求越短，后面的求交越来越快
+            order_.clear();
+            for (size_t w = 0; w < lists_.size(); ++w)
+                order_.push_back(w);
+            std::sort(order_.begin(), order_.end(), [this](size_t a, size_t b) { return lists_[a].size < lists_[b].size; });
+            const ns_index::PositionList &shortest = lists_[order_[0]];
+            docs->assign(shortest.docs, shortest.docs + shortest.size);
+            for (size_t i = 1; i < order_.size() && !docs->empty(); ++i) {
+                const ns_index::PositionList &list = lists_[order_[i]];
+                ns_index::IntersectSorted(docs->data(), docs->size(), list.docs, list.size, &scratch_);
+                docs->swap(scratch_);
+            }
+            if (!Phrase(clause))
+                return;
+            // 候选文档升序，各拉链上的游标只前进
+            cursors_.assign(lists_.size(), 0);
+            size_t kept = 0;
+            for (uint32_t doc : *docs) {
+                if (PhraseAt(doc))
+                    (*docs)[kept++] = doc;
+            }
+            docs->resize(kept);
+        }
+
+        // 单个文档是否满足 clause
+        bool Matches(const QueryClause &clause, uint32_t ordinal)
+        {
+            if (!Lookup(clause))
+                return false;
+            for (const auto &list : lists_) {
+                if (!std::binary_search(list.docs, list.docs + list.size, ordinal))
+                    return false;
+            }
+            if (!Phrase(clause))
+                return true;
+            cursors_.assign(lists_.size(), 0);
+            return PhraseAt(ordinal);
+        }
+
+    private:
+        // 取出 clause 中每个词的拉链，有词不存在时返回 false
+        bool Lookup(const QueryClause &clause)
+        {
+            lists_.clear();
+            for (const auto &word : clause.words) {
+                ns_index::PositionList list;
+                if (!Find(word, &list))
+                    return false;
+                lists_.push_back(list);
+            }
+            return !lists_.empty();
+        }
+
+        // 未保留位置的段返回的拉链只有文档序号（positions 为空）
+        bool Find(const std::string &word, ns_index::PositionList *list)
+        {
+            if (segment_ != nullptr)
+                return segment_->Positions().Find(word, list);
+            return mem_->GetPositions(word, list);
+        }
+
+        bool Phrase(const QueryClause &clause) const
+        {
+            return clause.phrase && lists_.size() > 1 && lists_[0].positions != nullptr;
+        }
+
+        // doc 出现在 lists_ 的每条拉链中，检查各词的位置是否依次相邻
+        bool PhraseAt(uint32_t doc)
+        {
+            spans_.clear();
+            for (size_t w = 0; w < lists_.size(); ++w) {
+                const auto &list = lists_[w];
+                const uint32_t *it = ns_index::GallopTo(list.docs + cursors_[w], list.docs + list.size, doc);
+                cursors_[w] = static_cast<uint32_t>(it - list.docs);
+                spans_.emplace_back(list.PositionsBegin(cursors_[w]), list.PositionsEnd(cursors_[w]));
+            }
+            return ns_index::MatchPhrase(&spans_);
+        }
+
+        const ns_index::Segment *segment_ = nullptr;
+        const ns_index::MemSnapshot *mem_ = nullptr;
+        std::vector<ns_index::PositionList> lists_;
+        std::vector<size_t> order_;
+        std::vector<uint32_t> scratch_;
+        std::vector<uint32_t> cursors_;
+        std::vector<std::pair<const uint32_t *, const uint32_t *>> spans_;
+    };
+}
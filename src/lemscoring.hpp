@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+// 倒排检索的打分：BM25F
+// 倒排只索引标题和词形变化两个字段，每个倒排节点记录该词在各字段中的出现次数（词频）。
+// 先把各字段的词频按字段长度归一化、按字段权重加权，合成一个伪词频
+//   tf~ = Σ_f weight_f * tf_f / (1 - b_f + b_f * len_f / avg_len_f)
+// 再套用 BM25 的饱和函数，乘以 IDF：
+//   score = idf * impact，impact = (k1 + 1) * tf~ / (k1 + tf~)，idf = ln(1 + (N - df + 0.5) / (df + 0.5))
+// 不可变段在构建时按段内的平均字段长度把 impact 预先算好存进倒排拉链（不含 IDF）；
+// N 和 df 在查询时按整个视图（所有不可变段和内存段）合计，每个查询词算一次 IDF 乘进它的权重，
+// 一个文档的得分只是命中词 impact * 权重 的累加。这样刚写入内存段的词条与其他段的词条用同一个 IDF 打分，
+// 不会因为内存段只有几个文档而得到远小于其他段的 IDF。内存段的 impact 在查询时现算，平均字段长度同样按整个视图合计。
+
+namespace ns_index {
+
+// 参与打分的字段，下标即倒排节点中词频的存放顺序
+enum ScoredField {
+    SCORED_TITLE = 0,  // 词条标题
+    SCORED_FORMS = 1,  // 词形变化
+    SCORED_FIELD_COUNT = 2,
+};
+
+// BM25F 参数，构建时写入快照，合并段时沿用
+struct Bm25Params {
+    float k1 = 1.2f;                                     // 词频饱和速度
+    float weight[SCORED_FIELD_COUNT] = {3.0f, 1.0f};     // 字段权重：标题命中比词形命中更重要
+    float b[SCORED_FIELD_COUNT] = {0.5f, 0.75f};         // 字段长度归一化强度：标题都很短，归一化弱一些
+};
+
+// 绑定了文档数和平均字段长度（一个段或整个视图）的打分器
+class Bm25FScorer {
+public:
+    // total_lengths[f] 为这些文档第 f 个字段的词数之和
+    Bm25FScorer(const Bm25Params& params, uint64_t doc_count, const uint64_t* total_lengths)
+        : params_(params), doc_count_(doc_count) {
+        for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+            double avg = doc_count == 0 ? 0.0 : static_cast<double>(total_lengths[f]) / doc_count;
+            inv_avg_length_[f] = avg > 0.0 ? static_cast<float>(1.0 / avg) : 0.0f;
+        }
+    }
+
+    // 出现在 df 个文档中的词的 IDF，恒为正
+    float Idf(uint64_t df) const {
+        double n = static_cast<double>(std::max(doc_count_, df));
+        return static_cast<float>(std::log(1.0 + (n - df + 0.5) / (df + 0.5)));
+    }
+
+    // 一个倒排节点不含 IDF 的得分：tf、lengths 均按 ScoredField 排列
+    float Impact(const uint16_t* tf, const uint32_t* lengths) const {
+        float pseudo_tf = 0.0f;
+        for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+            if (tf[f] == 0) {
+                continue;
+            }
+            float norm = 1.0f - params_.b[f] + params_.b[f] * lengths[f] * inv_avg_length_[f];
+            pseudo_tf += params_.weight[f] * tf[f] / std::max(norm, 1e-3f);
+        }
+        return (params_.k1 + 1.0f) * pseudo_tf / (params_.k1 + pseudo_tf);
+    }
+
+private:
+    Bm25Params params_;
+    uint64_t doc_count_;
+    float inv_avg_length_[SCORED_FIELD_COUNT];
+};
+
+} // namespace ns_index
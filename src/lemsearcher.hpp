@@ -4,77 +4,405 @@
 #include <jsoncpp/json/json.h>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <memory>
+#include <atomic>
+#include <shared_mutex>
+#include <mutex>
+#include <condition_variable>
+#include <utility>
+#include <thread>
+#include <cstdint>
+#include <unordered_set>
+#include <sstream>
+#include <cmath>
 #include "lemindex.hpp"
+#include "lemwand.hpp"
+#include "lemfuzzy.hpp"
+#include "lemquery.hpp"
 #include "lemutil.hpp"  // 用于分词
 
 namespace ns_searcher
 {
-    // 将word变成数组，因为搜索的关键字中可能有多个关键字对应一个文档
+    // 将命中的关键词变成数组，因为搜索的关键字中可能有多个关键字对应一个文档
     // 为了使文档只出现一次，我们将所以倒排拉链的文档都去重
-    // 相同文档的将权重加起来，把映射这个文档的关键字填写到数组里面
+    // 相同文档的将权重加起来，把映射这个文档的关键词ID填写到数组里面
 
     //该结构体是用来对重复文档去重的结点结构
     struct InvertedElemPrint
     {
-        uint64_t doc_id;  //文档ID
-        int weight;       //重复文档的权重之和
-        std::vector<std::string> words;//关键字的集合，我们之前的倒排拉链节点只能保存一个关键字
-        InvertedElemPrint():doc_id(0), weight(0){}
+        uint64_t handle;  //文档句柄：(段下标 << 32) | 段内文档序号
+        float weight;     //命中的各关键词 BM25F 得分之和
+        uint64_t term_mask;  //命中的查询词位掩码，第 i 位对应去重后的第 i 个关键词（见 TermBit）
+        InvertedElemPrint():handle(0), weight(0.0f), term_mask(0){}
+        InvertedElemPrint(uint64_t h, float w, uint64_t mask):handle(h), weight(w), term_mask(mask){}
     };
 
     //定义一个用于存储向量搜索结果的结构体
     struct VectorResult {
-        uint64_t doc_id;    //文档ID
+        uint64_t handle;    //文档句柄，段内序号即该段向量索引的 label
         float similarity;   //向量相似度得分（转换后，数值越高表示越相似）
     };
 
+    // 向量检索每次返回的结果数和搜索宽度的上限，防止单个请求占满 CPU
+    const size_t MAX_VECTOR_K = 200;
+    const size_t MAX_VECTOR_EF = 1000;
+    // 每页返回的结果数：默认值和上限，正排查找和序列化只覆盖这一页
+    const size_t DEFAULT_PAGE_SIZE = 50;
+    const size_t MAX_PAGE_SIZE = 200;
+    // 翻页的最大跳过数：倒排部分要保留前 offset + limit 名，offset 不设上限时单个请求可以要求任意大的候选集合
+    const size_t MAX_PAGE_OFFSET = 10000;
+    // 前缀补全返回的结果数：默认值和上限（上限即补全树每个节点缓存的条数）
+    const size_t DEFAULT_SUGGEST_LIMIT = 8;
+    const size_t MAX_SUGGEST_LIMIT = ns_index::SUGGEST_CACHE_SIZE;
+
+    // 单次查询的参数
+    struct SearchOptions
+    {
+        size_t k = 20;       //向量检索返回的结果数，截断到 [1, MAX_VECTOR_K]
+        size_t ef = 0;       //向量检索的搜索宽度，截断到 [k, MAX_VECTOR_EF]；0 表示按 k 和当前负载自适应
+        bool exact = false;  //向量部分使用精确检索（忽略 ef）
+        size_t offset = 0;                  //跳过融合排序后的前 offset 个结果，截断到 [0, MAX_PAGE_OFFSET]
+        size_t limit = DEFAULT_PAGE_SIZE;   //本页最多返回的结果数，截断到 [1, MAX_PAGE_SIZE]
+        bool fuzzy = false;  //词典中没有的查询词（通常是拼写错误）改为匹配编辑距离 1~2 以内的词，得分打折（见 ExpandFuzzy）
+    };
+
+    // 段下标按 视图中的不可变段在前、内存段在后 的顺序编号
+    inline uint64_t MakeHandle(size_t source, uint32_t ordinal) {
+        return (static_cast<uint64_t>(source) << 32) | ordinal;
+    }
+
+    // 查询中的一个关键词：已转为小写并去重，weight 为它在查询中出现的次数，index 为去重后的下标。
+    // 模糊匹配扩展出的词沿用原词的 index，weight 按编辑距离打折；打分前 weight 再乘以该词在整个视图中的 IDF（见 WeighTerms）
+    struct QueryTerm
+    {
+        std::string word;
+        float weight;
+        uint32_t index;
+    };
+
+    // Block-Max WAND 用 64 位掩码记录命中的关键词，关键词更多的查询改为全量检索
+    const size_t MAX_WAND_TERMS = 64;
+
+    // 模糊匹配：每个拼错的词最多扩展出的词数，以及每差一次编辑得分所乘的系数
+    const size_t MAX_FUZZY_EXPANSIONS = 3;
+    const float FUZZY_PENALTY = 0.5f;
+
+    // 关键词在命中掩码中的位，第 64 个及以后的关键词共用最高位（只影响掩码，不影响得分）
+    inline uint64_t TermBit(uint32_t index) {
+        return uint64_t(1) << std::min<uint32_t>(index, 63);
+    }
+
+    // 按词（term-at-a-time）累加一个段内各文档得分的稠密数组，下标即段内文档序号，代替以句柄为 key 的哈希表。
+    // 每个线程复用同一个实例（见 Local），数组只增不减，稳定后查询不再分配内存；
+    // touched 记录本段被写过的序号，取出结果时顺带只复位这些位置，代价与命中数而不是段的大小成正比
+    class ScoreAccumulator
+    {
+    public:
+        static ScoreAccumulator &Local() {
+            thread_local ScoreAccumulator accumulator;
+            return accumulator;
+        }
+
+        // 开始累加一个有 doc_count 个文档的段
+        void Begin(size_t doc_count) {
+            if (scores_.size() < doc_count) {
+                scores_.resize(doc_count, 0.0f);
+                masks_.resize(doc_count, 0);
+            }
+        }
+
+        void Add(uint32_t ordinal, float score, uint64_t bit) {
+            if (masks_[ordinal] == 0)
+                touched_.push_back(ordinal);
+            scores_[ordinal] += score;
+            masks_[ordinal] |= bit;
+        }
+
+        // 按首次命中的顺序交出每个命中文档 emit(ordinal, score, mask)，同时复位，之后可以开始下一个段
+        template<typename Emit>
+        void Drain(Emit emit) {
+            for (uint32_t ordinal : touched_) {
+                emit(ordinal, scores_[ordinal], masks_[ordinal]);
+                scores_[ordinal] = 0.0f;
+                masks_[ordinal] = 0;
+            }
+            touched_.clear();
+        }
+
+    private:
+        std::vector<float> scores_;
+        std::vector<uint64_t> masks_;    // 非 0 即表示该序号已在 touched_ 中
+        std::vector<uint32_t> touched_;
+    };
+
+    // 跨段收集倒排得分最高的 k 个文档（小顶堆），堆满后第 k 名的得分就是 Block-Max WAND 的剪枝门槛
+    class TopKCollector
+    {
+    public:
+        // k 由请求的翻页参数决定，不按它预先分配：堆随收下的文档增长，不超过命中的文档数
+        explicit TopKCollector(size_t k) : k_(k) {}
+
+        // 之后收下的文档序号属于第 source 个段
+        void SetSource(size_t source) { source_ = source; }
+
+        float Threshold() const { return heap_.size() < k_ ? 0.0f : heap_.front().weight; }
+
+        void Collect(uint32_t ordinal, float score, uint64_t mask) {
+            InvertedElemPrint item(MakeHandle(source_, ordinal), score, mask);
+            if (heap_.size() == k_) {
+                std::pop_heap(heap_.begin(), heap_.end(), Greater);
+                heap_.back() = item;
+            } else {
+                heap_.push_back(item);
+            }
+            std::push_heap(heap_.begin(), heap_.end(), Greater);
+        }
+
+        std::vector<InvertedElemPrint> &Items() { return heap_; }
+
+    private:
+        static bool Greater(const InvertedElemPrint &a, const InvertedElemPrint &b) { return a.weight > b.weight; }
+
+        size_t k_;
+        size_t source_ = 0;
+        std::vector<InvertedElemPrint> heap_;
+    };
+
     class Searcher
     {
     private:
-        ns_index::Index *index; //供系统进行查找的索引
+        // 发布给查询的索引指针不拥有索引，只共享一个通知用的控制块：最后一个持有者释放时删除器把 released 置位并唤醒重载线程，
+        // 索引由 owner 持有、在重载线程中释放，释放的开销不会落在最后结束的那个查询上（见 Publish、Reload）
+        struct Retirement {
+            std::mutex mtx;
+            std::condition_variable cv;
+            bool released = false;
+        };
+
+        std::shared_ptr<ns_index::Index> owner;         //当前索引的所有者，只在初始化和重载线程中访问
+        std::shared_ptr<Retirement> retirement;         //当前发布的指针全部释放时得到通知
+        std::shared_ptr<ns_index::Index> index; //供系统进行查找的索引，只通过 atomic_load/atomic_store/atomic_exchange 访问
+        std::string input_, vector_input_, snapshot_dir_; //启动时的数据路径，重载时默认沿用
+        std::atomic<bool> reloading{false};     //同一时刻只允许一个重载
+        std::shared_mutex write_mtx;            //增量写入持读锁，开始重载时持写锁（见 ApplyWrites）
+        std::thread reload_thread;
+        std::atomic<size_t> vector_searches{0}; //正在进行的向量检索数，自适应 ef 据此判断负载
     public:
         Searcher(){}
-        ~Searcher(){}
+        ~Searcher()
+        {
+            if (reload_thread.joinable())
+                reload_thread.join();
+        }
     public:
-        void InitSearcher(const std::string &input, const std::string &vector_input)
+        // snapshot_dir 非空时优先从离线构建好的索引快照加载，快照不存在或版本不符时再回退到全量构建
+        void InitSearcher(const std::string &input, const std::string &vector_input, const std::string &snapshot_dir = "")
+        {
+            input_ = input;
+            vector_input_ = vector_input;
+            snapshot_dir_ = snapshot_dir;
+            std::shared_ptr<ns_index::Index> loaded = LoadIndex(input, vector_input, snapshot_dir, ns_index::BuildOptions());
+            if (loaded == nullptr) {
+                LOG(FATAL , "构建索引失败....");
+                loaded = std::make_shared<ns_index::Index>();
+            }
+            owner = std::move(loaded);
+            retirement = std::make_shared<Retirement>();
+            std::atomic_store(&index, Publish(owner.get(), retirement));
+        }
+
+        // 为 target 创建发布给查询的指针，它的所有副本都释放后通知 notify
+        static std::shared_ptr<ns_index::Index> Publish(ns_index::Index *target, std::shared_ptr<Retirement> notify)
+        {
+            return std::shared_ptr<ns_index::Index>(target, [notify](ns_index::Index *) {
+                std::lock_guard<std::mutex> lock(notify->mtx);
+                notify->released = true;
+                notify->cv.notify_all();
+            });
+        }
+
+        // 当前对外服务的索引。调用方持有返回的指针期间，即使发生重载，该索引也不会被释放
+        std::shared_ptr<ns_index::Index> CurrentIndex() const { return std::atomic_load(&index); }
+
+        // 构建或加载一个新的索引实例，失败时返回 nullptr
+        static std::shared_ptr<ns_index::Index> LoadIndex(const std::string &input, const std::string &vector_input,
+                                                          const std::string &snapshot_dir, const ns_index::BuildOptions &options)
         {
-            // 获取或者创建index对象（单例）
-            index = ns_index::Index::GetInstance();  
-            //std::cout<< "获取index单例成功...."<<std::endl;
-            LOG(NORMAL , "获取index单例成功....");
+            auto loaded = std::make_shared<ns_index::Index>();
+            if (!snapshot_dir.empty() && loaded->LoadSnapshot(snapshot_dir)) {
+                LOG(NORMAL , "从索引快照加载正排、倒排和向量索引成功....");
+                return loaded;
+            }
             // 根据index对象建立正排和倒排索引
-            index->BuildIndex(input, vector_input);
+            if (!loaded->BuildIndex(input, vector_input, options))
+                return nullptr;
             //std::cout<< "建立正排和倒排索引成功...."<<std::endl;
             LOG(NORMAL , "建立正排、倒排和向量索引成功....");
+            return loaded;
         }
 
+        // 热重载：在后台线程构建或加载新的索引，完成后原子地替换当前索引，立即返回。
+        // 路径为空时沿用启动参数；已有重载在进行时返回 false。
+        // 新索引按源文件重建，重载进行中拒绝增量写入（见 ApplyWrites）；重载开始前写入旧索引的增量更新同样不会带到新索引中
+        bool ReloadAsync(const std::string &input = "", const std::string &vector_input = "", const std::string &snapshot_dir = "")
+        {
+            // 等正在进行的一批增量写入结束，之后的写入都会看到 reloading
+            std::unique_lock<std::shared_mutex> lock(write_mtx);
+            bool expected = false;
+            if (!reloading.compare_exchange_strong(expected, true))
+                return false;
+            if (reload_thread.joinable())
+                reload_thread.join();
+            reload_thread = std::thread([this, input, vector_input, snapshot_dir]() {
+                std::string err;
+                Reload(input.empty() ? input_ : input, vector_input.empty() ? vector_input_ : vector_input,
+                       snapshot_dir.empty() ? snapshot_dir_ : snapshot_dir, &err);
+                reloading = false;
+            });
+            return true;
+        }
 
-        // 倒排索引搜索，结果存放在 inverted_results 中
-        void InvertedSearch(const std::string &query, std::vector<ns_searcher::InvertedElemPrint> &inverted_results) {
-            std::vector<std::string> words;
-            ns_util::JiebaUtil::CutString(query, &words);
-            ns_util::removeSpacesAndPunctuationFromVector(words);
-            std::unordered_map<uint64_t, ns_searcher::InvertedElemPrint> tokens_map;
-            for (std::string word : words) {
-                if(word == "") continue;
-                std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::tolower(c); });
-                ns_index::InvertedList* inv_list = index->GetInvertedList(word);
-                if (inv_list == nullptr)
-                    continue;
-                for (const auto &elem : *inv_list) {
-                    auto &item = tokens_map[elem.doc_id]; // 自动创建或更新已有项
-                    item.doc_id = elem.doc_id;
-                    item.weight += elem.weight;
-                    item.words.push_back(elem.word);
+        bool IsReloading() const { return reloading; }
+
+        // 同步重载，返回时旧索引已经释放
+        bool Reload(const std::string &input, const std::string &vector_input, const std::string &snapshot_dir, std::string *err)
+        {
+            // 只用一半的硬件线程构建，给正在服务的查询留出 CPU
+            ns_index::BuildOptions options;
+            options.threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()) / 2);
+            options.vector_threads = options.threads;
+            std::shared_ptr<ns_index::Index> loaded = LoadIndex(input, vector_input, snapshot_dir, options);
+            if (loaded == nullptr) {
+                *err = "构建新索引失败";
+                LOG(WARNING , "索引重载失败，继续使用旧索引....");
+                return false;
+            }
+            std::shared_ptr<Retirement> old_retirement = std::exchange(retirement, std::make_shared<Retirement>());
+            std::shared_ptr<ns_index::Index> old_owner = std::exchange(owner, std::move(loaded));
+            std::shared_ptr<ns_index::Index> old = std::atomic_exchange(&index, Publish(owner.get(), retirement));
+            LOG(NORMAL , "新索引已替换旧索引....");
+            // 新的查询已经只能拿到新索引；仍持有旧索引的查询全部结束时由最后一个释放的指针唤醒本线程，
+            // 再在本线程释放旧索引，释放内存、停止合并线程的开销不会落在任何一个查询上
+            old.reset();
+            {
+                std::unique_lock<std::mutex> lock(old_retirement->mtx);
+                old_retirement->cv.wait(lock, [&old_retirement]() { return old_retirement->released; });
+            }
+            old_owner.reset();
+            LOG(NORMAL , "旧索引已释放....");
+            return true;
+        }
+
+        // 执行一批增量写入（在 writes 中调用 UpsertLexeme / DeleteLexeme）。重载进行中时不执行并返回 false：
+        // 这期间写入旧索引的更新会在替换时丢失。writes 执行期间持有读锁，重载要等这一批写完才能开始，
+        // 因此调用方应在 writes 之外完成向量化等耗时的准备工作
+        template <typename Writes>
+        bool ApplyWrites(Writes writes)
+        {
+            std::shared_lock<std::shared_mutex> lock(write_mtx);
+            if (reloading)
+                return false;
+            writes();
+            return true;
+        }
+
+        // 增量更新：转发给索引，写入内存段，不等待正在进行的查询。需要在 ApplyWrites 中调用
+        bool UpsertLexeme(const Json::Value &lex, const std::vector<float> &vec, std::string *err) {
+            return CurrentIndex()->UpsertLexeme(lex, vec, err);
+        }
+
+        bool DeleteLexeme(const std::string &lexeme_id) {
+            uint64_t doc_id = 0;
+            if (!ns_util::ParseLexemeId(lexeme_id, &doc_id))
+                return false;
+            return CurrentIndex()->DeleteLexeme(doc_id);
+        }
+
+        // 倒排索引搜索，依次检索视图中的每个段，结果追加到 inverted_results 中。
+        // top_k 为 0 时返回命中任一关键词的全部文档；大于 0 时只返回倒排得分最高的 top_k 个，
+        // 不可变段用 Block-Max WAND 动态剪枝（见 lemwand.hpp），跳过进不了前 top_k 的整块拉链。
+        // also 中的文档（通常是向量检索的结果）即使不在前 top_k 之内也会补算完整的倒排得分，融合时不会少算。
+        // 含有 +/- 或短语的查询（见 lemquery.hpp）返回满足条件的全部文档，忽略 top_k 和 also。
+        // fuzzy 为 true 时打分关键词中词典里没有的词按编辑距离扩展（+/- 和短语条件仍要求精确匹配）
+        void InvertedSearch(const ns_index::IndexView &view, const std::string &query, std::vector<ns_searcher::InvertedElemPrint> &inverted_results,
+                            size_t top_k = 0, const std::vector<uint64_t> *also = nullptr, bool fuzzy = false) {
+            BooleanQuery parsed;
+            ParseBooleanQuery(query, &parsed);
+            InvertedSearch(view, parsed, inverted_results, top_k, also, fuzzy);
+        }
+
+        // 同上，查询已由调用方用 ParseBooleanQuery 解析（SearchCombined 解析一次，向量结果过滤和倒排检索共用）
+        void InvertedSearch(const ns_index::IndexView &view, const BooleanQuery &parsed, std::vector<ns_searcher::InvertedElemPrint> &inverted_results,
+                            size_t top_k = 0, const std::vector<uint64_t> *also = nullptr, bool fuzzy = false) {
+            std::vector<QueryTerm> terms;
+            ParseQuery(parsed.scoring_text, &terms);
+            if (fuzzy)
+                ExpandFuzzy(view, &terms);
+            ns_index::Bm25FScorer scorer = ViewScorer(view);
+            WeighTerms(view, scorer, &terms);
+            if (parsed.IsBoolean()) {
+                InvertedSearchBoolean(view, scorer, parsed, terms, inverted_results);
+                return;
+            }
+            if (terms.empty())
+                return;
+            if (top_k == 0 || terms.size() > MAX_WAND_TERMS) {
+                InvertedSearchAll(view, scorer, terms, inverted_results);
+                return;
+            }
+
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            TopKCollector collector(top_k);
+            std::vector<ns_index::WandTerm> wand_terms;
+            for (size_t s = 0; s < segments.size(); ++s) {
+                const ns_index::Segment &segment = *segments[s];
+                wand_terms.clear();
+                for (const auto &term : terms) {
+                    ns_index::WandTerm wand_term;
+                    if (segment.GetInvertedList(term.word, &wand_term.list)) {
+                        wand_term.weight = term.weight;
+                        wand_term.query_term = term.index;  // 不超过 MAX_WAND_TERMS 个关键词，下标即掩码中的位
+                        wand_terms.push_back(wand_term);
+                    }
                 }
+                collector.SetSource(s);
+                ns_index::BlockMaxWand(wand_terms, [&segment](uint32_t ordinal) { return segment.IsDeleted(ordinal); }, &collector);
             }
-            // 合并后将结果存入 inverted_results
-            for (const auto &kv : tokens_map) {
-                inverted_results.push_back(kv.second);
+            // 内存段很小，得分现算，逐个文档交给同一个收集器
+            ScoreAccumulator &accumulator = ScoreAccumulator::Local();
+            for (size_t m = 0; m < mem_segments.size(); ++m) {
+                ScoreMemSegment(mem_segments[m], scorer, terms, &accumulator);
+                collector.SetSource(segments.size() + m);
+                accumulator.Drain([&collector](uint32_t ordinal, float score, uint64_t mask) {
+                    if (score > collector.Threshold())
+                        collector.Collect(ordinal, score, mask);
+                });
             }
+
+            std::vector<InvertedElemPrint> &top = collector.Items();
+            if (also != nullptr) {
+                std::unordered_set<uint64_t> seen;
+                for (const auto &item : top)
+                    seen.insert(item.handle);
+                for (uint64_t handle : *also) {
+                    if (!seen.insert(handle).second)
+                        continue;
+                    InvertedElemPrint item;
+                    item.handle = handle;
+                    ScoreHandle(view, scorer, terms, &item);
+                    if (item.weight > 0.0f)
+                        top.push_back(item);
+                }
+            }
+            inverted_results.insert(inverted_results.end(), top.begin(), top.end());
         }
-        //  向量索引搜索，结果放在 vector_results 中
-        void VectorSearch(const std::vector<float>& query_vector, std::vector<VectorResult> &vector_results) {
+        //  向量索引搜索：每个段各取 k 个近邻，再合并出全局的前 k 个，结果放在 vector_results 中（已删除的文档由向量引擎过滤）
+        //  options.exact 为 true 时每个段都暴力扫描全部向量，得到精确的前 k 个（用于验证近似索引的召回率），
+        //  此时每个段的扫描按行块在全部硬件线程间并行
+        void VectorSearch(const ns_index::IndexView &view, const std::vector<float>& query_vector, std::vector<VectorResult> &vector_results,
+                          const SearchOptions &options = SearchOptions()) {
             //std::vector<float> query_vec = ns_util::ComputeVector(query, 384);
             std::vector<float> query_vec = query_vector;
             if (query_vec.empty()) {
@@ -82,17 +410,485 @@ namespace ns_searcher
                 return;
             }
 
-            int k = 20;
-            auto result = index->GetVectorIndex()->searchKnn(query_vec.data(), k);
-            while (!result.empty()) {
-                auto pair = result.top();
-                result.pop();
-                VectorResult vecRes;
-                vecRes.doc_id = pair.second;
-                // 如果 InnerProductSpace 返回的是内积值（相似度），则直接使用即可
-                vecRes.similarity = 1 - pair.first;  // 这里 1 - pair.first 就是相似度得分
-                vector_results.push_back(vecRes);
+            // 在途计数在返回时减一，自适应 ef 用它衡量当前的并发压力
+            vector_searches.fetch_add(1);
+            struct Leave {
+                std::atomic<size_t> &count;
+                ~Leave() { count.fetch_sub(1); }
+            } leave{vector_searches};
+            size_t k = std::min(std::max<size_t>(options.k, 1), MAX_VECTOR_K);
+            // 搜索宽度作为参数逐层传给各段（HNSW 的 ef、量化索引的精排候选数），不修改索引的共享状态，
+            // 不同 ef 的查询可以并发执行
+            size_t candidates = options.ef > 0 ? std::min(std::max(options.ef, k), MAX_VECTOR_EF) : AdaptiveEf(k);
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            std::vector<VectorResult> merged;
+            std::vector<ns_index::VectorHit> hits;
+            int threads = static_cast<int>(std::thread::hardware_concurrency());
+            for (size_t s = 0; s < segments.size() + mem_segments.size(); ++s) {
+                hits.clear();
+                if (s < segments.size() && options.exact)
+                    segments[s]->SearchVectorsExact(query_vec.data(), k, threads, &hits);
+                else if (s < segments.size())
+                    segments[s]->SearchVectors(query_vec.data(), k, candidates, &hits);
+                else if (options.exact)
+                    mem_segments[s - segments.size()].SearchVectorsExact(query_vec.data(), k, threads, &hits);
+                else
+                    mem_segments[s - segments.size()].SearchVectors(query_vec.data(), k, candidates, &hits);
+                for (const auto &hit : hits) {
+                    VectorResult vecRes;
+                    vecRes.handle = MakeHandle(s, hit.ordinal);
+                    vecRes.similarity = hit.similarity;
+                    merged.push_back(vecRes);
+                }
             }
+            size_t top = std::min(k, merged.size());
+            std::partial_sort(merged.begin(), merged.begin() + top, merged.end(),
+                              [](const VectorResult &a, const VectorResult &b) { return a.similarity > b.similarity; });
+            merged.resize(top);
+            vector_results.insert(vector_results.end(), merged.begin(), merged.end());
+        }
+
+        // 自适应搜索宽度：默认为 k 的 4 倍，在途的向量检索多于硬件线程数时按比例收窄，最低为 k
+        size_t AdaptiveEf(size_t k) const {
+            size_t ef = k * 4;
+            size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+            size_t busy = vector_searches.load();
+            if (busy > cores)
+                ef = std::max(k, ef * cores / busy);
+            return std::min(ef, MAX_VECTOR_EF);
+        }
+
+        // 分词、转小写、去掉空白和标点后合并重复的关键词
+        static void ParseQuery(const std::string &query, std::vector<QueryTerm> *terms) {
+            std::vector<std::string> words;
+            ns_util::JiebaUtil::CutString(query, &words);
+            ns_util::removeSpacesAndPunctuationFromVector(words);
+            for (auto &word : words) {
+                if (word == "")
+                    continue;
+                std::transform(word.begin(), word.end(), word.begin(), [](unsigned char c) { return std::tolower(c); });
+                auto it = std::find_if(terms->begin(), terms->end(), [&word](const QueryTerm &term) { return term.word == word; });
+                if (it != terms->end()) {
+                    it->weight += 1.0f;
+                } else {
+                    terms->push_back({word, 1.0f, static_cast<uint32_t>(terms->size())});
+                }
+            }
+        }
+
+        // 模糊匹配：对所有段的词典里都没有的查询词，在各段词典上找出编辑距离（含相邻交换）不超过 FuzzyMaxDistance 的词
+        // （见 lemfuzzy.hpp），按 距离、文档频率 排序取前 MAX_FUZZY_EXPANSIONS 个加入查询，
+        // 得分乘以 FUZZY_PENALTY 的距离次方，命中掩码沿用原词的位。词典里有的词不扩展，拼写正确的查询结果不变
+        static void ExpandFuzzy(const ns_index::IndexView &view, std::vector<QueryTerm> *terms) {
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            struct Candidate {
+                std::string word;
+                uint32_t distance;
+                size_t df;  // 各段文档频率之和
+            };
+            std::vector<Candidate> candidates;
+            size_t original = terms->size();
+            for (size_t t = 0; t < original; ++t) {
+                const QueryTerm term = (*terms)[t];
+                uint32_t max_distance = ns_index::FuzzyMaxDistance(term.word);
+                if (max_distance == 0)
+                    continue;
+                bool known = false;
+                uint32_t term_id = 0;
+                for (size_t s = 0; s < segments.size() && !known; ++s)
+                    known = segments[s]->Dictionary().Find(term.word, &term_id);
+                ns_index::MemPostings postings;
+                for (size_t m = 0; m < mem_segments.size() && !known; ++m)
+                    known = mem_segments[m].GetPostings(term.word, &postings);
+                if (known)
+                    continue;
+
+                candidates.clear();
+                auto add = [&candidates](std::string_view word, uint32_t distance, size_t df) {
+                    auto it = std::find_if(candidates.begin(), candidates.end(), [word](const Candidate &c) { return c.word == word; });
+                    if (it == candidates.end())
+                        candidates.push_back({std::string(word), distance, df});
+                    else
+                        it->df += df;
+                };
+                for (const auto &segment : segments) {
+                    const ns_index::TermDictionary &dictionary = segment->Dictionary();
+                    ns_index::FuzzyScan(dictionary, term.word, max_distance, [&](uint32_t id, uint32_t distance) {
+                        add(dictionary.Term(id), distance, segment->Postings().Get(id).size);
+                    });
+                }
+                // 内存段的关键词没有排序，逐个计算（内存段很小，BoundedEditDistance 先按长度差过滤）
+                std::vector<uint32_t> word_chars, chars;
+                ns_index::DecodeFuzzyChars(term.word, &word_chars);
+                for (const auto &mem : mem_segments) {
+                    mem.ForEachTerm([&](const std::string &word, size_t df) {
+                        ns_index::DecodeFuzzyChars(word, &chars);
+                        uint32_t distance = ns_index::BoundedEditDistance(chars, word_chars, max_distance);
+                        if (distance <= max_distance)
+                            add(word, distance, df);
+                    });
+                }
+                std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+                    if (a.distance != b.distance)
+                        return a.distance < b.distance;
+                    if (a.df != b.df)
+                        return a.df > b.df;
+                    return a.word < b.word;
+                });
+                size_t added = 0;
+                for (const auto &candidate : candidates) {
+                    if (added == MAX_FUZZY_EXPANSIONS)
+                        break;
+                    // 已经在查询中的词（原词或其他拼错的词扩展出的）不重复计分
+                    if (std::any_of(terms->begin(), terms->end(), [&candidate](const QueryTerm &q) { return q.word == candidate.word; }))
+                        continue;
+                    terms->push_back({candidate.word, term.weight * std::pow(FUZZY_PENALTY, static_cast<float>(candidate.distance)), term.index});
+                    ++added;
+                }
+            }
+        }
+
+        // 整个视图的 BM25F 打分器：文档数和各字段总词数按视图中的所有段（含内存段）合计。
+        // 两者都包含已删除的文档，与按拉链长度合计的文档频率口径一致
+        static ns_index::Bm25FScorer ViewScorer(const ns_index::IndexView &view) {
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            ns_index::Bm25Params params;
+            uint64_t doc_count = 0;
+            uint64_t totals[ns_index::SCORED_FIELD_COUNT] = {};
+            auto add = [&](const ns_index::Bm25Params &bm25, size_t docs, const uint64_t *lengths) {
+                params = bm25;  // 各段沿用同一份构建参数
+                doc_count += docs;
+                for (int f = 0; f < ns_index::SCORED_FIELD_COUNT; ++f)
+                    totals[f] += lengths[f];
+            };
+            for (const auto &segment : segments)
+                add(segment->Bm25(), segment->DocCount(), segment->TotalLengths());
+            for (const auto &mem : mem_segments)
+                add(mem.Bm25(), mem.DocCount(), mem.TotalLengths());
+            return ns_index::Bm25FScorer(params, doc_count, totals);
+        }
+
+        // 把每个关键词在整个视图中的 IDF 乘进它的权重，文档频率为各段拉链长度之和。
+        // 拉链中的得分不含 IDF，不论文档在哪个段（包括只有几个文档的内存段），同一个词都按同一个 IDF 打分
+        static void WeighTerms(const ns_index::IndexView &view, const ns_index::Bm25FScorer &scorer, std::vector<QueryTerm> *terms) {
+            for (auto &term : *terms) {
+                uint64_t df = 0;
+                uint32_t term_id = 0;
+                for (const auto &segment : view.set->segments) {
+                    if (segment->Dictionary().Find(term.word, &term_id))
+                        df += segment->Postings().Get(term_id).size;
+                }
+                ns_index::MemPostings postings;
+                for (const auto &mem : view.mem_segments) {
+                    if (mem.GetPostings(term.word, &postings))
+                        df += postings.size();
+                }
+                if (df > 0)
+                    term.weight *= scorer.Idf(df);
+            }
+        }
+
+        // 全量检索：逐段、逐词（term-at-a-time）把得分累加到线程局部的稠密数组中，每个段结束时取出全部命中文档。
+        // terms 的权重应已乘上 IDF（见 WeighTerms），scorer 为 ViewScorer 的结果
+        static void InvertedSearchAll(const ns_index::IndexView &view, const ns_index::Bm25FScorer &scorer,
+                                      const std::vector<QueryTerm> &terms, std::vector<InvertedElemPrint> &inverted_results) {
+            ScoreAccumulator &accumulator = ScoreAccumulator::Local();
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            for (size_t s = 0; s < segments.size(); ++s) {
+                const ns_index::Segment &segment = *segments[s];
+                AccumulateSegment(segment, terms, &accumulator);
+                // 已删除或已被新版本取代的文档在取出时才过滤，每个文档只查一次删除标记
+                accumulator.Drain([&](uint32_t ordinal, float score, uint64_t mask) {
+                    if (!segment.IsDeleted(ordinal))
+                        inverted_results.emplace_back(MakeHandle(s, ordinal), score, mask);
+                });
+            }
+            // 内存段中的倒排节点，得分按整个视图当前的统计量现算
+            for (size_t m = 0; m < mem_segments.size(); ++m) {
+                ScoreMemSegment(mem_segments[m], scorer, terms, &accumulator);
+                accumulator.Drain([&](uint32_t ordinal, float score, uint64_t mask) {
+                    inverted_results.emplace_back(MakeHandle(segments.size() + m, ordinal), score, mask);
+                });
+            }
+        }
+
+        // 布尔查询：逐段求出满足条件的文档，只为它们打分，返回全部结果（不剪枝）。
+        // 有必选条件时先在各条件的拉链上倍增求交，候选文档通常很少，打分时各关键词的拉链按候选文档跳着前进，
+        // 条件越严格越快；只有排除条件时与全量检索相同，取出结果时去掉被排除的文档。
+        // 满足条件但不含任何打分关键词的文档（如只在释义中出现）倒排得分为 0，仍然返回
+        static void InvertedSearchBoolean(const ns_index::IndexView &view, const ns_index::Bm25FScorer &scorer, const BooleanQuery &parsed,
+                                          const std::vector<QueryTerm> &terms, std::vector<InvertedElemPrint> &inverted_results) {
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            ScoreAccumulator &accumulator = ScoreAccumulator::Local();
+            std::vector<uint32_t> candidates, excluded;
+            std::vector<float> scores;
+            std::vector<uint64_t> masks;
+            for (size_t s = 0; s < segments.size() + mem_segments.size(); ++s) {
+                const ns_index::Segment *segment = s < segments.size() ? segments[s].get() : nullptr;
+                const ns_index::MemSnapshot *mem = segment == nullptr ? &mem_segments[s - segments.size()] : nullptr;
+                ClauseMatcher matcher = segment != nullptr ? ClauseMatcher(segment) : ClauseMatcher(mem);
+                auto deleted = [segment, mem](uint32_t ordinal) {
+                    return segment != nullptr ? segment->IsDeleted(ordinal) : mem->IsDeleted(ordinal);
+                };
+                MatchClauses(&matcher, parsed, &candidates, &excluded);
+                if (parsed.must.empty()) {
+                    if (segment != nullptr)
+                        AccumulateSegment(*segment, terms, &accumulator);
+                    else
+                        ScoreMemSegment(*mem, scorer, terms, &accumulator);
+                    accumulator.Drain([&](uint32_t ordinal, float score, uint64_t mask) {
+                        if (!deleted(ordinal) && !std::binary_search(excluded.begin(), excluded.end(), ordinal))
+                            inverted_results.emplace_back(MakeHandle(s, ordinal), score, mask);
+                    });
+                    continue;
+                }
+                candidates.erase(std::remove_if(candidates.begin(), candidates.end(), deleted), candidates.end());
+                scores.assign(candidates.size(), 0.0f);
+                masks.assign(candidates.size(), 0);
+                if (segment != nullptr)
+                    ScoreCandidates(*segment, terms, candidates, scores.data(), masks.data());
+                else
+                    ScoreCandidates(*mem, scorer, terms, candidates, scores.data(), masks.data());
+                for (size_t i = 0; i < candidates.size(); ++i)
+                    inverted_results.emplace_back(MakeHandle(s, candidates[i]), scores[i], masks[i]);
+            }
+        }
+
+        // 在一个段上求值布尔条件：candidates 为满足全部必选条件且不被排除的文档（没有必选条件时为空），
+        // excluded 为满足任一排除条件的文档，均升序
+        static void MatchClauses(ClauseMatcher *matcher, const BooleanQuery &parsed,
+                                 std::vector<uint32_t> *candidates, std::vector<uint32_t> *excluded) {
+            std::vector<uint32_t> docs, merged;
+            excluded->clear();
+            for (const auto &clause : parsed.must_not) {
+                matcher->Match(clause, &docs);
+                excluded->insert(excluded->end(), docs.begin(), docs.end());
+            }
+            std::sort(excluded->begin(), excluded->end());
+            excluded->erase(std::unique(excluded->begin(), excluded->end()), excluded->end());
+
+            candidates->clear();
+            for (size_t i = 0; i < parsed.must.size(); ++i) {
+                matcher->Match(parsed.must[i], i == 0 ? candidates : &docs);
+                if (i > 0) {
+                    ns_index::IntersectSorted(candidates->data(), candidates->size(), docs.data(), docs.size(), &merged);
+                    candidates->swap(merged);
+                }
+                if (candidates->empty())
+                    return;
+            }
+            const uint32_t *cursor = excluded->data();
+            const uint32_t *last = excluded->data() + excluded->size();
+            candidates->erase(std::remove_if(candidates->begin(), candidates->end(), [&](uint32_t ordinal) {
+                return ns_index::ContainsSorted(&cursor, last, ordinal);
+            }), candidates->end());
+        }
+
+        // 为升序的候选文档计算倒排得分：每条拉链按候选文档 SkipTo，跳表整块跳过不含候选的部分
+        static void ScoreCandidates(const ns_index::Segment &segment, const std::vector<QueryTerm> &terms,
+                                    const std::vector<uint32_t> &candidates, float *scores, uint64_t *masks) {
+            for (const auto &term : terms) {
+                ns_index::InvertedList list;
+                if (!segment.GetInvertedList(term.word, &list))
+                    continue;
+                uint64_t bit = TermBit(term.index);
+                ns_index::PostingCursor cursor(list);
+                for (size_t i = 0; i < candidates.size(); ++i) {
+                    cursor.SkipTo(candidates[i]);
+                    if (!cursor.valid())
+                        break;
+                    if (cursor.doc() == candidates[i]) {
+                        scores[i] += cursor.impact() * term.weight;
+                        masks[i] |= bit;
+                    }
+                }
+            }
+        }
+
+        // 内存段的拉链是按序号升序的数组，在上面倍增查找候选文档，得分现算
+        static void ScoreCandidates(const ns_index::MemSnapshot &mem, const ns_index::Bm25FScorer &scorer, const std::vector<QueryTerm> &terms,
+                                    const std::vector<uint32_t> &candidates, float *scores, uint64_t *masks) {
+            for (const auto &term : terms) {
+                ns_index::MemPostings list;
+                if (!mem.GetPostings(term.word, &list))
+                    continue;
+                uint64_t bit = TermBit(term.index);
+                auto it = list.begin();
+                for (size_t i = 0; i < candidates.size(); ++i) {
+                    it = std::lower_bound(it, list.end(), candidates[i],
+                                          [](const ns_index::DeltaPosting &p, uint32_t target) { return p.ordinal < target; });
+                    if (it == list.end())
+                        break;
+                    if (it->ordinal == candidates[i]) {
+                        scores[i] += scorer.Impact(it->tf, mem.FieldLengths(candidates[i])) * term.weight;
+                        masks[i] |= bit;
+                    }
+                }
+            }
+        }
+
+        // 布尔查询的向量结果同样要满足条件：必选条件都成立、排除条件都不成立
+        static void FilterVectorResults(const ns_index::IndexView &view, const BooleanQuery &parsed,
+                                        std::vector<VectorResult> *results) {
+            const auto &segments = view.set->segments;
+            std::unordered_map<size_t, ClauseMatcher> matchers;  // 按段复用，段没有位置倒排时解压出的拉链也一并复用
+            size_t kept = 0;
+            for (const auto &result : *results) {
+                size_t source = static_cast<size_t>(result.handle >> 32);
+                uint32_t ordinal = static_cast<uint32_t>(result.handle);
+                auto it = matchers.find(source);
+                if (it == matchers.end()) {
+                    it = matchers.emplace(source, source < segments.size()
+                                                      ? ClauseMatcher(segments[source].get())
+                                                      : ClauseMatcher(&view.mem_segments[source - segments.size()])).first;
+                }
+                ClauseMatcher &matcher = it->second;
+                bool ok = std::all_of(parsed.must.begin(), parsed.must.end(),
+                                      [&](const QueryClause &clause) { return matcher.Matches(clause, ordinal); }) &&
+                          std::none_of(parsed.must_not.begin(), parsed.must_not.end(),
+                                       [&](const QueryClause &clause) { return matcher.Matches(clause, ordinal); });
+                if (ok)
+                    (*results)[kept++] = result;
+            }
+            results->resize(kept);
+        }
+
+        // 把不可变段上各关键词的得分逐词累加到 accumulator 中，拉链逐块解压后顺序扫描，得分数组与之一一对应；
+        // 得分在构建时已经算好，这里只做乘加。不过滤已删除的文档，由调用方在取出时过滤
+        static void AccumulateSegment(const ns_index::Segment &segment, const std::vector<QueryTerm> &terms,
+                                      ScoreAccumulator *accumulator) {
+            accumulator->Begin(segment.DocCount());
+            for (const auto &term : terms) {
+                ns_index::InvertedList inv_list;
+                if (!segment.GetInvertedList(term.word, &inv_list))
+                    continue;
+                uint64_t bit = TermBit(term.index);
+                uint32_t buffer[ns_index::POSTING_BLOCK_SIZE];
+                for (uint32_t chunk = 0; chunk < inv_list.chunk_count(); ++chunk) {
+                    uint32_t count = 0;
+                    const uint32_t *docs = inv_list.DecodeChunk(chunk, buffer, &count);
+                    const float *impacts = inv_list.impacts + chunk * ns_index::POSTING_BLOCK_SIZE;
+                    for (uint32_t i = 0; i < count; ++i)
+                        accumulator->Add(docs[i], impacts[i] * term.weight, bit);
+                }
+            }
+        }
+
+        // 把内存段中每个命中文档的得分和命中关键词累加到 accumulator 中，调用方负责取出
+        static void ScoreMemSegment(const ns_index::MemSnapshot &mem, const ns_index::Bm25FScorer &scorer, const std::vector<QueryTerm> &terms,
+                                    ScoreAccumulator *accumulator) {
+            accumulator->Begin(mem.DocCount());
+            for (const auto &term : terms) {
+                ns_index::MemPostings list;
+                if (!mem.GetPostings(term.word, &list))
+                    continue;
+                uint64_t bit = TermBit(term.index);
+                for (const auto &posting : list) {
+                    if (mem.IsDeleted(posting.ordinal))
+                        continue;
+                    accumulator->Add(posting.ordinal, scorer.Impact(posting.tf, mem.FieldLengths(posting.ordinal)) * term.weight, bit);
+                }
+            }
+        }
+
+        // 单独计算一个文档的倒排得分：不可变段在每条拉链上跳到该文档（跳表整块跳过），内存段在升序拉链上二分
+        static void ScoreHandle(const ns_index::IndexView &view, const ns_index::Bm25FScorer &scorer, const std::vector<QueryTerm> &terms,
+                                InvertedElemPrint *item) {
+            size_t source = static_cast<size_t>(item->handle >> 32);
+            uint32_t ordinal = static_cast<uint32_t>(item->handle);
+            const auto &segments = view.set->segments;
+            for (const auto &term : terms) {
+                float impact = 0.0f;
+                if (source < segments.size()) {
+                    ns_index::InvertedList list;
+                    if (!segments[source]->GetInvertedList(term.word, &list))
+                        continue;
+                    ns_index::PostingCursor cursor(list);
+                    cursor.SkipTo(ordinal);
+                    if (!cursor.valid() || cursor.doc() != ordinal)
+                        continue;
+                    impact = cursor.impact();
+                } else {
+                    const ns_index::MemSnapshot &mem = view.mem_segments[source - segments.size()];
+                    ns_index::MemPostings list;
+                    if (!mem.GetPostings(term.word, &list))
+                        continue;
+                    auto it = std::lower_bound(list.begin(), list.end(), ordinal,
+                                               [](const ns_index::DeltaPosting &p, uint32_t target) { return p.ordinal < target; });
+                    if (it == list.end() || it->ordinal != ordinal)
+                        continue;
+                    impact = scorer.Impact(it->tf, mem.FieldLengths(ordinal));
+                }
+                item->weight += impact * term.weight;
+                item->term_mask |= TermBit(term.index);
+            }
+        }
+
+        // 前缀补全：每个段取出以 prefix 开头、排名最前的 limit 个不同补全项，合并后再取前 limit 个。
+        // 只查各段的补全树，不分词、不打分、不做向量检索。结果为 [{"text", "title", "url"}]，text 为补全项（小写）
+        void Suggest(const std::string &prefix, size_t limit, std::string *json_string) {
+            std::shared_ptr<ns_index::Index> current = CurrentIndex();
+            ns_index::IndexView view = current->Acquire();
+            std::string key = ns_index::NormalizeSuggestKey(prefix);
+            limit = std::min(std::max<size_t>(limit, 1), MAX_SUGGEST_LIMIT);
+            std::vector<ns_index::SuggestHit> hits;
+            std::vector<uint64_t> handles;  // 与 hits 一一对应
+            const auto &segments = view.set->segments;
+            const auto &mem_segments = view.mem_segments;
+            for (size_t s = 0; !key.empty() && s < segments.size() + mem_segments.size(); ++s) {
+                size_t before = hits.size();
+                if (s < segments.size())
+                    segments[s]->Suggest(key, limit, &hits);
+                else
+                    mem_segments[s - segments.size()].Suggest(key, limit, &hits);
+                for (size_t i = before; i < hits.size(); ++i) {
+                    handles.push_back(MakeHandle(s, hits[i].ordinal));
+                    hits[i].ordinal = static_cast<uint32_t>(i);  // 之后用作 handles 的下标
+                }
+            }
+            ns_index::TakeDistinct(&hits, limit);
+
+            Json::Value root(Json::arrayValue);
+            for (const auto &hit : hits) {
+                ns_index::DocView doc;
+                GetDoc(view, handles[hit.ordinal], &doc);
+                Json::Value elem;
+                elem["text"] = ToJson(hit.text);
+                elem["title"] = ToJson(doc.title);
+                elem["url"] = ToJson(doc.url);
+                root.append(elem);
+            }
+            // 补全请求很频繁，每个线程复用同一个紧凑格式的 writer，不必每次重新解析 writer 的配置
+            thread_local std::unique_ptr<Json::StreamWriter> writer = [] {
+                Json::StreamWriterBuilder builder;
+                builder["indentation"] = "";
+                return std::unique_ptr<Json::StreamWriter>(builder.newStreamWriter());
+            }();
+            std::ostringstream out;
+            writer->write(root, &out);
+            *json_string = out.str();
+        }
+
+        // 根据文档句柄取出正排中的文档
+        static void GetDoc(const ns_index::IndexView &view, uint64_t handle, ns_index::DocView *doc) {
+            size_t source = static_cast<size_t>(handle >> 32);
+            uint32_t ordinal = static_cast<uint32_t>(handle);
+            const auto &segments = view.set->segments;
+            if (source < segments.size()) {
+                segments[source]->GetDoc(ordinal, doc);
+            } else {
+                view.mem_segments[source - segments.size()].GetDoc(ordinal, doc);
+            }
+        }
+
+        // 正排字段是指向列存储的 string_view，直接按区间构造 JSON 字符串，不经过中间的 std::string
+        static Json::Value ToJson(std::string_view text) {
+            return Json::Value(text.data(), text.data() + text.size());
         }
 
         // 向量标准化函数
@@ -107,83 +903,98 @@ namespace ns_searcher
             }
         }
 
-        // 融合策略实现：（取并集）
-        void SearchCombined(const std::string &query, const std::vector<float>& query_vector,std::string *json_string) {
-            // 1. 分别获得倒排搜索结果和向量搜索结果
-            std::vector<ns_searcher::InvertedElemPrint> inverted_results;
-            InvertedSearch(query, inverted_results);
-            
+        // 融合策略实现：（取并集）。options 控制向量检索的结果数、搜索宽度、是否精确检索以及返回哪一页；
+        // total_hits 非空时写入参与融合的候选数（倒排部分经过剪枝，是命中总数的下界），大于 offset + limit 说明还有下一页
+        void SearchCombined(const std::string &query, const std::vector<float>& query_vector,std::string *json_string,
+                            const SearchOptions &options = SearchOptions(), size_t *total_hits = nullptr) {
+            // 整个查询期间持有同一个索引实例和同一个段集合的视图，
+            // 热重载替换索引、后台合并替换段集合都不影响本次查询
+            std::shared_ptr<ns_index::Index> current = CurrentIndex();
+            ns_index::IndexView view = current->Acquire();
+
+            // 1. 分别获得向量搜索结果和倒排搜索结果。
+            //    倒排部分只取得分最高的 offset + limit 个（Block-Max WAND 剪枝），并为向量结果补算倒排得分：
+            //    不在这两部分中的文档，综合得分不可能高于倒排前 offset + limit 名中的任何一个，不会出现在请求的页中
+            //    查询只解析一次，向量结果的 +/- 过滤和倒排检索共用
+            BooleanQuery parsed;
+            ParseBooleanQuery(query, &parsed);
             std::vector<VectorResult> vector_results;
-            VectorSearch(query_vector, vector_results);
+            VectorSearch(view, query_vector, vector_results, options);
+            // 含有 +/- 或短语时，向量结果也必须满足这些条件
+            if (parsed.IsBoolean())
+                FilterVectorResults(view, parsed, &vector_results);
+
+            std::vector<uint64_t> vector_handles;
+            vector_handles.reserve(vector_results.size());
+            for (const auto &item : vector_results)
+                vector_handles.push_back(item.handle);
+            size_t limit = std::min(std::max<size_t>(options.limit, 1), MAX_PAGE_SIZE);
+            size_t offset = std::min(options.offset, MAX_PAGE_OFFSET);
+            // 多取一个，候选数大于 offset + limit 即说明还有下一页
+            size_t top_k = offset + limit + 1;
+            std::vector<ns_searcher::InvertedElemPrint> inverted_results;
+            InvertedSearch(view, parsed, inverted_results, top_k, &vector_handles, options.fuzzy);
             
-            // 2. 分别构建 doc_id -> 得分 映射（未归一化的得分）
-            std::unordered_map<uint64_t, float> inverted_score_map;
-            for (const auto &item : inverted_results) {
-                inverted_score_map[item.doc_id] = static_cast<float>(item.weight);
-            }
-            std::unordered_map<uint64_t, float> vector_score_map;
-            for (const auto &item : vector_results) {
-                vector_score_map[item.doc_id] = item.similarity;
-            }
-            // 3. 对倒排索引得分进行归一化：将所有倒排得分除以最大得分，使其归一化到 [0, 1]
+            // 2. 倒排得分按最大得分归一化到 [0, 1]
             float max_inv = 0.0f;
-            for (const auto &kv : inverted_score_map) {
-                if (kv.second > max_inv)
-                    max_inv = kv.second;
-            }
-            if (max_inv > 0.0f) {
-                for (auto &kv : inverted_score_map) {
-                    kv.second /= max_inv;
-                }
+            for (const auto &item : inverted_results) {
+                max_inv = std::max(max_inv, item.weight);
             }
-            // 3. 取并集：将两侧所有的 doc_id 加入集合
-            std::unordered_set<uint64_t> all_ids;
-            for (const auto &kv : inverted_score_map) {
-                all_ids.insert(kv.first);
+
+            // 3. 取并集并计算综合得分：文档句柄 -> 得分，不存在于某一侧的候选该侧得分为 0
+            float alpha = 0.5f;  // 倒排得分权重
+            float beta  = 0.5f;  // 向量得分权重
+            std::unordered_map<uint64_t, float> score_map;
+            score_map.reserve(inverted_results.size() + vector_results.size());
+            for (const auto &item : inverted_results) {
+                score_map[item.handle] += max_inv > 0.0f ? alpha * item.weight / max_inv : 0.0f;
             }
-            for (const auto &kv : vector_score_map) {
-                all_ids.insert(kv.first);
+            for (const auto &item : vector_results) {
+                score_map[item.handle] += beta * item.similarity;
             }
-            
-            // 4. 计算综合得分：对于不存在于某一侧的候选，得分默认为 0
+
             struct CombinedResult {
-                uint64_t doc_id;
+                uint64_t handle;
                 float combined_score;
             };
             std::vector<CombinedResult> combined_results;
-            float alpha = 0.5f;  // 倒排得分权重
-            float beta  = 0.5f;  // 向量得分权重
-            for (auto doc_id : all_ids) {
-                float inv_score = 0.0f;
-                if (inverted_score_map.find(doc_id) != inverted_score_map.end()) {
-                    inv_score = inverted_score_map[doc_id];
-                }
-                float vec_score = 0.0f;
-                if (vector_score_map.find(doc_id) != vector_score_map.end()) {
-                    vec_score = vector_score_map[doc_id];
-                }
-                float combined = alpha * inv_score + beta * vec_score;
-                combined_results.push_back({doc_id, combined});
+            combined_results.reserve(score_map.size());
+            for (const auto &kv : score_map) {
+                combined_results.push_back({kv.first, kv.second});
             }
-            
-            // 5. 对融合结果按综合得分降序排序
-            std::sort(combined_results.begin(), combined_results.end(),
-                    [](const CombinedResult &a, const CombinedResult &b) {
-                        return a.combined_score > b.combined_score;
-                    });
-            
-            // 6. 从正排索引中获取文档信息，并构建 JSON 结果
-            Json::Value root;
-            for (const auto &item : combined_results) {
-                ns_index::DocInfo* doc = index->GetForwardIndex(item.doc_id);
-                if (doc == nullptr)
-                    continue;
+
+            // 4. 只挑出请求的那一页 [begin, end)：先用 nth_element 把前 end 个分出来，
+            //    再在其中分出前 begin 个，最后只排序这一页，代价是 O(n + limit·log limit) 而不是整体排序。
+            //    得分相同时按句柄排序，保证翻页时同一结果不会在两页间重复或遗漏
+            auto better = [](const CombinedResult &a, const CombinedResult &b) {
+                if (a.combined_score != b.combined_score)
+                    return a.combined_score > b.combined_score;
+                return a.handle < b.handle;
+            };
+            size_t total = combined_results.size();
+            size_t begin = std::min(offset, total);
+            size_t end = begin + std::min(limit, total - begin);
+            auto first = combined_results.begin();
+            if (end < total)
+                std::nth_element(first, first + end, combined_results.end(), better);
+            if (begin > 0 && begin < end)
+                std::nth_element(first, first + begin, first + end, better);
+            std::sort(first + begin, first + end, better);
+            if (total_hits != nullptr)
+                *total_hits = total;
+
+            // 5. 只为这一页从正排索引中获取文档信息（直接引用列存储中的文本），并构建 JSON 结果
+            Json::Value root(Json::arrayValue);
+            for (size_t i = begin; i < end; ++i) {
+                const CombinedResult &item = combined_results[i];
+                ns_index::DocView doc;
+                GetDoc(view, item.handle, &doc);
                 Json::Value elem;
-                elem["title"] = doc->title;
-                elem["language"] = doc->language;
-                elem["forms"] = doc->forms;
-                elem["senses"] = doc->senses;
-                elem["url"] = doc->url;
+                elem["title"] = ToJson(doc.title);
+                elem["language"] = ToJson(doc.language);
+                elem["forms"] = ToJson(doc.forms);
+                elem["senses"] = ToJson(doc.senses);
+                elem["url"] = ToJson(doc.url);
                 elem["score"] = item.combined_score;
                 root.append(elem);
             }
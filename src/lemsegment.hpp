@@ -0,0 +1,1100 @@
+#pragma once
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <algorithm>
+#include <queue>
+#include <map>
+
+#include "lemutil.hpp"
+#include "lemsnapshot.hpp"
+#include "lemvecfile.hpp"
+#include "lempostings.hpp"
+#include "lempositions.hpp"
+#include "lemappend.hpp"
+#include "lemsuggest.hpp"
+#include "lemforward.hpp"
+#include "lemquantize.hpp"
+#include "lemvecengine.hpp"
+#include "lemivfpq.hpp"
+#include "lemflat.hpp"
+
+// 引入 HNSWlib 头文件（假定路径正确）
+#include "hnswlib/hnswlib.h"
+#include "hnswlib/space_ip.h"
+
+// 索引段
+// 整个索引由若干个不可变的 Segment 和少量可写的 MemSegment 组成：
+//   Segment 拥有自己的列式正排、词典、块压缩倒排拉链、（可选的）位置倒排、前缀补全树和向量索引（VectorEngine，见 lemvecengine.hpp），构建完成后除删除标记外不再改动，
+//     可以从快照 mmap 加载；文档序号只在段内有效。
+//   MemSegment 接收增量写入的新词条，写满后冻结，由后台线程封存为 Segment。
+// 同一个词条（doc_id）在所有段中至多有一份未删除的副本：更新时先给旧副本打删除标记再写入新副本。
+
+namespace ns_index {
+
+// 一个不可变的索引段
+class Segment {
+public:
+    Segment(uint64_t id, int dim) : id_(id), dim_(dim) {}
+
+    // ---- 构建 ----
+    // docs 按 doc_id 升序排列后下标即为文档序号（doc_id 重复时保留最后一个），写入列式正排；
+    // raw 压实为词典 + PostingStore，并按段内统计量预先计算每个倒排节点的 BM25F 得分；
+    // positions 压实为判断 +/- 条件的位置倒排，with_positions 为 false 时只保留文档区间、本段不支持短语匹配。
+    // 三者处理完即被释放。最后由正排建立前缀补全树
+    void Finalize(std::vector<DocInfo>* docs, RawPostings* raw, RawPositions* positions, bool with_positions,
+                  const Bm25Params& bm25);
+
+    // 从向量数据文件加载向量，为每个文档序号记录其向量所在位置（vector_sources）
+    // 自动识别格式：二进制向量文件走 mmap，向量直接指向映射内存；否则按旧的文本格式逐行解析到构建期矩阵
+    bool LoadVectors(const std::string& vectorFile);
+
+    // 直接指定每个文档序号的向量（合并、封存时指向源段的数据），缺失为 nullptr
+    void SetVectorSources(std::vector<const float*> sources) { vector_sources_ = std::move(sources); }
+
+    // 按 options.vector_engine 构建向量索引，完成后释放构建期的向量来源，此后向量只存在于向量引擎内部
+    bool BuildVectorIndex(const BuildOptions& options);
+
+    // 保存为快照目录：index.snap（正排、倒排、向量引擎的数组）+ HNSW 引擎的 vector.hnsw
+    bool Save(const std::string& dir) const;
+
+    // 从快照目录加载
+    bool Load(const std::string& dir);
+
+    // ---- 查询（均可并发调用） ----
+    uint64_t id() const { return id_; }
+    int dim() const { return dim_; }
+    size_t DocCount() const { return doc_ids_.size(); }
+    size_t LiveCount() const { return DocCount() - deleted_.load(std::memory_order_relaxed); }
+    size_t DeletedCount() const { return deleted_.load(std::memory_order_relaxed); }
+
+    uint64_t GetDocId(uint32_t ordinal) const { return doc_ids_[ordinal]; }
+    bool FindOrdinal(uint64_t doc_id, uint32_t* ordinal) const;
+    void GetDoc(uint32_t ordinal, DocView* doc) const { forward_.Get(ordinal, doc_ids_[ordinal], doc); }
+
+    bool GetInvertedList(const std::string& word, InvertedList* list) const;
+    const TermDictionary& Dictionary() const { return dictionary_; }
+    const PostingStore& Postings() const { return postings_; }
+    const ForwardStore& Forward() const { return forward_; }
+    const Bm25Params& Bm25() const { return bm25_; }
+    // 各字段的总词数（含已删除的文档），与 DocCount() 一起合计出整个视图的平均字段长度
+    const uint64_t* TotalLengths() const { return total_lengths_; }
+    bool HasPositions() const { return positions_.HasPositions(); }
+    const PositionStore& Positions() const { return positions_; }
+    const SuggestIndex& Suggestions() const { return suggest_; }
+
+    // 以 prefix（已规范化，见 NormalizeSuggestKey）开头、排名最前的至多 limit 个不同补全项，跳过已删除的文档，追加到 hits
+    void Suggest(std::string_view prefix, size_t limit, std::vector<SuggestHit>* hits) const;
+
+    // 向量检索，结果追加到 hits（已删除的文档由向量引擎过滤）。
+    // candidates 为搜索宽度（HNSW 的 ef、量化引擎的精排候选数，见 VectorEngine::Search）
+    void SearchVectors(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const {
+        if (vector_engine_) {
+            vector_engine_->Search(query, k, candidates, hits);
+        }
+    }
+
+    // 精确检索：精确引擎直接检索，其他引擎逐个读取原始向量暴力扫描，行块在 threads 个线程间并行；
+    // 不保存原始向量的引擎（未开启精排的 IVF-PQ）扫描由编码还原的近似向量
+    void SearchVectorsExact(const float* query, size_t k, int threads, std::vector<VectorHit>* hits) const;
+
+    // 获取文档的原始向量（dim 个 float），文档没有向量、已删除或引擎不保存原始向量时返回 nullptr
+    const float* GetVector(uint32_t ordinal) const {
+        return vector_engine_ ? vector_engine_->GetVector(ordinal) : nullptr;
+    }
+
+    // 向量引擎是否保存了原始向量
+    bool StoresVectors() const { return vector_engine_ == nullptr || vector_engine_->StoresVectors(); }
+
+    // 不保存原始向量时取由编码还原的近似向量写入 out（dim 个 float），没有向量或已删除时返回 false
+    bool DecodeVector(uint32_t ordinal, float* out) const {
+        return vector_engine_ != nullptr && vector_engine_->DecodeVector(ordinal, out);
+    }
+
+    // 快照中记录的向量格式（ns_snapshot::VectorFormat）
+    uint32_t VectorFormat() const { return vector_engine_ ? vector_engine_->Format() : ns_snapshot::VECTOR_FLOAT; }
+
+    // int8 HNSW 段的量化参数，其他段返回 nullptr
+    std::shared_ptr<const ns_quant::ScalarQuantizer> Quantizer() const {
+        return vector_engine_ ? vector_engine_->Quantizer() : nullptr;
+    }
+
+    bool IsDeleted(uint32_t ordinal) const {
+        return tombstones_ && tombstones_[ordinal].load(std::memory_order_relaxed) != 0;
+    }
+
+    // 打上删除标记并从 HNSW 中 markDelete，文档原本未删除时返回 true
+    bool MarkDeleted(uint32_t ordinal);
+
+private:
+    // 通过 mmap 读取二进制向量文件（见 lemvecfile.hpp）
+    bool LoadVectorsBinary(const std::string& vectorFile);
+
+    // 释放构建期的向量矩阵和向量文件映射
+    void ReleaseVectorSources();
+
+    void ResetTombstones();
+
+    // 由正排建立前缀补全树
+    void BuildSuggest();
+
+    uint64_t id_;
+    int dim_;
+    ForwardStore forward_;                                       // 列式正排索引（以文档序号为下标）
+    ns_util::MappedArray<uint64_t> doc_ids_;                     // 文档序号 -> 文档ID（升序）
+    TermDictionary dictionary_;                                  // 有序词典（下标即 term_id）
+    PostingStore postings_;                                      // 倒排拉链（以 term_id 为下标）
+    Bm25Params bm25_;                                            // 计算 postings_ 中得分所用的参数
+    uint64_t total_lengths_[SCORED_FIELD_COUNT] = {};            // 各字段的总词数，由 field_tfs 累加
+    PositionStore positions_;                                    // 位置倒排（构建时关闭位置则只有文档区间）
+    SuggestIndex suggest_;                                       // 前缀补全树
+    std::unique_ptr<ns_snapshot::SnapshotReader> snapshot_;      // 加载快照时保持映射，数组直接指向其中
+    std::unique_ptr<VectorEngine> vector_engine_;                // 向量索引（数组可能指向 snapshot_ 的映射内存）
+    std::unique_ptr<std::atomic<uint8_t>[]> tombstones_;         // 文档序号 -> 是否已删除
+    std::atomic<size_t> deleted_{0};
+
+    std::vector<float> vectors_;                                 // 构建期向量矩阵（仅文本格式），每行 dim 个
+    std::unique_ptr<ns_vecfile::VecFileReader> vector_file_;     // 构建期映射的二进制向量文件
+    std::vector<const float*> vector_sources_;                   // 构建期：文档序号 -> 向量，缺失为 nullptr
+};
+
+// 可写的内存段：容量固定，写入由调用方串行化（Index 的写锁），查询不加锁。
+// 正排、字段长度和向量是按容量预先分配的数组，关键词到拉链、位置拉链、补全项的映射都只追加（见 lemappend.hpp）；
+// 一个词条的全部内容写完后才发布新的文档数，查询通过 MemSnapshot 只读取获取视图时已发布的文档，写入与查询互不等待
+class MemSegment {
+public:
+    // quantizer 非空时 HNSW 中存放它的 int8 编码（通常沿用最近构建的不可变段的量化参数）
+    // positions 为 true 时位置倒排同时记录词的位置，否则只记录文档序号，封存后的段与之相同
+    MemSegment(uint64_t id, int dim, size_t capacity, const Bm25Params& bm25, bool positions,
+               std::shared_ptr<const ns_quant::ScalarQuantizer> quantizer = nullptr);
+
+    uint64_t id() const { return id_; }
+    size_t capacity() const { return capacity_; }
+    bool full() const { return next_ordinal_ >= capacity_; }
+
+    // 追加一个词条，tokens 为该词条的分词结果，positions 为它的词位置（本段不记录位置时只取其中的词），
+    // vec 为空时只参与倒排检索。只能由写线程调用
+    bool Add(DocInfo&& doc, const RawPostings& tokens, const DocPositions& positions, const std::vector<float>& vec,
+             std::string* err);
+
+    // 查找 doc_id 最新写入的副本，只能由写线程调用
+    bool FindOrdinal(uint64_t doc_id, uint32_t* ordinal) const;
+
+    bool IsDeleted(uint32_t ordinal) const { return tombstones_[ordinal].load(std::memory_order_relaxed) != 0; }
+    bool MarkDeleted(uint32_t ordinal);
+
+    // 已发布（对查询可见）的文档数
+    uint32_t DocCount() const { return doc_count_.load(std::memory_order_acquire); }
+    const DocInfo& Doc(uint32_t ordinal) const { return docs_[ordinal]; }
+
+    // 把当前内容封存为不可变的 Segment（在后台线程调用，段应当已冻结）。
+    // included 返回被收入新段的 (文档序号)，用于发布前补上封存期间新增的删除标记
+    std::shared_ptr<Segment> Seal(uint64_t segment_id, const BuildOptions& options,
+                                  std::vector<uint32_t>* included) const;
+
+private:
+    friend class MemSnapshot;
+
+    using PostingList = AppendVector<DeltaPosting>;
+    using SuggestDocs = AppendVector<std::pair<uint32_t, uint32_t>>;  // (文档序号, 权重)
+
+    uint64_t id_;
+    int dim_;
+    size_t capacity_;
+    std::vector<DocInfo> docs_;                                              // capacity 个，按文档序号写入
+    std::unordered_map<uint64_t, uint32_t> ordinals_;                        // doc_id -> 最新的文档序号，只由写线程访问
+    AppendTermMap<PostingList> postings_;                                    // 关键词 -> 倒排节点
+    bool has_positions_;
+    AppendTermMap<MemPositionList> positions_;                               // 关键词 -> 位置拉链
+    AppendTermMap<SuggestDocs> suggest_keys_;                                // 补全项 -> 文档
+    Bm25Params bm25_;
+    std::vector<uint32_t> field_lengths_;                                    // capacity * SCORED_FIELD_COUNT，各文档的字段词数
+    std::vector<uint64_t> total_lengths_;                                    // (capacity + 1) * SCORED_FIELD_COUNT，前 n 个文档的字段词数之和
+    std::vector<float> vectors_;                                             // capacity * dim，封存时作为向量来源
+    std::vector<uint8_t> has_vector_;
+    std::unique_ptr<std::atomic<uint8_t>[]> tombstones_;
+    uint32_t next_ordinal_ = 0;                                              // 只由写线程访问
+    std::atomic<uint32_t> doc_count_{0};                                     // 已发布的文档数
+    std::shared_ptr<const ns_quant::ScalarQuantizer> quantizer_;
+    std::vector<char> code_;                                                 // 量化编码缓冲区，只由写线程使用
+    std::unique_ptr<hnswlib::SpaceInterface<float>> space_;
+    std::unique_ptr<hnswlib::HierarchicalNSW<float>> vector_index_;
+};
+
+// 内存段的一条倒排拉链（按文档序号升序），只含快照可见的文档
+struct MemPostings {
+    const DeltaPosting* first = nullptr;
+    const DeltaPosting* last = nullptr;
+
+    const DeltaPosting* begin() const { return first; }
+    const DeltaPosting* end() const { return last; }
+    size_t size() const { return static_cast<size_t>(last - first); }
+};
+
+// 内存段在获取视图时的只读快照：只看得到序号小于 DocCount() 的文档，之后写入的词条即使已经追加到拉链中也被忽略，
+// 同一个查询中各处看到的文档数、字段总长和拉链始终一致。快照不持有段，段由 IndexView 中的段集合保持存活
+class MemSnapshot {
+public:
+    MemSnapshot(const MemSegment* segment, uint32_t doc_count) : segment_(segment), doc_count_(doc_count) {}
+
+    size_t DocCount() const { return doc_count_; }
+    bool IsDeleted(uint32_t ordinal) const { return segment_->IsDeleted(ordinal); }
+    void GetDoc(uint32_t ordinal, DocView* doc) const;
+    bool GetPostings(std::string_view word, MemPostings* list) const;
+    // 逐个产出关键词及其倒排长度 emit(word, df)，顺序不定（模糊匹配用）
+    template <typename Emit>
+    void ForEachTerm(Emit emit) const {
+        segment_->postings_.ForEach([this, &emit](const auto& entry) {
+            size_t df = Visible(entry.value).size();
+            if (df > 0) {
+                emit(entry.key, df);
+            }
+        });
+    }
+    bool HasPositions() const { return segment_->has_positions_; }
+    bool GetPositions(std::string_view word, PositionList* list) const;
+
+    // 同 Segment::Suggest。内存段很小，逐个检查补全项，取以 prefix 开头的现排
+    void Suggest(std::string_view prefix, size_t limit, std::vector<SuggestHit>* hits) const;
+
+    // 内存段的内容随写入变化，BM25F 得分在查询时按整个视图的文档数和平均字段长度现算（见 lemscoring.hpp）
+    const Bm25Params& Bm25() const { return segment_->bm25_; }
+    const uint64_t* TotalLengths() const { return segment_->total_lengths_.data() + static_cast<size_t>(doc_count_) * SCORED_FIELD_COUNT; }
+    const uint32_t* FieldLengths(uint32_t ordinal) const {
+        return segment_->field_lengths_.data() + static_cast<size_t>(ordinal) * SCORED_FIELD_COUNT;
+    }
+
+    // 向量检索，忽略快照之后写入的文档，其余同 Segment::SearchVectors
+    void SearchVectors(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const;
+
+    // 精确检索，直接扫描段内的向量矩阵
+    void SearchVectorsExact(const float* query, size_t k, int threads, std::vector<VectorHit>* hits) const;
+
+private:
+    // 拉链中快照可见的部分：先取长度再取数据，去掉序号不小于 doc_count_ 的节点
+    MemPostings Visible(const MemSegment::PostingList& list) const {
+        size_t size = list.size();
+        MemPostings postings;
+        postings.first = list.data();
+        postings.last = std::lower_bound(postings.first, postings.first + size, doc_count_,
+                                         [](const DeltaPosting& p, uint32_t target) { return p.ordinal < target; });
+        return postings;
+    }
+
+    const MemSegment* segment_;
+    uint32_t doc_count_;
+};
+
+// 某一时刻的全部段，发布后不再修改，查询通过 shared_ptr 持有它直到结束
+struct SegmentSet {
+    std::vector<std::shared_ptr<Segment>> segments;        // 不可变段
+    std::vector<std::shared_ptr<MemSegment>> mem_segments; // 等待封存的冻结段 + 最后一个为当前写入段
+};
+
+// 把若干段中未删除的文档合并为一个新段（不改动源段），included 按源段返回被收入新段的文档序号
+std::shared_ptr<Segment> MergeSegments(const std::vector<std::shared_ptr<Segment>>& sources,
+                                       uint64_t segment_id, int dim, const BuildOptions& options,
+                                       std::vector<std::vector<uint32_t>>* included);
+
+// ---------------------------------------------------------------------------
+// Segment
+
+void Segment::Finalize(std::vector<DocInfo>* docs, RawPostings* raw, RawPositions* positions, bool with_positions,
+                       const Bm25Params& bm25) {
+    std::vector<DocInfo>& raw_docs = *docs;
+    // 同一 doc_id 出现多次时保留输入中最后一个（seq 最大）的词条，它们的倒排节点会合并到同一个序号上。
+    // 并行解析时 docs 的顺序取决于线程调度，按 (doc_id, seq) 排序保证与单线程构建的结果相同
+    std::sort(raw_docs.begin(), raw_docs.end(), [](const DocInfo& a, const DocInfo& b) {
+        return a.doc_id != b.doc_id ? a.doc_id < b.doc_id : a.seq < b.seq;
+    });
+
+    // 逐个写入各列，写完一个就释放它的字符串，峰值内存不会叠加两份正排索引
+    StringColumnBuilder builders[FIELD_COUNT];
+    std::vector<uint64_t> ids;
+    ids.reserve(raw_docs.size());
+    std::unordered_map<uint64_t, uint32_t> ordinals;  // 只在压实拉链时使用，用完即释放
+    ordinals.reserve(raw_docs.size());
+    for (size_t i = 0; i < raw_docs.size(); ++i) {
+        DocInfo doc = std::move(raw_docs[i]);
+        if (i + 1 < raw_docs.size() && raw_docs[i + 1].doc_id == doc.doc_id) {
+            continue;
+        }
+        ordinals[doc.doc_id] = static_cast<uint32_t>(ids.size());
+        ids.push_back(doc.doc_id);
+        builders[FIELD_TITLE].Add(doc.title);
+        builders[FIELD_LANGUAGE].Add(doc.language);
+        builders[FIELD_FORMS].Add(doc.forms);
+        builders[FIELD_SENSES].Add(doc.senses);
+        builders[FIELD_URL].Add(doc.url);
+    }
+    raw_docs = std::vector<DocInfo>();
+    for (int field = 0; field < FIELD_COUNT; ++field) {
+        builders[field].Finish(&forward_.columns[field]);
+    }
+    doc_ids_.Assign(std::move(ids));
+    BuildPostingStore(raw, ordinals, &dictionary_, &postings_);
+    *raw = RawPostings();
+    BuildPositionStore(positions, ordinals, with_positions, &positions_);
+    bm25_ = bm25;
+    ScorePostings(bm25_, DocCount(), &postings_);
+    SumFieldLengths(postings_, total_lengths_);
+    BuildSuggest();
+    ResetTombstones();
+}
+
+void Segment::BuildSuggest() {
+    SuggestBuilder builder;
+    for (uint32_t ordinal = 0; ordinal < DocCount(); ++ordinal) {
+        builder.Add(ordinal, forward_.Field(ordinal, FIELD_TITLE), forward_.Field(ordinal, FIELD_FORMS),
+                    forward_.Field(ordinal, FIELD_SENSES));
+    }
+    builder.Finish(&suggest_);
+}
+
+void Segment::Suggest(std::string_view prefix, size_t limit, std::vector<SuggestHit>* hits) const {
+    std::vector<uint32_t> entries;
+    suggest_.Complete(prefix, limit, [this](uint32_t ordinal) { return !IsDeleted(ordinal); }, &entries);
+    for (uint32_t e : entries) {
+        const SuggestEntry& entry = suggest_.Entry(e);
+        hits->push_back({suggest_.Key(e), entry.doc, entry.weight});
+    }
+}
+
+void Segment::ResetTombstones() {
+    tombstones_.reset(new std::atomic<uint8_t>[DocCount()]);
+    for (size_t i = 0; i < DocCount(); ++i) {
+        tombstones_[i].store(0, std::memory_order_relaxed);
+    }
+    deleted_ = 0;
+}
+
+bool Segment::FindOrdinal(uint64_t doc_id, uint32_t* ordinal) const {
+    auto it = std::lower_bound(doc_ids_.begin(), doc_ids_.end(), doc_id);
+    if (it == doc_ids_.end() || *it != doc_id) {
+        return false;
+    }
+    *ordinal = static_cast<uint32_t>(it - doc_ids_.begin());
+    return true;
+}
+
+bool Segment::GetInvertedList(const std::string& word, InvertedList* list) const {
+    uint32_t term_id = 0;
+    if (!dictionary_.Find(word, &term_id))
+        return false;
+    *list = postings_.Get(term_id);
+    return true;
+}
+
+void Segment::SearchVectorsExact(const float* query, size_t k, int threads, std::vector<VectorHit>* hits) const {
+    if (vector_engine_ == nullptr) {
+        return;
+    }
+    if (vector_engine_->Exact()) {
+        vector_engine_->Search(query, k, k, hits);
+        return;
+    }
+    std::vector<std::vector<VectorHit>> results;
+    if (vector_engine_->StoresVectors()) {
+        ns_flat::SearchRows(query, 1, DocCount(), dim_, k, threads, [this](size_t ordinal) {
+            return GetVector(static_cast<uint32_t>(ordinal));
+        }, &results);
+        hits->insert(hits->end(), results[0].begin(), results[0].end());
+        return;
+    }
+    // 没有原始向量：每次还原一块文档的近似向量再扫描，各块的前 k 个合并后取前 k 个
+    const size_t chunk = 4096;
+    std::vector<float> rows(chunk * dim_);
+    std::vector<uint8_t> decoded(chunk);
+    std::vector<VectorHit> found;
+    for (size_t begin = 0; begin < DocCount(); begin += chunk) {
+        size_t count = std::min(chunk, DocCount() - begin);
+        for (size_t i = 0; i < count; ++i) {
+            decoded[i] = DecodeVector(static_cast<uint32_t>(begin + i), rows.data() + i * dim_) ? 1 : 0;
+        }
+        ns_flat::SearchRows(query, 1, count, dim_, k, threads, [&](size_t i) -> const float* {
+            return decoded[i] ? rows.data() + i * dim_ : nullptr;
+        }, &results);
+        for (VectorHit hit : results[0]) {
+            hit.ordinal += static_cast<uint32_t>(begin);
+            found.push_back(hit);
+        }
+    }
+    size_t top = std::min(k, found.size());
+    std::partial_sort(found.begin(), found.begin() + top, found.end(),
+                      [](const VectorHit& a, const VectorHit& b) { return a.similarity > b.similarity; });
+    hits->insert(hits->end(), found.begin(), found.begin() + top);
+}
+
+bool Segment::MarkDeleted(uint32_t ordinal) {
+    if (tombstones_[ordinal].exchange(1) != 0) {
+        return false;
+    }
+    ++deleted_;
+    if (vector_engine_) {
+        vector_engine_->MarkDeleted(ordinal);
+    }
+    return true;
+}
+
+bool Segment::LoadVectors(const std::string& vectorFile) {
+    if (ns_vecfile::IsVecFile(vectorFile)) {
+        return LoadVectorsBinary(vectorFile);
+    }
+    std::ifstream in(vectorFile);
+    if (!in.is_open()) {
+        std::cerr << "无法打开向量文件: " << vectorFile << std::endl;
+        return false;
+    }
+    vectors_.assign(DocCount() * dim_, 0.0f);
+    vector_sources_.assign(DocCount(), nullptr);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        std::istringstream iss(line);
+        std::string idStr, lemma, vecStr;
+        if (!std::getline(iss, idStr, '\t'))
+            continue;
+        if (!std::getline(iss, lemma, '\t'))
+            continue;
+        if (!std::getline(iss, vecStr))
+            continue;
+        uint64_t id = 0;
+        if (!ns_util::ParseLexemeId(idStr, &id)) {
+            std::cerr << "转换 docID 失败: " << idStr << std::endl;
+            continue;
+        }
+        std::istringstream vecStream(vecStr);
+        std::vector<float> vec;
+        float val;
+        while (vecStream >> val) {
+            vec.push_back(val);
+        }
+        uint32_t ordinal = 0;
+        if (!FindOrdinal(id, &ordinal)) {
+            std::cerr << "正排索引中未找到 docID: " << id << std::endl;
+            continue;
+        }
+        if (vec.size() != static_cast<size_t>(dim_)) {
+            std::cerr << "文档 " << id << " 向量维度不匹配。" << std::endl;
+            continue;
+        }
+        float* row = vectors_.data() + static_cast<size_t>(ordinal) * dim_;
+        std::copy(vec.begin(), vec.end(), row);
+        vector_sources_[ordinal] = row;
+    }
+    in.close();
+    std::cout << "加载向量文件成功: " << vectorFile << std::endl;
+    return true;
+}
+
+bool Segment::LoadVectorsBinary(const std::string& vectorFile) {
+    // 映射保持到向量索引构建完成，插入 HNSW 时直接读取映射内存，不再先拷贝一份
+    vector_file_.reset(new ns_vecfile::VecFileReader());
+    ns_vecfile::VecFileReader& reader = *vector_file_;
+    if (!reader.Open(vectorFile)) {
+        vector_file_.reset();
+        return false;
+    }
+    if (reader.dim() != static_cast<size_t>(dim_)) {
+        std::cout << "向量文件维度为 " << reader.dim() << "，索引维度随之调整。" << std::endl;
+        dim_ = static_cast<int>(reader.dim());
+    }
+    vector_sources_.assign(DocCount(), nullptr);
+    size_t missing = 0;
+    for (size_t i = 0; i < reader.count(); ++i) {
+        uint32_t ordinal = 0;
+        if (!FindOrdinal(reader.id(i), &ordinal)) {
+            ++missing;
+            continue;
+        }
+        vector_sources_[ordinal] = reader.vector(i);
+    }
+    if (missing > 0) {
+        std::cerr << "有 " << missing << " 个向量在正排索引中未找到对应词条。" << std::endl;
+    }
+    std::cout << "加载二进制向量文件成功: " << vectorFile << "，共 " << reader.count() << " 个向量。" << std::endl;
+    return true;
+}
+
+void Segment::ReleaseVectorSources() {
+    vectors_ = std::vector<float>();
+    vector_file_.reset();
+    vector_sources_ = std::vector<const float*>();
+}
+
+bool Segment::BuildVectorIndex(const BuildOptions& options) {
+    size_t missing = 0;
+    for (size_t ordinal = 0; ordinal < DocCount(); ++ordinal) {
+        if (ordinal >= vector_sources_.size() || vector_sources_[ordinal] == nullptr) {
+            ++missing;
+        }
+    }
+    if (missing > 0 && options.progress_interval > 0) {
+        std::cerr << "有 " << missing << " 个词条没有向量，不会出现在向量检索结果中。" << std::endl;
+    }
+    bool ok = false;
+    if (options.vector_engine == VECTOR_ENGINE_FLAT) {
+        std::unique_ptr<FlatEngine> engine(new FlatEngine(dim_));
+        ok = engine->Build(vector_sources_, DocCount(), options);
+        vector_engine_ = std::move(engine);
+    } else if (options.vector_engine == VECTOR_ENGINE_IVFPQ) {
+        std::unique_ptr<IvfPqEngine> engine(new IvfPqEngine(dim_));
+        ok = engine->Build(vector_sources_, DocCount(), options);
+        vector_engine_ = std::move(engine);
+    } else {
+        std::unique_ptr<HnswEngine> engine(new HnswEngine(dim_));
+        ok = engine->Build(vector_sources_, DocCount(), options);
+        vector_engine_ = std::move(engine);
+    }
+    // 向量已经拷贝进向量引擎，构建期的来源不再需要，之后统一通过 GetVector 读取
+    ReleaseVectorSources();
+    return ok;
+}
+
+bool Segment::Save(const std::string& dir) const {
+    if (DocCount() == 0 || vector_engine_ == nullptr) {
+        std::cerr << "索引段为空，无法保存快照。" << std::endl;
+        return false;
+    }
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    if (ec) {
+        std::cerr << "无法创建快照目录: " << dir << ", 错误: " << ec.message() << std::endl;
+        return false;
+    }
+    // 向量引擎的其他文件（vector.hnsw）先于 index.snap 写出，index.snap 最后原子落盘，它的存在即表示快照完整
+    ns_snapshot::SnapshotWriter writer;
+    if (!writer.Open(dir + "/index.snap")) {
+        std::cerr << "无法创建快照文件: " << dir << "/index.snap" << std::endl;
+        return false;
+    }
+    writer.BeginSection(ns_snapshot::SECTION_META);
+    writer.Put<uint64_t>(DocCount());
+    writer.Put<uint64_t>(dictionary_.size());
+    writer.Put<uint32_t>(dim_);
+    writer.Put<uint32_t>(vector_engine_->Format());
+    writer.EndSection();
+    writer.BeginSection(ns_snapshot::SECTION_BM25);
+    writer.Put<float>(bm25_.k1);
+    for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+        writer.Put<float>(bm25_.weight[f]);
+        writer.Put<float>(bm25_.b[f]);
+    }
+    writer.EndSection();
+    if (!vector_engine_->Save(dir, &writer)) {
+        return false;
+    }
+
+    // 正排各列、词典和倒排拉链本身就是连续数组，原样写出，加载时直接映射
+    for (uint32_t field = 0; field < FIELD_COUNT; ++field) {
+        const StringColumn& column = forward_.columns[field];
+        writer.PutArray(ns_snapshot::SECTION_FIELD_BYTES + field, column.bytes.data(), column.bytes.size());
+        writer.PutArray(ns_snapshot::SECTION_FIELD_OFFSETS + field, column.offsets.data(), column.offsets.size());
+    }
+    writer.PutArray(ns_snapshot::SECTION_DOC_IDS, doc_ids_.data(), doc_ids_.size());
+    writer.PutArray(ns_snapshot::SECTION_TERM_BYTES, dictionary_.bytes.data(), dictionary_.bytes.size());
+    writer.PutArray(ns_snapshot::SECTION_TERM_OFFSETS, dictionary_.offsets.data(), dictionary_.offsets.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_OFFSETS, postings_.offsets.data(), postings_.offsets.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_BLOCK_OFFSETS, postings_.block_offsets.data(), postings_.block_offsets.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_BLOCKS, postings_.blocks.data(), postings_.blocks.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_PACKED, postings_.packed.data(), postings_.packed.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_TAIL, postings_.tail_docs.data(), postings_.tail_docs.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_IMPACTS, postings_.impacts.data(), postings_.impacts.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_FIELD_TFS, postings_.field_tfs.data(), postings_.field_tfs.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_BLOCK_MAX, postings_.block_max.data(), postings_.block_max.size());
+    writer.PutArray(ns_snapshot::SECTION_POSTING_TERM_MAX, postings_.term_max.data(), postings_.term_max.size());
+    writer.PutArray(ns_snapshot::SECTION_POSITION_TERM_BYTES, positions_.dictionary.bytes.data(), positions_.dictionary.bytes.size());
+    writer.PutArray(ns_snapshot::SECTION_POSITION_TERM_OFFSETS, positions_.dictionary.offsets.data(), positions_.dictionary.offsets.size());
+    writer.PutArray(ns_snapshot::SECTION_POSITION_OFFSETS, positions_.offsets.data(), positions_.offsets.size());
+    writer.PutArray(ns_snapshot::SECTION_POSITION_DOCS, positions_.docs.data(), positions_.docs.size());
+    if (HasPositions()) {
+        writer.PutArray(ns_snapshot::SECTION_POSITION_POS_OFFSETS, positions_.pos_offsets.data(), positions_.pos_offsets.size());
+        writer.PutArray(ns_snapshot::SECTION_POSITION_DATA, positions_.positions.data(), positions_.positions.size());
+    }
+    writer.PutArray(ns_snapshot::SECTION_SUGGEST_KEY_BYTES, suggest_.keys.bytes.data(), suggest_.keys.bytes.size());
+    writer.PutArray(ns_snapshot::SECTION_SUGGEST_KEY_OFFSETS, suggest_.keys.offsets.data(), suggest_.keys.offsets.size());
+    writer.PutArray(ns_snapshot::SECTION_SUGGEST_ENTRIES, suggest_.entries.data(), suggest_.entries.size());
+    writer.PutArray(ns_snapshot::SECTION_SUGGEST_NODES, suggest_.nodes.data(), suggest_.nodes.size());
+    writer.PutArray(ns_snapshot::SECTION_SUGGEST_TOP, suggest_.top.data(), suggest_.top.size());
+
+    if (!writer.Finish()) {
+        std::cerr << "写入快照文件失败: " << dir << "/index.snap" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Segment::Load(const std::string& dir) {
+    std::unique_ptr<ns_snapshot::SnapshotReader> reader(new ns_snapshot::SnapshotReader());
+    if (!reader->Open(dir + "/index.snap")) {
+        return false;
+    }
+
+    ns_snapshot::BufferReader meta;
+    uint64_t doc_count = 0, term_count = 0;
+    uint32_t snap_dim = 0, vector_format = 0;
+    if (!reader->GetSection(ns_snapshot::SECTION_META, &meta) || !meta.Get(&doc_count) ||
+        !meta.Get(&term_count) || !meta.Get(&snap_dim) || !meta.Get(&vector_format)) {
+        std::cerr << "快照元信息损坏。" << std::endl;
+        return false;
+    }
+    dim_ = static_cast<int>(snap_dim);
+    if (vector_format != ns_snapshot::VECTOR_FLOAT && vector_format != ns_snapshot::VECTOR_INT8 &&
+        vector_format != ns_snapshot::VECTOR_IVFPQ && vector_format != ns_snapshot::VECTOR_FLAT) {
+        std::cerr << "未知的向量格式: " << vector_format << std::endl;
+        return false;
+    }
+
+    // 正排各列、词典和倒排拉链直接指向映射内存，不做解码和拷贝
+    for (uint32_t field = 0; field < FIELD_COUNT; ++field) {
+        StringColumn& column = forward_.columns[field];
+        if (!reader->GetArray(ns_snapshot::SECTION_FIELD_BYTES + field, &column.bytes) ||
+            !reader->GetArray(ns_snapshot::SECTION_FIELD_OFFSETS + field, &column.offsets)) {
+            return false;
+        }
+    }
+    if (!reader->GetArray(ns_snapshot::SECTION_DOC_IDS, &doc_ids_) || doc_ids_.size() != doc_count ||
+        !forward_.Validate(doc_count)) {
+        std::cerr << "快照正排索引损坏。" << std::endl;
+        return false;
+    }
+    if (!reader->GetArray(ns_snapshot::SECTION_TERM_BYTES, &dictionary_.bytes) ||
+        !reader->GetArray(ns_snapshot::SECTION_TERM_OFFSETS, &dictionary_.offsets) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_OFFSETS, &postings_.offsets) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_BLOCK_OFFSETS, &postings_.block_offsets) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_BLOCKS, &postings_.blocks) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_PACKED, &postings_.packed) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_TAIL, &postings_.tail_docs) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_IMPACTS, &postings_.impacts) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_FIELD_TFS, &postings_.field_tfs) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_BLOCK_MAX, &postings_.block_max) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSTING_TERM_MAX, &postings_.term_max) ||
+        dictionary_.size() != term_count || !postings_.Validate(term_count)) {
+        std::cerr << "快照倒排索引损坏。" << std::endl;
+        return false;
+    }
+    SumFieldLengths(postings_, total_lengths_);
+    // 位置两节只在构建时保留了位置才有
+    if (!reader->GetArray(ns_snapshot::SECTION_POSITION_TERM_BYTES, &positions_.dictionary.bytes) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSITION_TERM_OFFSETS, &positions_.dictionary.offsets) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSITION_OFFSETS, &positions_.offsets) ||
+        !reader->GetArray(ns_snapshot::SECTION_POSITION_DOCS, &positions_.docs) ||
+        (reader->HasSection(ns_snapshot::SECTION_POSITION_POS_OFFSETS) &&
+         (!reader->GetArray(ns_snapshot::SECTION_POSITION_POS_OFFSETS, &positions_.pos_offsets) ||
+          !reader->GetArray(ns_snapshot::SECTION_POSITION_DATA, &positions_.positions))) ||
+        !positions_.Validate(doc_count)) {
+        std::cerr << "快照位置倒排损坏。" << std::endl;
+        return false;
+    }
+    if (!reader->HasSection(ns_snapshot::SECTION_SUGGEST_NODES)) {
+        BuildSuggest();
+    } else if (!reader->GetArray(ns_snapshot::SECTION_SUGGEST_KEY_BYTES, &suggest_.keys.bytes) ||
+               !reader->GetArray(ns_snapshot::SECTION_SUGGEST_KEY_OFFSETS, &suggest_.keys.offsets) ||
+               !reader->GetArray(ns_snapshot::SECTION_SUGGEST_ENTRIES, &suggest_.entries) ||
+               !reader->GetArray(ns_snapshot::SECTION_SUGGEST_NODES, &suggest_.nodes) ||
+               !reader->GetArray(ns_snapshot::SECTION_SUGGEST_TOP, &suggest_.top) ||
+               !suggest_.Validate(doc_count)) {
+        std::cerr << "快照前缀补全树损坏。" << std::endl;
+        return false;
+    }
+    ns_snapshot::BufferReader bm25;
+    bool bm25_ok = reader->GetSection(ns_snapshot::SECTION_BM25, &bm25) && bm25.Get(&bm25_.k1);
+    for (int f = 0; bm25_ok && f < SCORED_FIELD_COUNT; ++f) {
+        bm25_ok = bm25.Get(&bm25_.weight[f]) && bm25.Get(&bm25_.b[f]);
+    }
+    if (!bm25_ok) {
+        std::cerr << "快照 BM25 参数损坏。" << std::endl;
+        return false;
+    }
+
+    if (vector_format == ns_snapshot::VECTOR_FLAT) {
+        std::unique_ptr<FlatEngine> engine(new FlatEngine(dim_));
+        if (!engine->Load(*reader, doc_count)) {
+            return false;
+        }
+        vector_engine_ = std::move(engine);
+    } else if (vector_format == ns_snapshot::VECTOR_IVFPQ) {
+        std::unique_ptr<IvfPqEngine> engine(new IvfPqEngine(dim_));
+        if (!engine->Load(*reader, doc_count)) {
+            return false;
+        }
+        vector_engine_ = std::move(engine);
+    } else {
+        std::unique_ptr<HnswEngine> engine(new HnswEngine(dim_));
+        if (!engine->Load(dir, *reader, vector_format, doc_count)) {
+            return false;
+        }
+        vector_engine_ = std::move(engine);
+    }
+    snapshot_ = std::move(reader);
+    ResetTombstones();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+// MemSegment
+
+MemSegment::MemSegment(uint64_t id, int dim, size_t capacity, const Bm25Params& bm25, bool positions,
+                       std::shared_ptr<const ns_quant::ScalarQuantizer> quantizer)
+    : id_(id), dim_(dim), capacity_(capacity), docs_(capacity), has_positions_(positions), bm25_(bm25),
+      field_lengths_(capacity * SCORED_FIELD_COUNT, 0), total_lengths_((capacity + 1) * SCORED_FIELD_COUNT, 0),
+      vectors_(capacity * dim, 0.0f), has_vector_(capacity, 0),
+      tombstones_(new std::atomic<uint8_t>[capacity]), quantizer_(std::move(quantizer)) {
+    for (size_t i = 0; i < capacity_; ++i) {
+        tombstones_[i].store(0, std::memory_order_relaxed);
+    }
+    if (quantizer_) {
+        code_.resize(quantizer_->code_size());
+        space_.reset(new ns_quant::Int8InnerProductSpace(*quantizer_));
+    } else {
+        space_.reset(new hnswlib::InnerProductSpace(dim_));
+    }
+    vector_index_.reset(new hnswlib::HierarchicalNSW<float>(space_.get(), capacity_, 16, 200));
+}
+
+bool MemSegment::Add(DocInfo&& doc, const RawPostings& tokens, const DocPositions& positions, const std::vector<float>& vec,
+                     std::string* err) {
+    if (full()) {
+        *err = "内存段已满";
+        return false;
+    }
+    uint32_t ordinal = next_ordinal_;
+    // 向量先写入段内矩阵并插入 HNSW（addPoint 可以与查询并发），
+    // 在发布文档数之前查询会忽略序号不小于快照文档数的向量结果
+    if (!vec.empty()) {
+        float* row = vectors_.data() + static_cast<size_t>(ordinal) * dim_;
+        std::copy(vec.begin(), vec.end(), row);
+        try {
+            if (quantizer_) {
+                quantizer_->Encode(row, code_.data());
+                vector_index_->addPoint(code_.data(), ordinal);
+            } else {
+                vector_index_->addPoint(row, ordinal);
+            }
+        } catch (const std::exception& e) {
+            *err = std::string("插入向量失败: ") + e.what();
+            return false;
+        }
+    }
+    has_vector_[ordinal] = vec.empty() ? 0 : 1;
+    uint32_t* lengths = field_lengths_.data() + static_cast<size_t>(ordinal) * SCORED_FIELD_COUNT;
+    for (const auto& pair : tokens) {
+        PostingList& list = postings_.Upsert(pair.first);
+        for (const auto& posting : pair.second) {
+            DeltaPosting delta{ordinal, {}};
+            AddFieldTfs(delta.tf, posting.tf);
+            list.push_back(delta);
+            for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+                lengths[f] += posting.tf[f];
+            }
+        }
+    }
+    const uint64_t* totals = total_lengths_.data() + static_cast<size_t>(ordinal) * SCORED_FIELD_COUNT;
+    for (int f = 0; f < SCORED_FIELD_COUNT; ++f) {
+        total_lengths_[static_cast<size_t>(ordinal + 1) * SCORED_FIELD_COUNT + f] = totals[f] + lengths[f];
+    }
+    for (const auto& pair : positions) {
+        positions_.Upsert(pair.first).Append(ordinal, pair.second, has_positions_);
+    }
+    ForEachSuggestKey(doc.title, doc.forms, doc.senses, [this, ordinal](const std::string& key, uint32_t weight) {
+        suggest_keys_.Upsert(key).push_back({ordinal, weight});
+    });
+    ordinals_[doc.doc_id] = ordinal;
+    docs_[ordinal] = std::move(doc);
+    ++next_ordinal_;
+    // 以上内容都写完后才对新获取的视图可见
+    doc_count_.store(next_ordinal_, std::memory_order_release);
+    return true;
+}
+
+bool MemSegment::FindOrdinal(uint64_t doc_id, uint32_t* ordinal) const {
+    auto it = ordinals_.find(doc_id);
+    if (it == ordinals_.end()) {
+        return false;
+    }
+    *ordinal = it->second;
+    return true;
+}
+
+bool MemSegment::MarkDeleted(uint32_t ordinal) {
+    if (tombstones_[ordinal].exchange(1) != 0) {
+        return false;
+    }
+    try {
+        vector_index_->markDelete(ordinal);
+    } catch (const std::exception&) {
+        // 该文档没有向量
+    }
+    return true;
+}
+
+void MemSnapshot::GetDoc(uint32_t ordinal, DocView* doc) const {
+    const DocInfo& info = segment_->docs_[ordinal];
+    doc->doc_id = info.doc_id;
+    doc->title = info.title;
+    doc->language = info.language;
+    doc->forms = info.forms;
+    doc->senses = info.senses;
+    doc->url = info.url;
+}
+
+void MemSnapshot::SearchVectors(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const {
+    const MemSegment& segment = *segment_;
+    std::vector<VectorHit> found;
+    std::priority_queue<std::pair<float, hnswlib::labeltype>> result;
+    if (segment.quantizer_) {
+        std::vector<char> code(segment.quantizer_->code_size());
+        segment.quantizer_->Encode(query, code.data());
+        result = segment.vector_index_->searchKnn(code.data(), std::max(k, candidates));
+    } else {
+        result = segment.vector_index_->searchKnn(query, std::max(k, candidates));  // 同 HnswEngine::Search，ef 由参数传入
+    }
+    while (!result.empty()) {
+        // 快照之后写入（或正在写入）的文档
+        if (result.top().second < doc_count_) {
+            found.push_back({static_cast<uint32_t>(result.top().second), 1 - result.top().first});
+        }
+        result.pop();
+    }
+    if (segment.quantizer_) {
+        RerankHits(query, segment.dim_, k, &found, [&segment](uint32_t ordinal) {
+            return segment.vectors_.data() + static_cast<size_t>(ordinal) * segment.dim_;
+        });
+    } else if (found.size() > k) {
+        // 结果按距离从远到近弹出，最后 k 个最近
+        found.erase(found.begin(), found.end() - k);
+    }
+    hits->insert(hits->end(), found.begin(), found.end());
+}
+
+void MemSnapshot::SearchVectorsExact(const float* query, size_t k, int threads, std::vector<VectorHit>* hits) const {
+    const MemSegment& segment = *segment_;
+    std::vector<std::vector<VectorHit>> results;
+    ns_flat::SearchRows(query, 1, doc_count_, segment.dim_, k, threads, [&segment](size_t ordinal) -> const float* {
+        return segment.has_vector_[ordinal] && !segment.IsDeleted(static_cast<uint32_t>(ordinal))
+                   ? segment.vectors_.data() + ordinal * segment.dim_ : nullptr;
+    }, &results);
+    hits->insert(hits->end(), results[0].begin(), results[0].end());
+}
+
+bool MemSnapshot::GetPostings(std::string_view word, MemPostings* list) const {
+    const MemSegment::PostingList* postings = segment_->postings_.Find(word);
+    if (postings == nullptr) {
+        return false;
+    }
+    *list = Visible(*postings);
+    return list->size() > 0;
+}
+
+bool MemSnapshot::GetPositions(std::string_view word, PositionList* list) const {
+    const MemPositionList* positions = segment_->positions_.Find(word);
+    if (positions == nullptr) {
+        return false;
+    }
+    *list = positions->View(doc_count_, segment_->has_positions_);
+    return list->size > 0;
+}
+
+void MemSnapshot::Suggest(std::string_view prefix, size_t limit, std::vector<SuggestHit>* hits) const {
+    std::vector<SuggestHit> found;
+    segment_->suggest_keys_.ForEach([&](const auto& entry) {
+        if (entry.key.compare(0, prefix.size(), prefix) != 0) {
+            return;
+        }
+        size_t size = entry.value.size();
+        const std::pair<uint32_t, uint32_t>* docs = entry.value.data();
+        for (size_t i = 0; i < size && docs[i].first < doc_count_; ++i) {
+            if (!IsDeleted(docs[i].first)) {
+                found.push_back({entry.key, docs[i].first, docs[i].second});
+            }
+        }
+    });
+    TakeDistinct(&found, limit);
+    hits->insert(hits->end(), found.begin(), found.end());
+}
+
+std::shared_ptr<Segment> MemSegment::Seal(uint64_t segment_id, const BuildOptions& options,
+                                          std::vector<uint32_t>* included) const {
+    // 段已冻结，不再有新的写入，按已发布的全部文档取快照
+    MemSnapshot snapshot(this, DocCount());
+    std::vector<DocInfo> docs;
+    std::unordered_map<uint64_t, const float*> sources;
+    included->clear();
+    for (uint32_t ordinal = 0; ordinal < snapshot.DocCount(); ++ordinal) {
+        if (IsDeleted(ordinal)) {
+            continue;
+        }
+        included->push_back(ordinal);
+        docs.push_back(docs_[ordinal]);
+        docs.back().seq = docs.size() - 1;
+        if (has_vector_[ordinal]) {
+            sources[docs_[ordinal].doc_id] = vectors_.data() + static_cast<size_t>(ordinal) * dim_;
+        }
+    }
+    RawPostings raw;
+    postings_.ForEach([&](const auto& entry) {
+        MemPostings postings;
+        if (!snapshot.GetPostings(entry.key, &postings)) {
+            return;
+        }
+        std::vector<RawPosting> list;
+        for (const auto& posting : postings) {
+            if (!IsDeleted(posting.ordinal)) {
+                RawPosting raw_posting{docs_[posting.ordinal].doc_id, {}};
+                AddFieldTfs(raw_posting.tf, posting.tf);
+                list.push_back(raw_posting);
+            }
+        }
+        if (!list.empty()) {
+            raw.emplace(entry.key, std::move(list));
+        }
+    });
+    RawPositions raw_positions;
+    positions_.ForEach([&](const auto& entry) {
+        PositionList list;
+        snapshot.GetPositions(entry.key, &list);
+        for (uint32_t i = 0; i < list.size; ++i) {
+            if (IsDeleted(list.docs[i])) {
+                continue;
+            }
+            if (has_positions_) {
+                raw_positions.Add(entry.key, docs_[list.docs[i]].doc_id, list.PositionsBegin(i),
+                                  static_cast<uint32_t>(list.pos_offsets[i + 1] - list.pos_offsets[i]));
+            } else {
+                raw_positions.Add(entry.key, docs_[list.docs[i]].doc_id, nullptr, 0);
+            }
+        }
+    });
+
+    auto segment = std::make_shared<Segment>(segment_id, dim_);
+    segment->Finalize(&docs, &raw, &raw_positions, has_positions_, options.bm25);
+    std::vector<const float*> by_ordinal(segment->DocCount(), nullptr);
+    for (uint32_t ordinal = 0; ordinal < segment->DocCount(); ++ordinal) {
+        auto it = sources.find(segment->GetDocId(ordinal));
+        if (it != sources.end()) {
+            by_ordinal[ordinal] = it->second;
+        }
+    }
+    segment->SetVectorSources(std::move(by_ordinal));
+    if (!segment->BuildVectorIndex(options)) {
+        return nullptr;
+    }
+    return segment;
+}
+
+// ---------------------------------------------------------------------------
+
+std::shared_ptr<Segment> MergeSegments(const std::vector<std::shared_ptr<Segment>>& sources,
+                                       uint64_t segment_id, int dim, const BuildOptions& options,
+                                       std::vector<std::vector<uint32_t>>* included) {
+    std::vector<DocInfo> docs;
+    std::unordered_map<uint64_t, const float*> vector_sources;
+    std::deque<std::vector<float>> decoded;  // 不保存原始向量的源段还原出的近似向量，保留到构建完向量索引
+    RawPostings raw;
+    RawPositions raw_positions;
+    // 只要有一个源段没有保留位置，新段也不保留，否则其中一部分文档会查不到短语
+    bool positions = !sources.empty();
+    for (const auto& source : sources) {
+        positions = positions && source->HasPositions();
+    }
+    included->assign(sources.size(), std::vector<uint32_t>());
+    uint32_t buffer[POSTING_BLOCK_SIZE];
+    for (size_t s = 0; s < sources.size(); ++s) {
+        const Segment& source = *sources[s];
+        // 先固定本次收入的文档：合并期间新增的删除标记在发布前另行补上
+        std::vector<uint8_t> live(source.DocCount(), 0);
+        for (uint32_t ordinal = 0; ordinal < source.DocCount(); ++ordinal) {
+            if (source.IsDeleted(ordinal)) {
+                continue;
+            }
+            live[ordinal] = 1;
+            (*included)[s].push_back(ordinal);
+            DocView view;
+            source.GetDoc(ordinal, &view);
+            DocInfo doc;
+            doc.doc_id = view.doc_id;
+            doc.title.assign(view.title);
+            doc.language.assign(view.language);
+            doc.forms.assign(view.forms);
+            doc.senses.assign(view.senses);
+            doc.url.assign(view.url);
+            doc.seq = docs.size();
+            docs.push_back(std::move(doc));
+            if (const float* vec = source.GetVector(ordinal)) {
+                vector_sources[view.doc_id] = vec;
+            } else if (!source.StoresVectors()) {
+                decoded.emplace_back(dim);
+                if (source.DecodeVector(ordinal, decoded.back().data())) {
+                    vector_sources[view.doc_id] = decoded.back().data();
+                } else {
+                    decoded.pop_back();
+                }
+            }
+        }
+        const TermDictionary& dictionary = source.Dictionary();
+        for (uint32_t term_id = 0; term_id < dictionary.size(); ++term_id) {
+            InvertedList list = source.Postings().Get(term_id);
+            std::vector<RawPosting>* dst = nullptr;
+            for (uint32_t chunk = 0; chunk < list.chunk_count(); ++chunk) {
+                uint32_t count = 0;
+                const uint32_t* ordinals = list.DecodeChunk(chunk, buffer, &count);
+                const uint16_t* tfs = list.field_tfs + static_cast<size_t>(chunk) * POSTING_BLOCK_SIZE * SCORED_FIELD_COUNT;
+                for (uint32_t i = 0; i < count; ++i) {
+                    if (!live[ordinals[i]]) {
+                        continue;
+                    }
+                    if (dst == nullptr) {
+                        dst = &raw[std::string(dictionary.Term(term_id))];
+                    }
+                    RawPosting posting{source.GetDocId(ordinals[i]), {}};
+                    AddFieldTfs(posting.tf, tfs + i * SCORED_FIELD_COUNT);
+                    dst->push_back(posting);
+                }
+            }
+        }
+        const PositionStore& store = source.Positions();
+        for (uint32_t term_id = 0; term_id < store.dictionary.size(); ++term_id) {
+            std::string term(store.dictionary.Term(term_id));
+            for (uint64_t e = store.offsets[term_id]; e < store.offsets[term_id + 1]; ++e) {
+                uint32_t ordinal = store.docs[e];
+                if (!live[ordinal]) {
+                    continue;
+                }
+                if (positions) {
+                    raw_positions.Add(term, source.GetDocId(ordinal), store.positions.data() + store.pos_offsets[e],
+                                      static_cast<uint32_t>(store.pos_offsets[e + 1] - store.pos_offsets[e]));
+                } else {
+                    raw_positions.Add(term, source.GetDocId(ordinal), nullptr, 0);
+                }
+            }
+        }
+    }
+
+    auto segment = std::make_shared<Segment>(segment_id, dim);
+    segment->Finalize(&docs, &raw, &raw_positions, positions, options.bm25);
+    std::vector<const float*> by_ordinal(segment->DocCount(), nullptr);
+    for (uint32_t ordinal = 0; ordinal < segment->DocCount(); ++ordinal) {
+        auto it = vector_sources.find(segment->GetDocId(ordinal));
+        if (it != vector_sources.end()) {
+            by_ordinal[ordinal] = it->second;
+        }
+    }
+    segment->SetVectorSources(std::move(by_ordinal));
+    if (!segment->BuildVectorIndex(options)) {
+        return nullptr;
+    }
+    return segment;
+}
+
+} // namespace ns_index
@@ -1,38 +1,20 @@
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
 #include "cpp-httplib/httplib.h"
 #include "lemsearcher.hpp"
 #include "redis_util.hpp"
 #include "mysql_util.hpp"
 
 const std::string input = "./data/simplified_lexemes.json";    
-const std::string vector_input = "./data/lexeme_vectors.txt";    
+const std::string vector_input = "./data/lexeme_vectors.bin";    
+const std::string snapshot_input = "./data/lexeme_index";    // 由 lembuildsnapshot 离线生成
 const std::string root_path = "./lemwwwroot";    
 
 
-std::string exec_python_vectorize(const std::string& input_text) {
-    // 构造调用命令，此处假设 python3 可执行文件在 PATH 中
-    // 你可以将输入文本作为命令行参数传递，但要注意转义空格和特殊字符
-    std::string command = "python3 ./src/lemvectorize.py \"" + input_text + "\"";
-
-    // 打开管道读取脚本输出
-    FILE* pipe = popen(command.c_str(), "r");
-    if (!pipe) {
-        throw std::runtime_error("popen() failed!");
-    }
-    
-    char buffer[128];
-    std::string result;
-    while (fgets(buffer, sizeof(buffer), pipe) != nullptr) {
-        result += buffer;
-    }
-    pclose(pipe);
-    // 去除末尾换行符
-    if (!result.empty() && result.back() == '\n') {
-        result.pop_back();
-    }
-    return result;
-}
-
-
 // 将逗号分隔的字符串转换为 vector<float>
 std::vector<float> ParseEmbeddingString(const std::string &embedding_str) {
     std::vector<float> embedding;
@@ -51,6 +33,181 @@ std::vector<float> ParseEmbeddingString(const std::string &embedding_str) {
 }
 
 
+extern char **environ;
+
+// 在一个 python 进程中向量化一批文本：不经过 shell，直接启动 python3 并通过标准输入传入文本，
+// 每行一条（文本中的换行替换为空格），脚本以 --batch 模式一次加载模型、逐行输出向量。
+// 成功时 embeddings 与 texts 一一对应；脚本失败或输出的行数、维度不对时返回 false 并写入 err
+bool exec_python_vectorize(const std::vector<std::string>& texts, std::vector<std::vector<float>>* embeddings, std::string* err) {
+    embeddings->clear();
+    if (texts.empty())
+        return true;
+    int in_pipe[2], out_pipe[2];
+    if (pipe2(in_pipe, O_CLOEXEC) != 0) {
+        *err = std::string("创建管道失败: ") + std::strerror(errno);
+        return false;
+    }
+    if (pipe2(out_pipe, O_CLOEXEC) != 0) {
+        *err = std::string("创建管道失败: ") + std::strerror(errno);
+        close(in_pipe[0]);
+        close(in_pipe[1]);
+        return false;
+    }
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, in_pipe[0], STDIN_FILENO);
+    posix_spawn_file_actions_adddup2(&actions, out_pipe[1], STDOUT_FILENO);
+    char *argv[] = {const_cast<char *>("python3"), const_cast<char *>("./src/lemvectorize.py"), const_cast<char *>("--batch"), nullptr};
+    pid_t pid = 0;
+    int rc = posix_spawnp(&pid, "python3", &actions, nullptr, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(in_pipe[0]);
+    close(out_pipe[1]);
+    if (rc != 0) {
+        *err = std::string("启动 python3 失败: ") + std::strerror(rc);
+        close(in_pipe[1]);
+        close(out_pipe[0]);
+        return false;
+    }
+
+    // 脚本读完全部输入后才开始输出，先写完再读不会互相等待。
+    // 脚本提前退出时写入返回 EPIPE（httplib::Server 已忽略 SIGPIPE），照常读取并回收子进程
+    std::string input;
+    for (const auto &text : texts) {
+        std::string line = text;
+        std::replace(line.begin(), line.end(), '\n', ' ');
+        std::replace(line.begin(), line.end(), '\r', ' ');
+        input += line;
+        input += '\n';
+    }
+    for (size_t written = 0; written < input.size();) {
+        ssize_t n = write(in_pipe[1], input.data() + written, input.size() - written);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        written += static_cast<size_t>(n);
+    }
+    close(in_pipe[1]);
+    std::string output;
+    char buffer[4096];
+    for (;;) {
+        ssize_t n = read(out_pipe[0], buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        output.append(buffer, static_cast<size_t>(n));
+    }
+    close(out_pipe[0]);
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        *err = "向量化脚本执行失败";
+        return false;
+    }
+
+    std::istringstream lines(output);
+    std::string line;
+    while (std::getline(lines, line) && embeddings->size() < texts.size()) {
+        embeddings->push_back(ParseEmbeddingString(line));
+        if (embeddings->back().empty() || embeddings->back().size() != embeddings->front().size()) {
+            *err = "向量化脚本的输出格式错误";
+            return false;
+        }
+    }
+    if (embeddings->size() != texts.size()) {
+        *err = "向量化脚本输出的向量数与文本数不一致";
+        return false;
+    }
+    return true;
+}
+
+
+// 读取非负整数查询参数，缺失或无法解析时返回 0
+size_t GetSizeParam(const httplib::Request &req, const char *name) {
+    std::string value = req.get_param_value(name);
+    char *end = nullptr;
+    unsigned long long parsed = std::strtoull(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || value[0] == '-')
+        return 0;
+    return static_cast<size_t>(parsed);
+}
+
+
+// 管理接口只允许从本机访问
+bool IsAdminRequest(const httplib::Request &req) {
+    return req.remote_addr == "127.0.0.1" || req.remote_addr == "::1";
+}
+
+
+// 重载进行中拒绝增量写入：新索引按源文件重建，写入旧索引的更新会在替换时丢失
+void RejectWhileReloading(httplib::Response &rsp) {
+    Json::Value result;
+    result["status"] = "索引正在重载，请在重载完成后重试";
+    rsp.status = 409;
+    Json::StreamWriterBuilder writer;
+    rsp.set_content(Json::writeString(writer, result), "application/json");
+}
+
+
+// 取得一批增量更新词条的向量：优先使用请求中的 "vector" 数组，
+// 其余词条与离线流程一致，对 combined_text（缺省时由 lemma、forms、senses 拼接）向量化，全部放在同一个 python 进程中完成。
+// "vector" 中有非数字元素或向量化失败时 errors 中对应的位置写入原因，这些词条不应写入索引
+void GetLexemeEmbeddings(const Json::Value &lexemes, std::vector<std::vector<float>> *embeddings, std::vector<std::string> *errors) {
+    embeddings->assign(lexemes.size(), std::vector<float>());
+    errors->assign(lexemes.size(), std::string());
+    std::vector<std::string> texts;
+    std::vector<Json::Value::ArrayIndex> pending;
+    for (Json::Value::ArrayIndex i = 0; i < lexemes.size(); ++i) {
+        const Json::Value &lex = lexemes[i];
+        if (!lex.isObject())
+            continue;
+        const Json::Value &vec = lex["vector"];
+        if (vec.isArray()) {
+            // 向量来自客户端，元素不是数字时整条拒绝，不能让 asFloat 抛出异常
+            for (Json::Value::ArrayIndex j = 0; j < vec.size(); ++j) {
+                if (!vec[j].isNumeric()) {
+                    (*embeddings)[i].clear();
+                    (*errors)[i] = "vector 的第 " + std::to_string(j) + " 个元素不是数字";
+                    break;
+                }
+                (*embeddings)[i].push_back(vec[j].asFloat());
+            }
+            continue;
+        }
+        std::string text = lex.get("combined_text", "").asString();
+        if (text.empty()) {
+            text = lex.get("lemma", "").asString();
+            for (const auto &field : {"forms", "senses"}) {
+                const Json::Value &values = lex[field];
+                if (!values.isArray())
+                    continue;
+                for (Json::Value::ArrayIndex j = 0; j < values.size(); ++j) {
+                    if (values[j].isString())
+                        text += " " + values[j].asString();
+                }
+            }
+        }
+        texts.push_back(std::move(text));
+        pending.push_back(i);
+    }
+    std::vector<std::vector<float>> vectors;
+    std::string err;
+    if (!exec_python_vectorize(texts, &vectors, &err)) {
+        std::cerr << "词条向量化失败: " << err << std::endl;
+        for (Json::Value::ArrayIndex i : pending) {
+            (*errors)[i] = "向量化失败: " + err;
+        }
+        return;
+    }
+    for (size_t j = 0; j < pending.size(); ++j) {
+        (*embeddings)[pending[j]] = std::move(vectors[j]);
+    }
+}
+
+
 // 打印欢迎信息和服务器启动信息
 void printWelcomeMessage() {
     std::cout << R"(
@@ -91,7 +248,7 @@ int main() {
 
     // 1. 初始化，构建搜索索引
     ns_searcher::Searcher *search = new ns_searcher::Searcher();    
-    search->InitSearcher(input,vector_input);  //初始化search，创建单例，并构建索引  
+    search->InitSearcher(input,vector_input,snapshot_input);  //初始化search，并构建索引  
 
     // 2. 搭建服务器
     httplib::Server svr;
@@ -208,24 +365,50 @@ int main() {
             return;
         }
 
-        // 使用python脚本对文本进行向量化
+        // 使用python脚本对文本进行向量化，失败时只做倒排检索
         std::vector<float> embedding_vector;
-        try {
-            std::string embedding_str = exec_python_vectorize(text);
-            //std::cout << "文本向量化结果: " << embedding_str << std::endl;
-            embedding_vector = ParseEmbeddingString(embedding_str);
-        } catch (const std::exception &e) {
-            std::cerr << "错误: " << e.what() << std::endl;
+        std::vector<std::vector<float>> embeddings;
+        std::string vectorize_err;
+        if (exec_python_vectorize({text}, &embeddings, &vectorize_err)) {
+            embedding_vector = std::move(embeddings[0]);
+        } else {
+            std::cerr << "错误: " << vectorize_err << std::endl;
         }
 
-        // 搜索文本匹配的结果
+        // 搜索文本匹配的结果。可选参数：
+        //   k     向量检索返回的结果数（默认 20，上限 MAX_VECTOR_K）
+        //   ef    向量检索的搜索宽度（缺省时按 k 和当前负载自适应，上限 MAX_VECTOR_EF）
+        //   exact 为 1 时向量部分改用精确检索（较慢，用于对比近似索引的结果）
+        //   fuzzy 为 1 时词典中没有的关键词按编辑距离匹配相近的词（容忍拼写错误）
+        //   offset/limit 翻页：跳过前 offset 个结果（上限 MAX_PAGE_OFFSET），最多返回 limit 个（默认 DEFAULT_PAGE_SIZE，上限 MAX_PAGE_SIZE）
+        // 响应体仍是结果数组，参与融合的候选数放在 X-Total-Count 响应头中（大于 offset + limit 说明还有下一页）
+        ns_searcher::SearchOptions options;
+        if (size_t k = GetSizeParam(req, "k"))
+            options.k = k;
+        options.ef = GetSizeParam(req, "ef");
+        options.exact = req.get_param_value("exact") == "1";
+        options.fuzzy = req.get_param_value("fuzzy") == "1";
+        options.offset = GetSizeParam(req, "offset");
+        if (size_t limit = GetSizeParam(req, "limit"))
+            options.limit = limit;
         std::string json_results;
-        search->SearchCombined(text,embedding_vector,&json_results);
+        size_t total_hits = 0;
+        search->SearchCombined(text,embedding_vector,&json_results,options,&total_hits);
 
+        rsp.set_header("X-Total-Count", std::to_string(total_hits));
         rsp.set_content(json_results,"application/json");
         std::cout << "用户搜索成功，结果已返回！" << std::endl;
     });
     
+    // 前缀补全接口：GET /suggest?prefix=...&limit=...，供输入框联想使用。
+    // 只查询内存中的补全树，不记录搜索历史和热词，也不调用 python 向量化
+    svr.Get("/suggest", [&search](const httplib::Request &req, httplib::Response &rsp) {
+        size_t limit = GetSizeParam(req, "limit");
+        std::string json_results;
+        search->Suggest(req.get_param_value("prefix"), limit ? limit : ns_searcher::DEFAULT_SUGGEST_LIMIT, &json_results);
+        rsp.set_content(json_results, "application/json");
+    });
+
     // 增加接口用来获取热词
     svr.Get("/top-words", [&redis](const httplib::Request &req, httplib::Response &rsp) {
         auto topWords = redis.getTopWords();
@@ -261,6 +444,138 @@ int main() {
         rsp.set_content(jsonString, "application/json");
     });
 
+    // 管理接口：增量新增或更新词条，请求体为一个词条对象或词条数组（格式同 simplified_lexemes.json）。
+    // 重载进行中返回 409，不写入任何词条；向量化失败的词条不写入，与其他错误一样列在 errors 中
+    svr.Post("/admin/lexemes", [&search](const httplib::Request &req, httplib::Response &rsp) {
+        if (!IsAdminRequest(req)) {
+            rsp.status = 403;
+            rsp.set_content("仅允许本机访问", "text/plain; charset=utf-8");
+            return;
+        }
+        Json::Value requestBody;
+        Json::Reader reader;
+        if (!reader.parse(req.body, requestBody) || !(requestBody.isObject() || requestBody.isArray())) {
+            rsp.status = 400;
+            rsp.set_content("无效的请求数据", "text/plain; charset=utf-8");
+            return;
+        }
+        if (search->IsReloading()) {
+            RejectWhileReloading(rsp);
+            return;
+        }
+        Json::Value lexemes = requestBody;
+        if (requestBody.isObject()) {
+            lexemes = Json::Value(Json::arrayValue);
+            lexemes.append(requestBody);
+        }
+        // 先向量化，写入时不持锁等待 python 脚本；向量化失败的词条不写入，在 errors 中报告
+        std::vector<std::vector<float>> embeddings;
+        std::vector<std::string> embed_errors;
+        GetLexemeEmbeddings(lexemes, &embeddings, &embed_errors);
+        Json::Value result;
+        int upserted = 0;
+        result["errors"] = Json::Value(Json::arrayValue);
+        bool applied = search->ApplyWrites([&]() {
+            for (Json::Value::ArrayIndex i = 0; i < lexemes.size(); ++i) {
+                const Json::Value &lex = lexemes[i];
+                std::string err = embed_errors[i];
+                if (lex.isObject() && err.empty() && search->UpsertLexeme(lex, embeddings[i], &err)) {
+                    ++upserted;
+                    continue;
+                }
+                Json::Value error;
+                error["id"] = lex.isObject() ? lex.get("id", "").asString() : "";
+                error["message"] = lex.isObject() ? err : "词条必须是 JSON 对象";
+                result["errors"].append(error);
+            }
+        });
+        if (!applied) {
+            RejectWhileReloading(rsp);
+            return;
+        }
+        result["upserted"] = upserted;
+        Json::StreamWriterBuilder writer;
+        rsp.set_content(Json::writeString(writer, result), "application/json");
+    });
+
+    // 管理接口：删除词条，请求体为 {"ids": ["L1", "L2", ...]}。重载进行中返回 409，不删除任何词条
+    svr.Delete("/admin/lexemes", [&search](const httplib::Request &req, httplib::Response &rsp) {
+        if (!IsAdminRequest(req)) {
+            rsp.status = 403;
+            rsp.set_content("仅允许本机访问", "text/plain; charset=utf-8");
+            return;
+        }
+        Json::Value requestBody;
+        Json::Reader reader;
+        if (!reader.parse(req.body, requestBody) || !requestBody["ids"].isArray()) {
+            rsp.status = 400;
+            rsp.set_content("无效的请求数据", "text/plain; charset=utf-8");
+            return;
+        }
+        const Json::Value &ids = requestBody["ids"];
+        Json::Value result;
+        int deleted = 0;
+        result["missing"] = Json::Value(Json::arrayValue);
+        bool applied = search->ApplyWrites([&]() {
+            for (Json::Value::ArrayIndex i = 0; i < ids.size(); ++i) {
+                std::string id = ids[i].asString();
+                if (search->DeleteLexeme(id)) {
+                    ++deleted;
+                } else {
+                    result["missing"].append(id);
+                }
+            }
+        });
+        if (!applied) {
+            RejectWhileReloading(rsp);
+            return;
+        }
+        result["deleted"] = deleted;
+        Json::StreamWriterBuilder writer;
+        rsp.set_content(Json::writeString(writer, result), "application/json");
+    });
+
+    // 管理接口：热重载索引，请求体可选 {"input": ..., "vectors": ..., "snapshot": ...}，缺省沿用启动时的路径。
+    // 新索引在后台构建，完成后原子替换，重载期间查询照常由旧索引服务
+    svr.Post("/admin/reload", [&search](const httplib::Request &req, httplib::Response &rsp) {
+        if (!IsAdminRequest(req)) {
+            rsp.status = 403;
+            rsp.set_content("仅允许本机访问", "text/plain; charset=utf-8");
+            return;
+        }
+        Json::Value requestBody(Json::objectValue);
+        Json::Reader reader;
+        if (!req.body.empty() && (!reader.parse(req.body, requestBody) || !requestBody.isObject())) {
+            rsp.status = 400;
+            rsp.set_content("无效的请求数据", "text/plain; charset=utf-8");
+            return;
+        }
+        Json::Value result;
+        if (search->ReloadAsync(requestBody.get("input", "").asString(), requestBody.get("vectors", "").asString(),
+                                requestBody.get("snapshot", "").asString())) {
+            rsp.status = 202;
+            result["status"] = "reloading";
+        } else {
+            rsp.status = 409;
+            result["status"] = "已有重载正在进行";
+        }
+        Json::StreamWriterBuilder writer;
+        rsp.set_content(Json::writeString(writer, result), "application/json");
+    });
+
+    // 管理接口：查询重载是否仍在进行
+    svr.Get("/admin/reload", [&search](const httplib::Request &req, httplib::Response &rsp) {
+        if (!IsAdminRequest(req)) {
+            rsp.status = 403;
+            rsp.set_content("仅允许本机访问", "text/plain; charset=utf-8");
+            return;
+        }
+        Json::Value result;
+        result["reloading"] = search->IsReloading();
+        Json::StreamWriterBuilder writer;
+        rsp.set_content(Json::writeString(writer, result), "application/json");
+    });
+
     std::cout << "WikiLex-Searcher started successfully and is listening on port 8080..." << std::endl;
     svr.listen("0.0.0.0", 8080);
 
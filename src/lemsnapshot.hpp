@@ -0,0 +1,317 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <fstream>
+#include <type_traits>
+#include <vector>
+#include <unordered_map>
+
+#include "lemfileutil.hpp"
+
+// 索引快照的二进制文件格式
+// 离线构建好的正排、倒排索引按 section 顺序写入一个文件，启动时通过 mmap 映射后直接解码，
+// 不再需要重新解析 JSON 和分词。文件布局如下：
+//   [SnapshotHeader][section 1][section 2]...[SectionEntry * section_count]
+// 每个 section 按 8 字节对齐，目录表位于文件末尾，由 header 中的 table_offset 指出。
+// 格式有任何不兼容的改动都必须增加 SNAPSHOT_VERSION，旧快照会被拒绝加载并回退到重新构建。
+
+namespace ns_snapshot
+{
+    const char SNAPSHOT_MAGIC[8] = {'L', 'E', 'M', 'S', 'N', 'A', 'P', '\0'};
+    const uint32_t SNAPSHOT_VERSION = 12;
+
+    // SECTION_META 中记录的向量格式
+    enum VectorFormat : uint32_t {
+        VECTOR_FLOAT = 0,   // HNSW 中存放 float 向量
+        VECTOR_INT8 = 1,    // HNSW 中存放 int8 量化编码，原始向量在 SECTION_EXACT_VECTORS
+        VECTOR_IVFPQ = 2,   // IVF-PQ：SECTION_IVF_* 中的倒排列表和 PQ 编码，开启精排时原始向量在 SECTION_EXACT_VECTORS
+        VECTOR_FLAT = 3,    // 精确检索：SECTION_FLAT_* 中连续存放的向量矩阵
+    };
+
+    enum SectionId : uint32_t {
+        SECTION_META = 1,             // 元信息：文档数、词数、向量维度、向量格式
+        SECTION_DOC_IDS = 4,          // 文档序号 -> 文档ID
+        SECTION_TERM_BYTES = 5,       // 有序词典：拼接后的关键词字节
+        SECTION_TERM_OFFSETS = 6,     // 有序词典：每个关键词的起止偏移
+        SECTION_POSTING_OFFSETS = 7,  // 倒排拉链：每个 term_id 的倒排节点区间
+        SECTION_POSTING_BLOCK_MAX = 8,  // 倒排拉链：每个压缩块的最大得分
+        SECTION_POSTING_TERM_MAX = 9,   // 倒排拉链：每个 term_id 的最大得分
+        SECTION_POSTING_BLOCK_OFFSETS = 10,  // 倒排拉链：每个 term_id 的压缩块区间
+        SECTION_POSTING_BLOCKS = 11,         // 倒排拉链：压缩块跳表项
+        SECTION_POSTING_PACKED = 12,         // 倒排拉链：位打包后的文档序号差值
+        SECTION_POSTING_TAIL = 13,           // 倒排拉链：不足一块的尾部文档序号
+        SECTION_QUANT_OFFSETS = 14,   // int8 量化：每维偏移
+        SECTION_QUANT_SCALES = 15,    // int8 量化：每维步长
+        SECTION_EXACT_VECTORS = 16,   // int8 量化：精排用的原始向量，文档序号 * dim；IVF-PQ（可选）：只含有向量的文档，按序号顺序 * dim
+        SECTION_BM25 = 17,            // 倒排打分：BM25F 参数 k1、各字段权重和 b
+        SECTION_POSTING_IMPACTS = 18,    // 倒排拉链：预先算好的 BM25F 得分
+        SECTION_POSTING_FIELD_TFS = 19,  // 倒排拉链：各字段词频
+        SECTION_FIELD_BYTES = 20,     // 正排第 i 列的字节数组为 SECTION_FIELD_BYTES + i
+        SECTION_FIELD_OFFSETS = 30,   // 正排第 i 列的偏移数组为 SECTION_FIELD_OFFSETS + i
+        SECTION_IVF_META = 40,        // IVF-PQ：倒排列表数、子空间数、默认探查列表数
+        SECTION_IVF_CENTROIDS = 41,   // IVF-PQ：粗聚类中心，nlist * dim
+        SECTION_IVF_CODEBOOKS = 42,   // IVF-PQ：每个子空间 16 个码字
+        SECTION_IVF_LIST_OFFSETS = 43,  // IVF-PQ：每个倒排列表的槽位区间
+        SECTION_IVF_IDS = 44,         // IVF-PQ：槽位 -> 文档序号
+        SECTION_IVF_CODES = 45,       // IVF-PQ：按 16 个槽位一块交错存放的 4 位编码
+        SECTION_FLAT_VECTORS = 46,    // 精确检索：有向量的文档按序号顺序排成的矩阵，行数 * dim
+        SECTION_FLAT_LABELS = 47,     // 精确检索：行号 -> 文档序号
+        // 位置倒排（判断 +/- 条件，总是存在；后两节只在构建时保留了位置时才有）
+        SECTION_POSITION_TERM_BYTES = 50,    // 位置倒排：有序词典的关键词字节
+        SECTION_POSITION_TERM_OFFSETS = 51,  // 位置倒排：有序词典每个关键词的起止偏移
+        SECTION_POSITION_OFFSETS = 52,       // 位置倒排：每个 term_id 的文档区间
+        SECTION_POSITION_DOCS = 53,          // 位置倒排：文档序号
+        SECTION_POSITION_POS_OFFSETS = 54,   // 位置倒排：每个文档的位置区间
+        SECTION_POSITION_DATA = 55,          // 位置倒排：位置
+        // 前缀补全（可选，旧快照没有这些 section，加载时由正排重建）
+        SECTION_SUGGEST_KEY_BYTES = 56,      // 前缀补全：有序补全项的字节
+        SECTION_SUGGEST_KEY_OFFSETS = 57,    // 前缀补全：每个补全项的起止偏移
+        SECTION_SUGGEST_ENTRIES = 58,        // 前缀补全：(补全项, 文档序号, 权重)
+        SECTION_SUGGEST_NODES = 59,          // 前缀补全：层序排列的基数树节点
+        SECTION_SUGGEST_TOP = 60,            // 前缀补全：各节点缓存的前几名
+    };
+
+    struct SnapshotHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t section_count;
+        uint64_t table_offset;
+    };
+
+    struct SectionEntry {
+        uint32_t id;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // 带越界检查的顺序读取游标，所有读取都直接作用在映射内存上
+    class BufferReader
+    {
+    public:
+        BufferReader() = default;
+        BufferReader(const char *data, size_t size) : data_(data), size_(size) {}
+
+        template<typename T>
+        bool Get(T *value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "快照只能直接读取平凡类型");
+            if (size_ - pos_ < sizeof(T)) {
+                return false;
+            }
+            std::memcpy(value, data_ + pos_, sizeof(T));
+            pos_ += sizeof(T);
+            return true;
+        }
+
+        bool GetString(std::string *str)
+        {
+            uint32_t len = 0;
+            if (!Get(&len) || size_ - pos_ < len) {
+                return false;
+            }
+            str->assign(data_ + pos_, len);
+            pos_ += len;
+            return true;
+        }
+
+        // 零拷贝地取出一段连续字节
+        bool GetBytes(const char **ptr, size_t len)
+        {
+            if (size_ - pos_ < len) {
+                return false;
+            }
+            *ptr = data_ + pos_;
+            pos_ += len;
+            return true;
+        }
+
+        size_t remaining() const { return size_ - pos_; }
+
+    private:
+        const char *data_ = nullptr;
+        size_t size_ = 0;
+        size_t pos_ = 0;
+    };
+
+    // 快照写入器：先写入临时文件，Finish 成功后再原子地重命名为目标文件，
+    // 这样即使构建中途失败也不会留下半截快照
+    class SnapshotWriter
+    {
+    public:
+        bool Open(const std::string &path)
+        {
+            path_ = path;
+            tmp_path_ = path + ".tmp";
+            out_.open(tmp_path_, std::ios::binary | std::ios::trunc);
+            if (!out_.is_open()) {
+                return false;
+            }
+            SnapshotHeader header{};  // 先占位，Finish 时回填
+            out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            offset_ = sizeof(header);
+            return out_.good();
+        }
+
+        void BeginSection(uint32_t id)
+        {
+            Align();
+            SectionEntry entry{};
+            entry.id = id;
+            entry.offset = offset_;
+            table_.push_back(entry);
+        }
+
+        void EndSection()
+        {
+            table_.back().size = offset_ - table_.back().offset;
+        }
+
+        template<typename T>
+        void Put(const T &value)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "快照只能直接写入平凡类型");
+            PutBytes(&value, sizeof(T));
+        }
+
+        void PutString(const std::string &str)
+        {
+            Put<uint32_t>(static_cast<uint32_t>(str.size()));
+            PutBytes(str.data(), str.size());
+        }
+
+        // 把一个平凡类型数组单独写成一个 section，加载时可以零拷贝地映射回 MappedArray
+        template<typename T>
+        void PutArray(uint32_t id, const T *data, size_t count)
+        {
+            static_assert(std::is_trivially_copyable<T>::value, "快照只能直接写入平凡类型");
+            BeginSection(id);
+            PutBytes(data, sizeof(T) * count);
+            EndSection();
+        }
+
+        void PutBytes(const void *data, size_t len)
+        {
+            out_.write(static_cast<const char*>(data), len);
+            offset_ += len;
+        }
+
+        bool Finish()
+        {
+            Align();
+            SnapshotHeader header{};
+            std::memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+            header.version = SNAPSHOT_VERSION;
+            header.section_count = static_cast<uint32_t>(table_.size());
+            header.table_offset = offset_;
+            for (const auto &entry : table_) {
+                out_.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+            }
+            out_.seekp(0);
+            out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out_.close();
+            if (out_.fail()) {
+                std::remove(tmp_path_.c_str());
+                return false;
+            }
+            return std::rename(tmp_path_.c_str(), path_.c_str()) == 0;
+        }
+
+    private:
+        void Align()
+        {
+            static const char zeros[8] = {0};
+            size_t pad = (8 - offset_ % 8) % 8;
+            PutBytes(zeros, pad);
+        }
+
+        std::ofstream out_;
+        std::string path_;
+        std::string tmp_path_;
+        uint64_t offset_ = 0;
+        std::vector<SectionEntry> table_;
+    };
+
+    // 快照读取器：mmap 整个快照文件，校验 magic/version 和目录表后按 section 提供读取游标
+    class SnapshotReader
+    {
+    public:
+        bool Open(const std::string &path)
+        {
+            if (!file_.Open(path)) {
+                std::cerr << "无法映射快照文件: " << path << std::endl;
+                return false;
+            }
+            SnapshotHeader header;
+            if (file_.size() < sizeof(header)) {
+                std::cerr << "快照文件已损坏: " << path << std::endl;
+                return false;
+            }
+            std::memcpy(&header, file_.data(), sizeof(header));
+            if (std::memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+                std::cerr << "不是有效的索引快照: " << path << std::endl;
+                return false;
+            }
+            if (header.version != SNAPSHOT_VERSION) {
+                std::cerr << "快照版本不匹配: 文件为 v" << header.version
+                          << "，程序需要 v" << SNAPSHOT_VERSION << std::endl;
+                return false;
+            }
+            uint64_t table_size = static_cast<uint64_t>(header.section_count) * sizeof(SectionEntry);
+            if (header.table_offset > file_.size() || file_.size() - header.table_offset < table_size) {
+                std::cerr << "快照目录表越界: " << path << std::endl;
+                return false;
+            }
+            sections_.clear();
+            for (uint32_t i = 0; i < header.section_count; ++i) {
+                SectionEntry entry;
+                std::memcpy(&entry, file_.data() + header.table_offset + i * sizeof(SectionEntry), sizeof(entry));
+                if (entry.offset > file_.size() || file_.size() - entry.offset < entry.size) {
+                    std::cerr << "快照 section " << entry.id << " 越界" << std::endl;
+                    return false;
+                }
+                sections_[entry.id] = entry;
+            }
+            return true;
+        }
+
+        // 可选的 section（如位置倒排）先用它判断是否存在
+        bool HasSection(uint32_t id) const { return sections_.count(id) != 0; }
+
+        bool GetSection(uint32_t id, BufferReader *reader) const
+        {
+            auto it = sections_.find(id);
+            if (it == sections_.end()) {
+                std::cerr << "快照中缺少 section " << id << std::endl;
+                return false;
+            }
+            *reader = BufferReader(file_.data() + it->second.offset, it->second.size);
+            return true;
+        }
+
+        // 把 PutArray 写入的 section 直接映射为数组，不拷贝数据；
+        // 映射内存的生命周期与本 reader 相同，调用方需要保证 reader 比数组活得久
+        template<typename T>
+        bool GetArray(uint32_t id, ns_util::MappedArray<T> *array) const
+        {
+            auto it = sections_.find(id);
+            if (it == sections_.end()) {
+                std::cerr << "快照中缺少 section " << id << std::endl;
+                return false;
+            }
+            const char *data = file_.data() + it->second.offset;
+            if (it->second.size % sizeof(T) != 0 || reinterpret_cast<uintptr_t>(data) % alignof(T) != 0) {
+                std::cerr << "快照 section " << id << " 的长度或对齐不正确" << std::endl;
+                return false;
+            }
+            array->Map(reinterpret_cast<const T*>(data), it->second.size / sizeof(T));
+            return true;
+        }
+
+    private:
+        ns_util::MmapFile file_;
+        std::unordered_map<uint32_t, SectionEntry> sections_;
+    };
+}
@@ -0,0 +1,416 @@
+#pragma once
+#include <cstdint>
+#include <cctype>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+
+#include "lemfileutil.hpp"
+#include "lempostings.hpp"
+
+// 前缀补全：输入框每敲一个字符就查询一次，只查这里的压缩前缀树，不经过分词、倒排打分、向量检索和 python 向量化。
+// 补全项是词条标题（整体）和每个词形（forms 按空格切开，去掉两端的 ASCII 标点），转为小写；同一个补全项可以来自多个词条。
+// 排序只用静态热度：词条的释义和词形越多通常越常用，热度 = 释义数 + 词形数，
+// 权重 = 热度 * 2 + (来自标题 ? 1 : 0)；权重相同时较短的补全项在前，再按字典序。
+// 存储（每个不可变段一份，随快照保存）：
+//   keys     有序、去重的补全项，下标即 key_id；
+//   entries  (key_id, 文档序号, 权重) 按 key_id 升序、权重降序排列，以某个前缀开头的补全项在其中恰好是一个连续区间；
+//   nodes    基数树（路径压缩的 trie）按层序排列，根为 0，一个节点的子节点编号连续。节点只记录深度和它覆盖的 entries 区间，
+//            边上的字节直接取区间第一个补全项的对应部分，不另外保存；最后多一个哨兵节点，前一个节点的子节点、缓存区间到它为止；
+//   top      覆盖超过 SUGGEST_CACHE_SIZE 个 entries 的节点预先排好前 SUGGEST_CACHE_SIZE 个不同的补全项（各取其权重最高的一条），
+//            其余节点的区间本来就很短，查询时现排。
+// 查询沿前缀走到对应节点（每层在子节点中二分查找一个字节），直接返回缓存的前几名，代价只与前缀长度有关；
+// 缓存中有已删除的文档时才下到子节点，只有缓存失效的子树需要展开，结果仍与逐个检查全部补全项一致。
+
+namespace ns_index {
+
+// 每个节点缓存的补全数，也是单次补全返回数的上限
+const size_t SUGGEST_CACHE_SIZE = 16;
+
+struct SuggestEntry {
+    uint32_t key;
+    uint32_t doc;      // 段内文档序号
+    uint32_t weight;
+};
+
+struct SuggestNode {
+    uint32_t depth;        // 本节点代表的前缀长度
+    uint32_t begin;        // 覆盖的 entries 区间 [begin, end)
+    uint32_t end;
+    uint32_t first_child;  // 子节点为 [first_child, 下一个节点的 first_child)
+    uint32_t first_top;    // 缓存的前几名为 top[first_top, 下一个节点的 first_top)
+};
+
+// 一条补全结果，text 指向段内的存储，与段同生命周期（查询期间由 IndexView 保持）
+struct SuggestHit {
+    std::string_view text;
+    uint32_t ordinal;
+    uint32_t weight;
+};
+
+// 补全结果的排序：权重降序，再按长度、字典序、文档序号
+inline bool SuggestBefore(const SuggestHit& a, const SuggestHit& b) {
+    if (a.weight != b.weight) {
+        return a.weight > b.weight;
+    }
+    if (a.text.size() != b.text.size()) {
+        return a.text.size() < b.text.size();
+    }
+    if (a.text != b.text) {
+        return a.text < b.text;
+    }
+    return a.ordinal < b.ordinal;
+}
+
+// 排序并去掉重复的补全项（保留排名最前的一条），最多保留 limit 条
+inline void TakeDistinct(std::vector<SuggestHit>* hits, size_t limit) {
+    std::sort(hits->begin(), hits->end(), SuggestBefore);
+    size_t kept = 0;
+    for (size_t i = 0; i < hits->size() && kept < limit; ++i) {
+        bool seen = false;
+        for (size_t j = 0; j < kept && !seen; ++j) {
+            seen = (*hits)[j].text == (*hits)[i].text;
+        }
+        if (!seen) {
+            (*hits)[kept++] = (*hits)[i];
+        }
+    }
+    hits->resize(kept);
+}
+
+// 补全项和查询前缀的规范化：去掉首尾空白，ASCII 转小写
+inline std::string NormalizeSuggestKey(std::string_view text) {
+    size_t begin = 0, end = text.size();
+    while (begin < end && std::isspace(static_cast<unsigned char>(text[begin]))) {
+        ++begin;
+    }
+    while (end > begin && std::isspace(static_cast<unsigned char>(text[end - 1]))) {
+        --end;
+    }
+    std::string key(text.substr(begin, end - begin));
+    std::transform(key.begin(), key.end(), key.begin(), [](unsigned char c) { return std::tolower(c); });
+    return key;
+}
+
+// 逐个产出一个词条的补全项 emit(key, weight)，同一词条内重复的补全项只产出权重最高的一次
+template <typename Emit>
+inline void ForEachSuggestKey(std::string_view title, std::string_view forms, std::string_view senses, Emit emit) {
+    std::vector<std::string> words;
+    size_t start = 0;
+    while (start < forms.size()) {
+        size_t space = forms.find(' ', start);
+        if (space == std::string_view::npos) {
+            space = forms.size();
+        }
+        std::string_view form = forms.substr(start, space - start);
+        while (!form.empty() && std::ispunct(static_cast<unsigned char>(form.front()))) {
+            form.remove_prefix(1);
+        }
+        while (!form.empty() && std::ispunct(static_cast<unsigned char>(form.back()))) {
+            form.remove_suffix(1);
+        }
+        std::string word = NormalizeSuggestKey(form);
+        if (!word.empty()) {
+            words.push_back(std::move(word));
+        }
+        start = space + 1;
+    }
+    uint32_t sense_count = senses.empty() ? 0 : static_cast<uint32_t>(std::count(senses.begin(), senses.end(), ';')) + 1;
+    uint32_t popularity = sense_count + static_cast<uint32_t>(words.size());
+    std::string key = NormalizeSuggestKey(title);
+    if (!key.empty()) {
+        emit(key, popularity * 2 + 1);
+    }
+    std::sort(words.begin(), words.end());
+    words.erase(std::unique(words.begin(), words.end()), words.end());
+    for (const auto& word : words) {
+        if (word != key) {
+            emit(word, popularity * 2);
+        }
+    }
+}
+
+class SuggestIndex {
+public:
+    bool empty() const { return nodes.empty(); }
+
+    std::string_view Key(uint32_t entry) const { return keys.Term(entries[entry].key); }
+    const SuggestEntry& Entry(uint32_t entry) const { return entries[entry]; }
+
+    // 以 prefix（已规范化）开头的补全项中排名最前的至多 limit 个，每个补全项只取 live(文档序号) 为真的权重最高的一条，
+    // 按排名写入 out（entries 下标）。limit 不超过 SUGGEST_CACHE_SIZE 且缓存的前 limit 名都 live 时只读缓存
+    template <typename Live>
+    void Complete(std::string_view prefix, size_t limit, Live live, std::vector<uint32_t>* out) const {
+        out->clear();
+        uint32_t node = 0;
+        if (limit == 0 || empty() || !Descend(prefix, &node)) {
+            return;
+        }
+        Collect(node, limit, live, out);
+    }
+
+    size_t bytes() const {
+        return keys.bytes.size() + keys.offsets.size() * sizeof(uint64_t) + entries.size() * sizeof(SuggestEntry) +
+               nodes.size() * sizeof(SuggestNode) + top.size() * sizeof(uint32_t);
+    }
+
+    bool Validate(size_t doc_count) const {
+        if (nodes.empty()) {
+            return entries.empty();
+        }
+        size_t node_count = nodes.size() - 1;
+        const SuggestNode& sentinel = nodes[node_count];
+        if (sentinel.first_child != node_count || sentinel.first_top != top.size()) {
+            return false;
+        }
+        for (const auto& entry : entries) {
+            if (entry.key >= keys.size() || entry.doc >= doc_count) {
+                return false;
+            }
+        }
+        for (size_t i = 0; i < node_count; ++i) {
+            const SuggestNode& node = nodes[i];
+            if (node.begin >= node.end || node.end > entries.size() || node.first_child > nodes[i + 1].first_child ||
+                node.first_child > node_count || node.first_top > nodes[i + 1].first_top ||
+                node.depth > Key(node.begin).size()) {
+                return false;
+            }
+            // 子节点必须更深，查找时才能取到它们在本节点深度处的字节，并且一定会走到底
+            for (uint32_t child = node.first_child; child < nodes[i + 1].first_child; ++child) {
+                if (nodes[child].depth <= node.depth) {
+                    return false;
+                }
+            }
+        }
+        for (uint32_t entry : top) {
+            if (entry >= entries.size()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Clear() {
+        keys.Clear();
+        entries.Clear();
+        nodes.Clear();
+        top.Clear();
+    }
+
+    TermDictionary keys;
+    ns_util::MappedArray<SuggestEntry> entries;
+    ns_util::MappedArray<SuggestNode> nodes;
+    ns_util::MappedArray<uint32_t> top;
+
+private:
+    bool Before(uint32_t a, uint32_t b) const {
+        if (entries[a].weight != entries[b].weight) {
+            return entries[a].weight > entries[b].weight;
+        }
+        size_t la = Key(a).size(), lb = Key(b).size();
+        if (la != lb) {
+            return la < lb;
+        }
+        return a < b;  // entries 按补全项字典序、文档序号排列
+    }
+
+    // 把 node 子树中排名最前的 limit 个补全项追加到 out
+    template <typename Live>
+    void Collect(uint32_t node, size_t limit, Live& live, std::vector<uint32_t>* out) const {
+        const SuggestNode& current = nodes[node];
+        size_t base = out->size();
+        if (current.end - current.begin <= SUGGEST_CACHE_SIZE) {
+            // 同一补全项的各条按权重降序相邻，第一条 live 的即为它的代表
+            for (uint32_t e = current.begin; e < current.end; ++e) {
+                if (live(entries[e].doc) && (out->size() == base || entries[out->back()].key != entries[e].key)) {
+                    out->push_back(e);
+                }
+            }
+        } else {
+            uint32_t first_top = current.first_top;
+            size_t cached = std::min<size_t>(limit, nodes[node + 1].first_top - first_top);
+            size_t clean = 0;
+            while (clean < cached && live(entries[top[first_top + clean]].doc)) {
+                ++clean;
+            }
+            if (clean == cached && limit <= SUGGEST_CACHE_SIZE) {
+                out->insert(out->end(), top.data() + first_top, top.data() + first_top + cached);
+                return;
+            }
+            // 缓存失效：本节点自己的补全项加上各子节点的前 limit 名
+            for (uint32_t e = current.begin; e < current.end && Key(e).size() == current.depth; ++e) {
+                if (live(entries[e].doc)) {
+                    out->push_back(e);
+                    break;
+                }
+            }
+            for (uint32_t child = current.first_child; child < nodes[node + 1].first_child; ++child) {
+                Collect(child, limit, live, out);
+            }
+        }
+        auto before = [this](uint32_t a, uint32_t b) { return Before(a, b); };
+        size_t kept = std::min(limit, out->size() - base);
+        std::partial_sort(out->begin() + base, out->begin() + base + kept, out->end(), before);
+        out->resize(base + kept);
+    }
+
+    // 找到 prefix 所在的节点：该节点覆盖的补全项恰好是以 prefix 开头的那些
+    bool Descend(std::string_view prefix, uint32_t* found) const {
+        uint32_t node = 0;
+        size_t matched = 0;
+        while (true) {
+            const SuggestNode& current = nodes[node];
+            std::string_view label = Key(current.begin);
+            size_t end = std::min<size_t>(current.depth, prefix.size());
+            if (label.compare(matched, end - matched, prefix, matched, end - matched) != 0) {
+                return false;
+            }
+            if (prefix.size() <= current.depth) {
+                *found = node;
+                return true;
+            }
+            // 子节点按它们在 depth 处的字节升序排列
+            matched = current.depth;
+            uint32_t lo = current.first_child, hi = nodes[node + 1].first_child;
+            unsigned char target = static_cast<unsigned char>(prefix[matched]);
+            while (lo < hi) {
+                uint32_t mid = lo + (hi - lo) / 2;
+                if (static_cast<unsigned char>(Key(nodes[mid].begin)[matched]) < target) {
+                    lo = mid + 1;
+                } else {
+                    hi = mid;
+                }
+            }
+            if (lo == nodes[node + 1].first_child ||
+                static_cast<unsigned char>(Key(nodes[lo].begin)[matched]) != target) {
+                return false;
+            }
+            node = lo;
+        }
+    }
+};
+
+// 构建 SuggestIndex：逐个文档 Add，最后 Finish
+class SuggestBuilder {
+public:
+    void Add(uint32_t ordinal, std::string_view title, std::string_view forms, std::string_view senses) {
+        ForEachSuggestKey(title, forms, senses, [this, ordinal](const std::string& key, uint32_t weight) {
+            items_.push_back({key, ordinal, weight});
+        });
+    }
+
+    void Finish(SuggestIndex* index) {
+        std::sort(items_.begin(), items_.end(), [](const Item& a, const Item& b) {
+            if (a.key != b.key) {
+                return a.key < b.key;
+            }
+            if (a.weight != b.weight) {
+                return a.weight > b.weight;
+            }
+            return a.doc < b.doc;
+        });
+        std::vector<std::string> keys;
+        std::vector<SuggestEntry> entries;
+        entries.reserve(items_.size());
+        for (auto& item : items_) {
+            if (keys.empty() || keys.back() != item.key) {
+                keys.push_back(std::move(item.key));
+            }
+            entries.push_back({static_cast<uint32_t>(keys.size() - 1), item.doc, item.weight});
+        }
+        items_ = std::vector<Item>();
+        index->Clear();
+        index->keys.Build(keys);
+        auto key = [&keys, &entries](uint32_t e) -> const std::string& { return keys[entries[e].key]; };
+
+        // 层序建立基数树：一个节点的区间按 depth 处的字节切分为子节点，depth 为区间内补全项的最长公共前缀
+        std::vector<SuggestNode> nodes;
+        if (!entries.empty()) {
+            nodes.push_back({0, 0, static_cast<uint32_t>(entries.size()), 0, 0});
+        }
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            uint32_t begin = nodes[n].begin, end = nodes[n].end;
+            const std::string& first = key(begin);
+            const std::string& last = key(end - 1);
+            size_t depth = 0;
+            while (depth < first.size() && depth < last.size() && first[depth] == last[depth]) {
+                ++depth;
+            }
+            nodes[n].depth = static_cast<uint32_t>(depth);
+            nodes[n].first_child = static_cast<uint32_t>(nodes.size());
+            // 恰好等于本节点前缀的补全项排在区间最前面，它们不属于任何子节点
+            uint32_t e = begin;
+            while (e < end && key(e).size() == depth) {
+                ++e;
+            }
+            while (e < end) {
+                uint32_t child_end = e + 1;
+                while (child_end < end && key(child_end)[depth] == key(e)[depth]) {
+                    ++child_end;
+                }
+                nodes.push_back({0, e, child_end, 0, 0});
+                e = child_end;
+            }
+        }
+
+        // 自底向上缓存前几名：父节点的候选只来自自己的补全项和各子节点的前几名，每个补全项只取权重最高的一条
+        std::vector<std::vector<uint32_t>> tops(nodes.size());
+        std::vector<uint32_t> candidates;
+        auto before = [&](uint32_t a, uint32_t b) {
+            if (entries[a].weight != entries[b].weight) {
+                return entries[a].weight > entries[b].weight;
+            }
+            if (key(a).size() != key(b).size()) {
+                return key(a).size() < key(b).size();
+            }
+            return a < b;
+        };
+        for (size_t n = nodes.size(); n-- > 0;) {
+            const SuggestNode& node = nodes[n];
+            if (node.end - node.begin <= SUGGEST_CACHE_SIZE) {
+                continue;
+            }
+            candidates.clear();
+            if (key(node.begin).size() == node.depth) {
+                candidates.push_back(node.begin);
+            }
+            uint32_t children_end = n + 1 < nodes.size() ? nodes[n + 1].first_child : static_cast<uint32_t>(nodes.size());
+            for (uint32_t child = node.first_child; child < children_end; ++child) {
+                if (!tops[child].empty()) {
+                    candidates.insert(candidates.end(), tops[child].begin(), tops[child].end());
+                } else {
+                    for (uint32_t e = nodes[child].begin; e < nodes[child].end; ++e) {
+                        if (e == nodes[child].begin || entries[e].key != entries[e - 1].key) {
+                            candidates.push_back(e);
+                        }
+                    }
+                }
+            }
+            size_t kept = std::min(SUGGEST_CACHE_SIZE, candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + kept, candidates.end(), before);
+            tops[n].assign(candidates.begin(), candidates.begin() + kept);
+        }
+        std::vector<uint32_t> top;
+        for (size_t n = 0; n < nodes.size(); ++n) {
+            nodes[n].first_top = static_cast<uint32_t>(top.size());
+            top.insert(top.end(), tops[n].begin(), tops[n].end());
+        }
+        if (!nodes.empty()) {
+            nodes.push_back({0, 0, 0, static_cast<uint32_t>(nodes.size()), static_cast<uint32_t>(top.size())});
+        }
+        index->entries.Assign(std::move(entries));
+        index->nodes.Assign(std::move(nodes));
+        index->top.Assign(std::move(top));
+    }
+
+private:
+    struct Item {
+        std::string key;
+        uint32_t doc;
+        uint32_t weight;
+    };
+    std::vector<Item> items_;
+};
+
+} // namespace ns_index
@@ -3,8 +3,16 @@
 #include <string>
 #include <fstream>
 #include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <exception>
 // #include <boost/algorithm/string.hpp>
 
+#include "lemfileutil.hpp"  // MmapFile、ParseLexemeId 等不依赖分词器的工具
+
 // 引入cppjieba头文件
 #include "cppjieba/Jieba.hpp"  //引入头文件（确保你建立的没有错误才可以使用）
 // 引入s
@@ -33,6 +41,101 @@ namespace ns_util
     }
 
 
+    // 有界阻塞队列：用于生产者/消费者流水线，队列满时生产者阻塞，从而限制在途数据的内存占用
+    template<typename T>
+    class BoundedQueue
+    {
+    public:
+        explicit BoundedQueue(size_t capacity) : capacity_(capacity) {}
+
+        // 队列已关闭时返回 false
+        bool Push(T item)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            not_full_.wait(lock, [this] { return closed_ || queue_.size() < capacity_; });
+            if (closed_) {
+                return false;
+            }
+            queue_.push_back(std::move(item));
+            not_empty_.notify_one();
+            return true;
+        }
+
+        // 队列已关闭且取空时返回 false
+        bool Pop(T *item)
+        {
+            std::unique_lock<std::mutex> lock(mtx_);
+            not_empty_.wait(lock, [this] { return closed_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return false;
+            }
+            *item = std::move(queue_.front());
+            queue_.pop_front();
+            not_full_.notify_one();
+            return true;
+        }
+
+        void Close()
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            closed_ = true;
+            not_empty_.notify_all();
+            not_full_.notify_all();
+        }
+
+    private:
+        size_t capacity_;
+        bool closed_ = false;
+        std::deque<T> queue_;
+        std::mutex mtx_;
+        std::condition_variable not_empty_;
+        std::condition_variable not_full_;
+    };
+
+
+    // 把 [start, end) 的下标动态分发给 threads 个线程执行 fn(i, thread_id)，
+    // 每个线程用原子计数器领取下一个下标，因此各线程负载自动均衡；
+    // 任一线程抛出的异常会在所有线程结束后重新抛给调用方
+    template<typename Function>
+    void ParallelFor(size_t start, size_t end, int threads, Function fn)
+    {
+        if (threads <= 1 || end - start <= 1) {
+            for (size_t i = start; i < end; ++i) {
+                fn(i, 0);
+            }
+            return;
+        }
+        std::atomic<size_t> next(start);
+        std::exception_ptr last_exception = nullptr;
+        std::mutex exception_mtx;
+        std::vector<std::thread> workers;
+        for (int t = 0; t < threads; ++t) {
+            workers.emplace_back([&, t]() {
+                while (true) {
+                    size_t i = next.fetch_add(1);
+                    if (i >= end) {
+                        break;
+                    }
+                    try {
+                        fn(i, t);
+                    } catch (...) {
+                        std::lock_guard<std::mutex> lock(exception_mtx);
+                        last_exception = std::current_exception();
+                        next = end;  // 让其他线程尽快退出
+                        break;
+                    }
+                }
+            });
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        if (last_exception) {
+            std::rethrow_exception(last_exception);
+        }
+    }
+
+
     //下面这5个是分词时所需要的词库路径
     const char* const DICT_PATH = "./src/dict/jieba.dict.utf8";    
     const char* const HMM_PATH = "./src/dict/hmm_model.utf8";    
@@ -50,6 +153,12 @@ namespace ns_util
             //调用CutForSearch函数，第一个参数就是你要对谁进行分词，第二个参数就是分词后的结果存放到哪里
             jieba.CutForSearch(src, *out);    
         }     
+
+        // 精确模式：切分结果互不重叠，相邻的词在原文中也相邻，用于位置倒排和短语查询
+        static void CutPrecise(const std::string &src, std::vector<std::string> *out)
+        {
+            jieba.Cut(src, *out);
+        }
     };
 
     //类外初始化，就是将上面的路径传进去，具体和它的构造函数是相关的，具体可以去看一下源代码
@@ -0,0 +1,79 @@
+// lemvec2bin.cpp
+// 将旧的文本向量文件（每行：id<TAB>lemma<TAB>空格分隔的浮点数）转换为二进制向量文件，
+// 转换后 Index::LoadVectors 可以直接 mmap 读取，不再逐个解析浮点数文本。
+// 用法: ./lemvec2bin [lexeme_vectors.txt] [lexeme_vectors.bin]
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "lemvecfile.hpp"
+
+int main(int argc, char *argv[])
+{
+    std::string inputFile = "./data/lexeme_vectors.txt";
+    std::string outputFile = "./data/lexeme_vectors.bin";
+    if (argc > 1) inputFile = argv[1];
+    if (argc > 2) outputFile = argv[2];
+
+    std::ifstream in(inputFile);
+    if (!in.is_open()) {
+        std::cerr << "无法打开文本向量文件: " << inputFile << std::endl;
+        return 1;
+    }
+
+    ns_vecfile::VecFileWriter writer;
+    std::vector<float> vec;
+    size_t dim = 0;
+    size_t skipped = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.empty())
+            continue;
+        size_t tab1 = line.find('\t');
+        size_t tab2 = tab1 == std::string::npos ? std::string::npos : line.find('\t', tab1 + 1);
+        uint64_t id = 0;
+        if (tab2 == std::string::npos || !ns_util::ParseLexemeId(line.substr(0, tab1), &id)) {
+            ++skipped;
+            continue;
+        }
+        // 用 strtof 原地解析，避免 istringstream 的开销
+        vec.clear();
+        const char *p = line.c_str() + tab2 + 1;
+        char *end = nullptr;
+        while (true) {
+            float val = std::strtof(p, &end);
+            if (end == p)
+                break;
+            vec.push_back(val);
+            p = end;
+        }
+        if (dim == 0) {
+            dim = vec.size();
+            if (dim == 0 || !writer.Open(outputFile, static_cast<uint32_t>(dim))) {
+                std::cerr << "无法创建二进制向量文件: " << outputFile << std::endl;
+                return 1;
+            }
+        }
+        if (vec.size() != dim) {
+            std::cerr << "向量维度不一致，跳过: " << line.substr(0, tab1) << std::endl;
+            ++skipped;
+            continue;
+        }
+        writer.Add(id, vec.data());
+        if (writer.count() % 100000 == 0) {
+            std::cout << "已转换 " << writer.count() << " 个向量" << std::endl;
+        }
+    }
+    if (dim == 0) {
+        std::cerr << "文本向量文件中没有有效数据: " << inputFile << std::endl;
+        return 1;
+    }
+    if (!writer.Finish()) {
+        std::cerr << "写入二进制向量文件失败: " << outputFile << std::endl;
+        return 1;
+    }
+    std::cout << "转换完成，共 " << writer.count() << " 个 " << dim << " 维向量，跳过 " << skipped
+              << " 行，输出文件：" << outputFile << std::endl;
+    return 0;
+}
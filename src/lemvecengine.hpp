@@ -0,0 +1,313 @@
+#pragma once
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <algorithm>
+
+#include "lemutil.hpp"
+#include "lemsnapshot.hpp"
+#include "lemfileutil.hpp"
+#include "lemquantize.hpp"
+#include "lemscoring.hpp"
+
+// 引入 HNSWlib 头文件（假定路径正确）
+#include "hnswlib/hnswlib.h"
+#include "hnswlib/space_ip.h"
+
+// 向量引擎
+// 每个不可变段通过 VectorEngine 接口持有自己的向量索引，查询、合并只依赖这个接口：
+//   HnswEngine   HNSW 图，图中存放 float 向量或 int8 量化编码（见 lemquantize.hpp）
+//   IvfPqEngine  倒排文件 + 乘积量化，每个词条只占几十字节（见 lemivfpq.hpp）
+//   FlatEngine   连续存放的 float 矩阵，暴力扫描得到精确结果（见 lemflat.hpp）
+// 构建时由 BuildOptions::vector_engine 选择，快照的 SECTION_META 记录向量格式，加载时据此恢复对应的引擎。
+// 向量检索的 label 都是段内文档序号，相似度都是内积（向量已归一化，即余弦相似度）。
+
+namespace ns_index {
+
+enum VectorEngineType {
+    VECTOR_ENGINE_HNSW = 0,   // HNSW 图（默认）
+    VECTOR_ENGINE_IVFPQ = 1,  // 倒排文件 + 乘积量化，适合远大于内存的语料
+    VECTOR_ENGINE_FLAT = 2,   // 精确检索，适合小规模语料和召回率评估
+};
+
+// 索引构建参数
+struct BuildOptions {
+    int threads = 0;          // 解析和分词的工作线程数：0 表示使用全部硬件线程，1 表示单线程流式构建
+    int vector_threads = 0;   // 并行插入 HNSW 的线程数：0 表示使用全部硬件线程
+    bool deterministic = false;      // 强制单线程按文档序号插入向量，重复构建得到完全相同的图
+    size_t progress_interval = 5000; // 每插入多少个向量输出一次进度，0 表示不输出
+    size_t mem_segment_docs = 4096;  // 内存段最多容纳的词条数，写满后冻结并在后台封存
+    size_t merge_fanout = 4;         // 同一层级的段达到该数量时在后台合并为一个
+    bool quantize_vectors = false;   // HNSW 中存放 int8 标量量化向量（约为 float 的 1/4），原始向量另存一份用于精排
+    size_t hnsw_m = 16;              // HNSW 每个节点的邻居数（第 0 层为 2M）
+    size_t hnsw_ef_construction = 200;  // HNSW 插入时的候选队列长度
+    VectorEngineType vector_engine = VECTOR_ENGINE_HNSW;  // 不可变段使用的向量引擎
+    size_t ivf_lists = 0;            // IVF-PQ 的倒排列表数，0 表示取 sqrt(向量数)
+    size_t ivf_nprobe = 8;           // IVF-PQ 查询时探查的倒排列表数
+    bool ivf_rerank = false;         // IVF-PQ 另存原始向量（每个多占 dim * 4 字节）并用它精排候选，否则直接按编码的近似内积排序
+    Bm25Params bm25;                 // 倒排打分的 BM25F 参数，构建时据此预先计算每个倒排节点的得分
+    bool positions = true;           // 位置倒排保留词的位置以支持短语，否则只记录文档，短语退化为各词同时出现（见 lempositions.hpp）
+};
+
+// 向量检索的一个结果
+struct VectorHit {
+    uint32_t ordinal;   // 段内文档序号（即 HNSW 的 label）
+    float similarity;   // 内积相似度，越大越相似
+};
+
+// 用原始向量重新计算候选的相似度，按相似度降序保留前 k 个
+template<typename VectorOf>
+void RerankHits(const float* query, size_t dim, size_t k, std::vector<VectorHit>* hits, VectorOf vector_of) {
+    for (auto& hit : *hits) {
+        hit.similarity = ns_quant::Dot(query, vector_of(hit.ordinal), dim);
+    }
+    size_t top = std::min(k, hits->size());
+    std::partial_sort(hits->begin(), hits->begin() + top, hits->end(),
+                      [](const VectorHit& a, const VectorHit& b) { return a.similarity > b.similarity; });
+    hits->resize(top);
+}
+
+class VectorEngine {
+public:
+    virtual ~VectorEngine() {}
+
+    // 快照中记录的向量格式（ns_snapshot::VectorFormat）
+    virtual uint32_t Format() const = 0;
+
+    // 检索与 query 最相似的 k 个文档，结果追加到 hits，已删除的文档不会出现。
+    // candidates 为本次查询的搜索宽度：HNSW 以 max(k, candidates) 作为 ef，量化引擎先取这么多候选再用原始向量精排，
+    // 精确引擎忽略它。搜索宽度只通过参数传入，不修改引擎的共享状态，不同宽度的查询可以并发执行
+    virtual void Search(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const = 0;
+
+    // Search 的结果是否就是精确结果
+    virtual bool Exact() const { return false; }
+
+    // 文档的原始向量（dim 个 float），没有向量、已删除或引擎不保存原始向量时返回 nullptr
+    virtual const float* GetVector(uint32_t ordinal) const = 0;
+
+    // 是否保存了原始向量；不保存时 GetVector 总是返回 nullptr，只能用 DecodeVector 取近似向量
+    virtual bool StoresVectors() const { return true; }
+
+    // 不保存原始向量的引擎把由编码还原的近似向量写入 out（dim 个 float），没有向量或已删除时返回 false
+    virtual bool DecodeVector(uint32_t, float*) const { return false; }
+
+    // 删除文档的向量，之后不再出现在检索结果中
+    virtual void MarkDeleted(uint32_t ordinal) = 0;
+
+    // 写入快照：数组写成 writer 中的 section，其他文件写入 dir
+    virtual bool Save(const std::string& dir, ns_snapshot::SnapshotWriter* writer) const = 0;
+
+    // int8 量化 HNSW 的量化参数，新的内存段沿用它；其他引擎返回 nullptr
+    virtual std::shared_ptr<const ns_quant::ScalarQuantizer> Quantizer() const { return nullptr; }
+};
+
+// HNSW 引擎。float 格式下向量只在 HNSW 内部保存一份；int8 格式下图中存放量化编码，
+// 原始向量另存一份（加载快照时为映射内存）用于精排
+class HnswEngine : public VectorEngine {
+public:
+    explicit HnswEngine(int dim) : dim_(dim) {}
+
+    // 利用 HNSWlib 将每个文档的向量插入到索引中（addPoint 支持多线程并发调用），sources 中缺失的为 nullptr
+    bool Build(const std::vector<const float*>& sources, size_t doc_count, const BuildOptions& options);
+
+    // 从快照目录恢复：vector.hnsw 由 hnswlib 自带的 loadIndex 读取，量化参数和原始向量来自 reader
+    bool Load(const std::string& dir, const ns_snapshot::SnapshotReader& reader, uint32_t format, size_t doc_count);
+
+    uint32_t Format() const override { return quantizer_ ? ns_snapshot::VECTOR_INT8 : ns_snapshot::VECTOR_FLOAT; }
+    void Search(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const override;
+    const float* GetVector(uint32_t ordinal) const override;
+    void MarkDeleted(uint32_t ordinal) override;
+    bool Save(const std::string& dir, ns_snapshot::SnapshotWriter* writer) const override;
+    std::shared_ptr<const ns_quant::ScalarQuantizer> Quantizer() const override { return quantizer_; }
+
+    hnswlib::HierarchicalNSW<float>* Graph() const { return index_.get(); }
+
+private:
+    int dim_;
+    std::unique_ptr<hnswlib::SpaceInterface<float>> space_;      // 距离空间（必须比 index_ 活得久）
+    std::unique_ptr<hnswlib::HierarchicalNSW<float>> index_;
+    std::shared_ptr<const ns_quant::ScalarQuantizer> quantizer_; // int8 格式的每维偏移和步长
+    ns_util::MappedArray<float> exact_vectors_;                  // int8 格式：文档序号 -> 原始向量，每行 dim 个
+};
+
+bool HnswEngine::Build(const std::vector<const float*>& sources, size_t doc_count, const BuildOptions& options) {
+    // HNSW 的 label 直接使用文档序号，检索结果无需再经过哈希表换算
+    std::vector<uint32_t> docs;
+    docs.reserve(doc_count);
+    for (size_t ordinal = 0; ordinal < doc_count; ++ordinal) {
+        if (ordinal < sources.size() && sources[ordinal] != nullptr) {
+            docs.push_back(static_cast<uint32_t>(ordinal));
+        }
+    }
+
+    // 使用 InnerProductSpace，假设向量已归一化，则内积即为余弦相似度。
+    // 量化时先按全部向量训练每维的偏移和步长，HNSW 中存放编码，原始向量拷贝一份供精排使用
+    if (options.quantize_vectors) {
+        auto quantizer = std::make_shared<ns_quant::ScalarQuantizer>();
+        quantizer->Train(sources, dim_);
+        quantizer_ = quantizer;
+        space_.reset(new ns_quant::Int8InnerProductSpace(*quantizer_));
+        std::vector<float> exact(doc_count * dim_, 0.0f);
+        for (uint32_t ordinal : docs) {
+            std::copy(sources[ordinal], sources[ordinal] + dim_, exact.data() + static_cast<size_t>(ordinal) * dim_);
+        }
+        exact_vectors_.Assign(std::move(exact));
+    } else {
+        quantizer_.reset();
+        space_.reset(new hnswlib::InnerProductSpace(dim_));
+    }
+    size_t max_elements = std::max<size_t>(doc_count, 1);
+    index_.reset(new hnswlib::HierarchicalNSW<float>(space_.get(), max_elements, options.hnsw_m,
+                                                     options.hnsw_ef_construction));
+
+    int threads = options.vector_threads > 0 ? options.vector_threads
+                                             : static_cast<int>(std::thread::hardware_concurrency());
+    if (options.deterministic) {
+        threads = 1;  // 并发插入时图的结构取决于线程调度
+    }
+    std::vector<std::vector<char>> codes(std::max(threads, 1));  // 每个线程一个编码缓冲区
+    if (quantizer_) {
+        for (auto& code : codes) {
+            code.resize(quantizer_->code_size());
+        }
+    }
+    size_t interval = options.progress_interval;
+    std::atomic<size_t> count(0);
+    std::mutex progress_mtx;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        ns_util::ParallelFor(0, docs.size(), threads, [&](size_t i, int tid) {
+            if (quantizer_) {
+                quantizer_->Encode(sources[docs[i]], codes[tid].data());
+                index_->addPoint(codes[tid].data(), docs[i]);
+            } else {
+                index_->addPoint(sources[docs[i]], docs[i]);
+            }
+            size_t done = ++count;
+            if (interval > 0 && done % interval == 0) {
+                double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                std::lock_guard<std::mutex> lock(progress_mtx);
+                std::cout << "向量索引构建中：第 " << done << "/" << docs.size() << " 个向量构建完成，"
+                          << "耗时 " << secs << " 秒。" << std::endl;
+            }
+        });
+    } catch (const std::exception& e) {
+        std::cerr << "插入向量失败: " << e.what() << std::endl;
+        return false;
+    }
+    if (interval > 0) {
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        std::cout << "向量索引构建完毕（" << std::max(threads, 1) << " 个线程），共 " << count.load()
+                  << " 个向量，耗时 " << secs << " 秒。" << std::endl;
+    }
+    return true;
+}
+
+bool HnswEngine::Load(const std::string& dir, const ns_snapshot::SnapshotReader& reader, uint32_t format, size_t doc_count) {
+    if (format == ns_snapshot::VECTOR_INT8) {
+        // 量化参数很小，拷贝出来；精排向量直接映射，查询时只有被精排的候选才会调入内存
+        ns_util::MappedArray<float> offsets, scales;
+        if (!reader.GetArray(ns_snapshot::SECTION_QUANT_OFFSETS, &offsets) ||
+            !reader.GetArray(ns_snapshot::SECTION_QUANT_SCALES, &scales) ||
+            !reader.GetArray(ns_snapshot::SECTION_EXACT_VECTORS, &exact_vectors_) ||
+            offsets.size() != static_cast<size_t>(dim_) || scales.size() != static_cast<size_t>(dim_) ||
+            exact_vectors_.size() != doc_count * dim_) {
+            std::cerr << "快照量化向量损坏。" << std::endl;
+            return false;
+        }
+        auto quantizer = std::make_shared<ns_quant::ScalarQuantizer>();
+        quantizer->Init(std::vector<float>(offsets.begin(), offsets.end()), std::vector<float>(scales.begin(), scales.end()));
+        quantizer_ = quantizer;
+    }
+    // HNSW 图通过 hnswlib 自带的 loadIndex 恢复，无需重新插入
+    try {
+        if (quantizer_) {
+            space_.reset(new ns_quant::Int8InnerProductSpace(*quantizer_));
+        } else {
+            space_.reset(new hnswlib::InnerProductSpace(dim_));
+        }
+        index_.reset(new hnswlib::HierarchicalNSW<float>(space_.get(), dir + "/vector.hnsw"));
+    } catch (const std::exception& e) {
+        std::cerr << "加载向量索引失败: " << e.what() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HnswEngine::Save(const std::string& dir, ns_snapshot::SnapshotWriter* writer) const {
+    try {
+        index_->saveIndex(dir + "/vector.hnsw");
+    } catch (const std::exception& e) {
+        std::cerr << "保存向量索引失败: " << e.what() << std::endl;
+        return false;
+    }
+    if (quantizer_) {
+        writer->PutArray(ns_snapshot::SECTION_QUANT_OFFSETS, quantizer_->offsets().data(), quantizer_->offsets().size());
+        writer->PutArray(ns_snapshot::SECTION_QUANT_SCALES, quantizer_->scales().data(), quantizer_->scales().size());
+        writer->PutArray(ns_snapshot::SECTION_EXACT_VECTORS, exact_vectors_.data(), exact_vectors_.size());
+    }
+    return true;
+}
+
+void HnswEngine::Search(const float* query, size_t k, size_t candidates, std::vector<VectorHit>* hits) const {
+    std::vector<VectorHit> found;
+    if (quantizer_) {
+        std::vector<char> code(quantizer_->code_size());
+        quantizer_->Encode(query, code.data());
+        auto result = index_->searchKnn(code.data(), std::max(k, candidates));
+        while (!result.empty()) {
+            found.push_back({static_cast<uint32_t>(result.top().second), 0.0f});
+            result.pop();
+        }
+        RerankHits(query, dim_, k, &found, [this](uint32_t ordinal) {
+            return exact_vectors_.data() + static_cast<size_t>(ordinal) * dim_;
+        });
+    } else {
+        // hnswlib 的 searchKnn 以 max(ef_, k) 为候选队列长度，而 ef_ 是整个索引共享的状态（setEf 会与并发查询竞争）。
+        // 这里不调用 setEf，保持 ef_ 为默认的最小值，把本次查询的 ef 作为 k 传入，再只保留距离最近的 k 个
+        auto result = index_->searchKnn(query, std::max(k, candidates));
+        while (result.size() > k) {
+            result.pop();
+        }
+        while (!result.empty()) {
+            // InnerProductSpace 返回 1 - 内积
+            found.push_back({static_cast<uint32_t>(result.top().second), 1 - result.top().first});
+            result.pop();
+        }
+    }
+    hits->insert(hits->end(), found.begin(), found.end());
+}
+
+const float* HnswEngine::GetVector(uint32_t ordinal) const {
+    hnswlib::tableint internal_id;
+    {
+        std::lock_guard<std::mutex> lock(index_->label_lookup_lock);
+        auto it = index_->label_lookup_.find(ordinal);
+        if (it == index_->label_lookup_.end()) {
+            return nullptr;
+        }
+        internal_id = it->second;
+    }
+    if (index_->isMarkedDeleted(internal_id)) {
+        return nullptr;
+    }
+    if (quantizer_) {
+        return exact_vectors_.data() + static_cast<size_t>(ordinal) * dim_;
+    }
+    return reinterpret_cast<const float*>(index_->getDataByInternalId(internal_id));
+}
+
+void HnswEngine::MarkDeleted(uint32_t ordinal) {
+    try {
+        index_->markDelete(ordinal);
+    } catch (const std::exception&) {
+        // 该文档没有向量，HNSW 中不存在对应的 label
+    }
+}
+
+} // namespace ns_index
@@ -0,0 +1,135 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+
+#include "lemfileutil.hpp"
+
+// 二进制向量文件格式（lexeme_vectors.bin）
+//   [VecFileHeader 64 字节][count * dim 个 float32，行主序][count 个 uint64 词条ID]
+// header 固定 64 字节，保证 mmap 后向量矩阵按 64 字节对齐，可以直接交给 SIMD 代码读取。
+// 由 model/sentence-bert/vectorize.py --format bin 生成，旧的文本文件可以用 lemvec2bin 转换。
+
+namespace ns_vecfile
+{
+    const char VECFILE_MAGIC[8] = {'L', 'E', 'M', 'V', 'E', 'C', '\0', '\0'};
+    const uint32_t VECFILE_VERSION = 1;
+
+    struct VecFileHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t dim;
+        uint64_t count;
+        char reserved[40];
+    };
+    static_assert(sizeof(VecFileHeader) == 64, "VecFileHeader 必须为 64 字节");
+
+    // 判断文件是否为二进制向量文件（只检查 magic）
+    inline bool IsVecFile(const std::string &path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        char magic[8] = {0};
+        in.read(magic, sizeof(magic));
+        return in.gcount() == sizeof(magic) && std::memcmp(magic, VECFILE_MAGIC, sizeof(magic)) == 0;
+    }
+
+    // 顺序写入：向量边写边落盘，只有 ID 列暂存在内存中，Finish 时追加到文件末尾并回填 header
+    class VecFileWriter
+    {
+    public:
+        bool Open(const std::string &path, uint32_t dim)
+        {
+            dim_ = dim;
+            ids_.clear();
+            out_.open(path, std::ios::binary | std::ios::trunc);
+            if (!out_.is_open()) {
+                return false;
+            }
+            VecFileHeader header{};
+            out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            return out_.good();
+        }
+
+        void Add(uint64_t id, const float *vec)
+        {
+            out_.write(reinterpret_cast<const char*>(vec), sizeof(float) * dim_);
+            ids_.push_back(id);
+        }
+
+        bool Finish()
+        {
+            out_.write(reinterpret_cast<const char*>(ids_.data()), sizeof(uint64_t) * ids_.size());
+            VecFileHeader header{};
+            std::memcpy(header.magic, VECFILE_MAGIC, sizeof(header.magic));
+            header.version = VECFILE_VERSION;
+            header.dim = dim_;
+            header.count = ids_.size();
+            out_.seekp(0);
+            out_.write(reinterpret_cast<const char*>(&header), sizeof(header));
+            out_.close();
+            return !out_.fail();
+        }
+
+        size_t count() const { return ids_.size(); }
+
+    private:
+        std::ofstream out_;
+        uint32_t dim_ = 0;
+        std::vector<uint64_t> ids_;
+    };
+
+    // 通过 mmap 只读访问二进制向量文件，向量和 ID 都直接指向映射内存，不做拷贝
+    class VecFileReader
+    {
+    public:
+        bool Open(const std::string &path)
+        {
+            if (!file_.Open(path)) {
+                std::cerr << "无法映射向量文件: " << path << std::endl;
+                return false;
+            }
+            if (file_.size() < sizeof(VecFileHeader)) {
+                std::cerr << "向量文件已损坏: " << path << std::endl;
+                return false;
+            }
+            std::memcpy(&header_, file_.data(), sizeof(header_));
+            if (std::memcmp(header_.magic, VECFILE_MAGIC, sizeof(header_.magic)) != 0) {
+                std::cerr << "不是有效的二进制向量文件: " << path << std::endl;
+                return false;
+            }
+            if (header_.version != VECFILE_VERSION) {
+                std::cerr << "向量文件版本不匹配: 文件为 v" << header_.version
+                          << "，程序需要 v" << VECFILE_VERSION << std::endl;
+                return false;
+            }
+            uint64_t expect = sizeof(VecFileHeader) +
+                              header_.count * (sizeof(float) * header_.dim + sizeof(uint64_t));
+            if (file_.size() < expect) {
+                std::cerr << "向量文件长度不足，可能未写完: " << path << std::endl;
+                return false;
+            }
+            vectors_ = reinterpret_cast<const float*>(file_.data() + sizeof(VecFileHeader));
+            ids_ = file_.data() + sizeof(VecFileHeader) + header_.count * sizeof(float) * header_.dim;
+            return true;
+        }
+
+        size_t count() const { return header_.count; }
+        size_t dim() const { return header_.dim; }
+        const float* vector(size_t i) const { return vectors_ + i * header_.dim; }
+        uint64_t id(size_t i) const
+        {
+            uint64_t value;  // ID 列不一定 8 字节对齐，用 memcpy 读取
+            std::memcpy(&value, ids_ + i * sizeof(uint64_t), sizeof(value));
+            return value;
+        }
+
+    private:
+        ns_util::MmapFile file_;
+        VecFileHeader header_{};
+        const float *vectors_ = nullptr;
+        const char *ids_ = nullptr;
+    };
+}
@@ -21,13 +21,13 @@ std::string LoadFile(const std::string &filename) {
 int main() {
     // 定义输入 JSON 文件、输出向量文件和模型名称（这里使用默认模型名称）
     std::string inputFile = "./data/simplified_lexemes.json";
-    std::string outputFile = "./data/lexeme_vectors.txt";
+    std::string outputFile = "./data/lexeme_vectors.bin";  // 二进制格式，见 lemvecfile.hpp
     std::string modelName = "all-MiniLM-L6-v2";
 
     // 构造调用命令，注意用引号包裹路径以防止空格问题
     std::string command = "python3 ./model/sentence-bert/vectorize.py --input \"" 
                             + inputFile + "\" --output \"" + outputFile 
-                            + "\" --model \"" + modelName + "\"" ;
+                            + "\" --model \"" + modelName + "\" --format bin" ;
                             
     std::cout << "执行命令: " << command << std::endl;
     
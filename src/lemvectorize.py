@@ -4,7 +4,27 @@ import json
 import numpy as np
 from sentence_transformers import SentenceTransformer
 
+def batch_main():
+    # 批量模式：标准输入每行一条文本，按输入顺序每行输出一个向量。模型只加载一次
+    data = sys.stdin.buffer.read().decode("utf-8", errors="replace")
+    texts = data.split("\n")
+    if texts and texts[-1] == "":
+        texts.pop()
+    if not texts:
+        return
+    model = SentenceTransformer('./model/sentence-bert/all-MiniLM-L6-v2')
+    embeddings = model.encode(texts)
+    for embedding in embeddings:
+        norm = np.linalg.norm(embedding)
+        if norm > 0:
+            embedding = embedding / norm
+        print(",".join(f"{x:.6f}" for x in embedding))
+
 def main():
+    if len(sys.argv) > 1 and sys.argv[1] == "--batch":
+        batch_main()
+        return
+
     # 从命令行参数或标准输入读取文本
     if len(sys.argv) > 1:
         input_text = sys.argv[1]
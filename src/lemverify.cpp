@@ -0,0 +1,261 @@
+// lemverify.cpp
+// 检索结果的一致性校验：在同一份索引上用快速路径和直接的实现各算一遍，逐个比较，用于修改打分、剪枝、缓存代码后回归。
+//   1. 倒排 top-k：Block-Max WAND（InvertedSearch 带 top_k）与全量检索 InvertedSearchAll 排序后的前 k 个得分一致；
+//   2. 模糊查词：FuzzyScan（共享前缀、剪枝跳段）与对整个词典逐个计算 BoundedEditDistance 找出的词和距离一致；
+//   3. 前缀补全：SuggestIndex::Complete（读缓存、缓存失效时展开子树）与逐个检查全部补全项的排序结果一致，
+//      另用一个随机剔除部分文档的 live 过滤强制缓存失效。
+// 索引按较小的内存段构建，随后重新写入一批随机词条，检索时视图中同时有多个不可变段、内存段和删除标记；
+// 后台合并完成后再校验一遍。
+// 用法: ./lemverify [--queries N] [--updates N] [simplified_lexemes.json] [lexeme_vectors.bin]
+//   --queries N   每项校验的随机查询数，默认 500
+//   --updates N   构建后重新写入的词条数，默认 1000
+// 全部一致时退出码为 0，否则为 1
+#include <cstdlib>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <jsoncpp/json/json.h>
+#include "lemsearcher.hpp"
+
+// 把字符序列编码回 UTF-8；NextFuzzyChar 解出的非法字节（0x110000 + 字节值）原样写回
+static std::string EncodeChars(const std::vector<uint32_t> &chars)
+{
+    std::string s;
+    for (uint32_t c : chars) {
+        if (c >= 0x110000) {
+            s += static_cast<char>(c - 0x110000);
+        } else if (c < 0x80) {
+            s += static_cast<char>(c);
+        } else if (c < 0x800) {
+            s += static_cast<char>(0xc0 | (c >> 6));
+            s += static_cast<char>(0x80 | (c & 0x3f));
+        } else if (c < 0x10000) {
+            s += static_cast<char>(0xe0 | (c >> 12));
+            s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+            s += static_cast<char>(0x80 | (c & 0x3f));
+        } else {
+            s += static_cast<char>(0xf0 | (c >> 18));
+            s += static_cast<char>(0x80 | ((c >> 12) & 0x3f));
+            s += static_cast<char>(0x80 | ((c >> 6) & 0x3f));
+            s += static_cast<char>(0x80 | (c & 0x3f));
+        }
+    }
+    return s;
+}
+
+// 倒排 top-k：随机取几个词条的标题和词形拼成查询，比较两条路径排序后的前 k 个得分
+static size_t VerifyTopK(const ns_index::IndexView &view, const Json::Value &lexemes, size_t queries, std::mt19937 &rng)
+{
+    ns_searcher::Searcher searcher;
+    size_t mismatches = 0;
+    for (size_t q = 0; q < queries; ++q) {
+        std::string query;
+        size_t words = 1 + rng() % 4;
+        for (size_t w = 0; w < words; ++w) {
+            const Json::Value &lex = lexemes[static_cast<Json::ArrayIndex>(rng() % lexemes.size())];
+            const Json::Value &forms = lex["forms"];
+            if (forms.isArray() && forms.size() > 0 && rng() % 2 == 0)
+                query += forms[static_cast<Json::ArrayIndex>(rng() % forms.size())].asString() + " ";
+            else
+                query += lex.get("lemma", "").asString() + " ";
+        }
+        // 去掉 +、-、引号，否则会被解析为布尔条件（如词形 "-cosm"），走不到 top-k 路径
+        for (char &c : query) {
+            if (c == '+' || c == '-' || c == '"')
+                c = ' ';
+        }
+        size_t k = 1 + rng() % 50;
+        std::vector<ns_searcher::InvertedElemPrint> top, all;
+        searcher.InvertedSearch(view, query, top, k);
+        std::vector<ns_searcher::QueryTerm> terms;
+        ns_searcher::Searcher::ParseQuery(query, &terms);
+        ns_index::Bm25FScorer scorer = ns_searcher::Searcher::ViewScorer(view);
+        ns_searcher::Searcher::WeighTerms(view, scorer, &terms);
+        ns_searcher::Searcher::InvertedSearchAll(view, scorer, terms, all);
+        auto greater = [](const ns_searcher::InvertedElemPrint &a, const ns_searcher::InvertedElemPrint &b) { return a.weight > b.weight; };
+        std::sort(top.begin(), top.end(), greater);
+        std::sort(all.begin(), all.end(), greater);
+        // 得分相同的文档谁进前 k 不确定，只比较得分
+        bool same = top.size() == std::min(k, all.size());
+        for (size_t i = 0; same && i < top.size(); ++i)
+            same = std::fabs(top[i].weight - all[i].weight) <= 1e-4f * std::max(1.0f, all[i].weight);
+        if (!same) {
+            ++mismatches;
+            std::cerr << "top-k 不一致: \"" << query << "\" k=" << k << "，WAND 返回 " << top.size()
+                      << " 个，全量检索前 k 个为 " << std::min(k, all.size()) << " 个" << std::endl;
+        }
+    }
+    return mismatches;
+}
+
+// 模糊查词：从词典中随机取词做一两次编辑（删除、替换、交换、插入，偶尔改坏一个字节），
+// 在每个不可变段的词典上比较 FuzzyScan 与逐词计算的结果
+static size_t VerifyFuzzy(const ns_index::IndexView &view, size_t queries, std::mt19937 &rng)
+{
+    size_t mismatches = 0;
+    for (const auto &segment : view.set->segments) {
+        const ns_index::TermDictionary &dictionary = segment->Dictionary();
+        if (dictionary.size() == 0)
+            continue;
+        for (size_t q = 0; q < queries; ++q) {
+            std::vector<uint32_t> chars, other;
+            ns_index::DecodeFuzzyChars(dictionary.Term(rng() % dictionary.size()), &chars);
+            ns_index::DecodeFuzzyChars(dictionary.Term(rng() % dictionary.size()), &other);
+            size_t edits = 1 + rng() % 2;
+            for (size_t e = 0; e < edits && !chars.empty(); ++e) {
+                size_t pos = rng() % chars.size();
+                uint32_t c = other.empty() ? 'x' : other[rng() % other.size()];
+                switch (rng() % 5) {
+                case 0: chars.erase(chars.begin() + pos); break;
+                case 1: chars[pos] = c; break;
+                case 2: if (pos + 1 < chars.size()) std::swap(chars[pos], chars[pos + 1]); break;
+                case 3: chars.insert(chars.begin() + pos, c); break;
+                default: chars[pos] = 0x110000 + 0x80 + rng() % 0x40; break;
+                }
+            }
+            std::string word = EncodeChars(chars);
+            uint32_t max_distance = ns_index::FuzzyMaxDistance(word);
+            if (max_distance == 0)
+                continue;
+            std::vector<std::pair<uint32_t, uint32_t>> scanned, expected;
+            ns_index::FuzzyScan(dictionary, word, max_distance, [&scanned](uint32_t id, uint32_t distance) {
+                scanned.emplace_back(id, distance);
+            });
+            std::vector<uint32_t> word_chars, term_chars;
+            ns_index::DecodeFuzzyChars(word, &word_chars);
+            for (uint32_t id = 0; id < dictionary.size(); ++id) {
+                ns_index::DecodeFuzzyChars(dictionary.Term(id), &term_chars);
+                uint32_t distance = ns_index::BoundedEditDistance(term_chars, word_chars, max_distance);
+                if (distance <= max_distance)
+                    expected.emplace_back(id, distance);
+            }
+            if (scanned != expected) {
+                ++mismatches;
+                std::cerr << "模糊查词不一致: \"" << word << "\" 距离 " << max_distance << "，FuzzyScan 找到 " << scanned.size()
+                          << " 个，逐词计算 " << expected.size() << " 个" << std::endl;
+            }
+        }
+    }
+    return mismatches;
+}
+
+// 逐个检查全部补全项：每个补全项取第一条 live 的（同一补全项的各条按权重降序相邻），再按 Complete 的顺序排序
+template <typename Live>
+static void CompleteByScan(const ns_index::SuggestIndex &suggest, const std::string &prefix, size_t limit, Live live,
+                           std::vector<uint32_t> *out)
+{
+    out->clear();
+    for (uint32_t e = 0; e < suggest.entries.size(); ++e) {
+        std::string_view key = suggest.Key(e);
+        if (key.compare(0, prefix.size(), prefix) != 0 || !live(suggest.Entry(e).doc))
+            continue;
+        if (out->empty() || suggest.Entry(out->back()).key != suggest.Entry(e).key)
+            out->push_back(e);
+    }
+    std::sort(out->begin(), out->end(), [&suggest](uint32_t a, uint32_t b) {
+        if (suggest.Entry(a).weight != suggest.Entry(b).weight)
+            return suggest.Entry(a).weight > suggest.Entry(b).weight;
+        if (suggest.Key(a).size() != suggest.Key(b).size())
+            return suggest.Key(a).size() < suggest.Key(b).size();
+        return a < b;
+    });
+    out->resize(std::min(limit, out->size()));
+}
+
+// 前缀补全：随机取补全项的前缀，分别用段的删除标记和额外剔除约 1/8 文档的过滤比较 Complete 与逐个检查的结果
+static size_t VerifySuggest(const ns_index::IndexView &view, size_t queries, std::mt19937 &rng)
+{
+    size_t mismatches = 0;
+    for (const auto &segment : view.set->segments) {
+        const ns_index::SuggestIndex &suggest = segment->Suggestions();
+        if (suggest.empty())
+            continue;
+        const ns_index::Segment *source = segment.get();
+        auto live = [source](uint32_t ordinal) { return !source->IsDeleted(ordinal); };
+        auto sparse = [source](uint32_t ordinal) { return !source->IsDeleted(ordinal) && (ordinal * 2654435761u) >> 29 != 0; };
+        std::vector<uint32_t> got, expected;
+        for (size_t q = 0; q < queries; ++q) {
+            std::string_view key = suggest.Key(rng() % suggest.entries.size());
+            std::string prefix(key.substr(0, 1 + rng() % key.size()));
+            size_t limit = 1 + rng() % ns_index::SUGGEST_CACHE_SIZE;
+            for (int filter = 0; filter < 2; ++filter) {
+                if (filter == 0) {
+                    suggest.Complete(prefix, limit, live, &got);
+                    CompleteByScan(suggest, prefix, limit, live, &expected);
+                } else {
+                    suggest.Complete(prefix, limit, sparse, &got);
+                    CompleteByScan(suggest, prefix, limit, sparse, &expected);
+                }
+                if (got != expected) {
+                    ++mismatches;
+                    std::cerr << "前缀补全不一致: \"" << prefix << "\" limit=" << limit << (filter == 0 ? "" : "（剔除部分文档）")
+                              << "，Complete 返回 " << got.size() << " 个，逐个检查 " << expected.size() << " 个" << std::endl;
+                }
+            }
+        }
+    }
+    return mismatches;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string input = "./data/simplified_lexemes.json";
+    std::string vector_input = "./data/lexeme_vectors.bin";
+    size_t queries = 500;
+    size_t updates = 1000;
+    std::vector<std::string> args;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--queries" && i + 1 < argc) {
+            queries = std::strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--updates" && i + 1 < argc) {
+            updates = std::strtoul(argv[++i], nullptr, 10);
+        } else {
+            args.push_back(arg);
+        }
+    }
+    if (args.size() > 0) input = args[0];
+    if (args.size() > 1) vector_input = args[1];
+
+    std::ifstream in(input);
+    Json::Value lexemes;
+    Json::CharReaderBuilder builder;
+    std::string errs;
+    if (!in || !Json::parseFromStream(builder, in, &lexemes, &errs) || !lexemes.isArray() || lexemes.size() == 0) {
+        std::cerr << "读取词条文件失败: " << input << std::endl;
+        return 1;
+    }
+    ns_index::BuildOptions options;
+    options.mem_segment_docs = 256;
+    options.progress_interval = 0;
+    auto index = std::make_shared<ns_index::Index>();
+    if (!index->BuildIndex(input, vector_input, options)) {
+        std::cerr << "索引构建失败。" << std::endl;
+        return 1;
+    }
+    std::mt19937 rng(20240521);
+    std::string err;
+    for (size_t i = 0; i < updates; ++i) {
+        if (!index->UpsertLexeme(lexemes[static_cast<Json::ArrayIndex>(rng() % lexemes.size())], {}, &err))
+            std::cerr << "写入词条失败: " << err << std::endl;
+    }
+
+    size_t total = 0;
+    for (int stage = 0; stage < 2; ++stage) {
+        if (stage == 1)
+            index->WaitForMerges();
+        ns_index::IndexView view = index->Acquire();
+        std::cout << (stage == 0 ? "写入后" : "合并后") << "：" << view.set->segments.size() << " 个不可变段，" << view.mem_segments.size() << " 个内存段" << std::endl;
+        size_t topk = VerifyTopK(view, lexemes, queries, rng);
+        size_t fuzzy = VerifyFuzzy(view, queries, rng);
+        size_t suggest = VerifySuggest(view, queries, rng);
+        std::cout << "  倒排 top-k 不一致 " << topk << " 个，模糊查词不一致 " << fuzzy << " 个，前缀补全不一致 " << suggest << " 个" << std::endl;
+        total += topk + fuzzy + suggest;
+    }
+    std::cout << (total == 0 ? "校验通过。" : "校验失败。") << std::endl;
+    return total == 0 ? 0 : 1;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+#include "lempostings.hpp"
+
+// Block-Max WAND：按文档序号（doc-at-a-time）同时推进各查询词的拉链，只为可能进入前 k 的文档计算得分。
+// 每个游标有两级上界：整条拉链的最大得分（term_max）和当前块的最大得分（block_max，见 lempostings.hpp）。
+//   1. 游标按当前文档序号排序，累加各词的整条拉链上界，第一个使累加值超过门槛（当前第 k 名的得分）的位置为枢轴，
+//      排在枢轴之前的文档只可能命中上界之和不超过门槛的那些词，直接跳过；
+//   2. 再用枢轴文档所在块的块上界之和复核，仍不超过门槛时，这些块里剩下的文档都进不了前 k，
+//      游标整块跳到块末之后（只看跳表项，不解压）；
+//   3. 通过两级检查的文档才真正累加得分并交给收集器。
+// 门槛由收集器维护：跨段检索时共用同一个收集器，前面的段填满前 k 之后，后面的段从一开始就能剪枝。
+
+namespace ns_index {
+
+// 参与求值的一个查询词
+struct WandTerm {
+    InvertedList list;
+    float weight = 1.0f;      // 该词在查询中出现的次数，得分按此加权
+    uint32_t query_term = 0;  // 查询词下标（< 64），命中的词以位掩码交给收集器
+};
+
+// Collector 需提供：
+//   float Threshold() const                                 文档得分必须大于它才可能进入前 k
+//   void Collect(uint32_t doc, float score, uint64_t mask)  收下一个得分大于门槛的文档，mask 为命中的查询词
+// skip(doc) 为 true 的文档（已删除）照常推进游标，但不交给收集器
+template<typename Skip, typename Collector>
+void BlockMaxWand(const std::vector<WandTerm>& terms, Skip skip, Collector* collector) {
+    struct Cursor {
+        explicit Cursor(const WandTerm& term)
+            : posting(term.list), weight(term.weight), upper(term.list.max_impact * term.weight),
+              bit(uint64_t(1) << term.query_term) {}
+        PostingCursor posting;
+        float weight;
+        float upper;    // 整条拉链的得分上界（已乘权重）
+        uint64_t bit;
+    };
+    // 游标的当前块可能指向自身的解压缓冲区，不能搬动，用 deque 原地构造
+    std::deque<Cursor> cursors;
+    std::vector<Cursor*> order;
+    for (const auto& term : terms) {
+        cursors.emplace_back(term);
+    }
+    for (auto& cursor : cursors) {
+        if (cursor.posting.valid()) {
+            order.push_back(&cursor);
+        }
+    }
+
+    while (true) {
+        order.erase(std::remove_if(order.begin(), order.end(), [](const Cursor* c) { return !c->posting.valid(); }),
+                    order.end());
+        if (order.empty()) {
+            break;
+        }
+        // 游标数很少且每轮只有少数几个前进，插入排序接近线性
+        for (size_t i = 1; i < order.size(); ++i) {
+            Cursor* cursor = order[i];
+            size_t j = i;
+            for (; j > 0 && order[j - 1]->posting.doc() > cursor->posting.doc(); --j) {
+                order[j] = order[j - 1];
+            }
+            order[j] = cursor;
+        }
+
+        // 1. 找枢轴
+        float threshold = collector->Threshold();
+        float upper = 0.0f;
+        size_t pivot = order.size();
+        for (size_t i = 0; i < order.size(); ++i) {
+            upper += order[i]->upper;
+            if (upper > threshold) {
+                pivot = i;
+                break;
+            }
+        }
+        if (pivot == order.size()) {
+            break;  // 剩下的文档即使命中全部查询词也进不了前 k
+        }
+        uint32_t doc = order[pivot]->posting.doc();
+        while (pivot + 1 < order.size() && order[pivot + 1]->posting.doc() == doc) {
+            ++pivot;
+        }
+
+        // 2. 块上界复核
+        float block_upper = 0.0f;
+        for (size_t i = 0; i <= pivot; ++i) {
+            block_upper += order[i]->posting.ShallowSkipTo(doc) * order[i]->weight;
+        }
+        if (block_upper <= threshold) {
+            // [doc, next) 中的文档只可能出现在前 pivot + 1 个游标的当前块里，整体跳过
+            uint64_t next = uint64_t(UINT32_MAX) + 1;
+            for (size_t i = 0; i <= pivot; ++i) {
+                next = std::min(next, uint64_t(order[i]->posting.shallow_last_doc()) + 1);
+            }
+            if (pivot + 1 < order.size()) {
+                next = std::min(next, uint64_t(order[pivot + 1]->posting.doc()));
+            }
+            if (next > UINT32_MAX) {
+                break;
+            }
+            for (size_t i = 0; i <= pivot; ++i) {
+                order[i]->posting.SkipTo(static_cast<uint32_t>(next));
+            }
+            continue;
+        }
+
+        // 3. 前面的游标都已对齐到枢轴文档时计算得分，否则先把它们推进到枢轴文档
+        if (order[0]->posting.doc() == doc) {
+            float score = 0.0f;
+            uint64_t mask = 0;
+            for (size_t i = 0; i <= pivot; ++i) {
+                score += order[i]->posting.impact() * order[i]->weight;
+                mask |= order[i]->bit;
+                order[i]->posting.Next();
+            }
+            if (score > threshold && !skip(doc)) {
+                collector->Collect(doc, score, mask);
+            }
+        } else {
+            for (size_t i = 0; i < pivot; ++i) {
+                order[i]->posting.SkipTo(doc);
+            }
+        }
+    }
+}
+
+} // namespace ns_index